@@ -0,0 +1,85 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextStream>
+#include <functional>
+
+// Timing helpers for moxie_bench. Each suite is a plain function that builds
+// its data, times the code under test against the path it replaced, and
+// prints one line per measurement.
+namespace Bench {
+
+inline QTextStream &out() {
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+// Keeps the compiler from discarding a result that is never otherwise used
+template <typename T>
+inline void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs body repeatedly for at least minMs (and at least once) and returns
+// the mean time of one run in nanoseconds
+inline double time(const std::function<void()> &body, int minMs = 300) {
+    body();     // warm caches and lazy statics
+    QElapsedTimer timer;
+    timer.start();
+    qint64 runs = 0;
+    do {
+        body();
+        ++runs;
+    } while (timer.elapsed() < minMs);
+    return double(timer.nsecsElapsed()) / double(runs);
+}
+
+// Times body once; for work too large to repeat
+inline double timeOnce(const std::function<void()> &body) {
+    QElapsedTimer timer;
+    timer.start();
+    body();
+    return double(timer.nsecsElapsed());
+}
+
+inline QString formatNs(double ns) {
+    if (ns >= 1e9) {
+        return QString::number(ns / 1e9, 'f', 2) + " s";
+    }
+    if (ns >= 1e6) {
+        return QString::number(ns / 1e6, 'f', 2) + " ms";
+    }
+    if (ns >= 1e3) {
+        return QString::number(ns / 1e3, 'f', 2) + " us";
+    }
+    return QString::number(ns, 'f', 0) + " ns";
+}
+
+inline void report(const QString &label, double ns, const QString &extra = QString()) {
+    out() << "  " << label.leftJustified(48) << formatNs(ns).rightJustified(12);
+    if (!extra.isEmpty()) {
+        out() << "   " << extra;
+    }
+    out() << Qt::endl;
+}
+
+// Reports body's time per run along with its throughput over bytes of input
+inline double reportThroughput(const QString &label, qint64 bytes, const std::function<void()> &body) {
+    const double ns = time(body);
+    report(label, ns, QString::number(bytes / ns * 1e9 / (1024.0 * 1024.0), 'f', 1) + " MB/s");
+    return ns;
+}
+
+inline void note(const QString &text) {
+    out() << "  " << text << Qt::endl;
+}
+
+} // namespace Bench
+
+// Suites, one per area; see main.cpp for how they are selected
+void benchTokenEstimator();
+void benchResponseParsing();
+void benchStorageFormats();
+void benchSearch();
+void benchUsageAggregates();
+void benchUsageStore();
@@ -0,0 +1,241 @@
+#include "Benchmark.h"
+#include "services/ProviderAdapter.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+
+namespace {
+
+// A reply of a few paragraphs with the escapes and non-ASCII text real
+// replies carry
+QString replyText(int paragraphs) {
+    QString text;
+    for (int i = 0; i < paragraphs; ++i) {
+        text += QStringLiteral("Dinosaurs lived a very long time ago — about 66 million years! "
+                               "Some, like the \"Brachiosaurus\", were taller than a house, and "
+                               "others were as small as a chicken. Paleontologists dig up their "
+                               "fossils very carefully.\n\nWould you like to hear about T. rex? \U0001F996\n\n");
+    }
+    return text;
+}
+
+QByteArray openAIResponse(const QString &content) {
+    QJsonObject message{{"role", "assistant"}, {"content", content}, {"refusal", QJsonValue()}};
+    QJsonObject choice{{"index", 0}, {"message", message}, {"logprobs", QJsonValue()},
+                       {"finish_reason", "stop"}};
+    QJsonObject usage{{"prompt_tokens", 812}, {"completion_tokens", 356}, {"total_tokens", 1168},
+                      {"prompt_tokens_details", QJsonObject{{"cached_tokens", 0}, {"audio_tokens", 0}}},
+                      {"completion_tokens_details", QJsonObject{{"reasoning_tokens", 0}, {"audio_tokens", 0},
+                                                                {"accepted_prediction_tokens", 0},
+                                                                {"rejected_prediction_tokens", 0}}}};
+    QJsonObject root{{"id", "chatcmpl-AjoahzpVYCyRmNyGBsF2QgU3CMiUM"}, {"object", "chat.completion"},
+                     {"created", 1735689600}, {"model", "gpt-4o-2024-08-06"},
+                     {"choices", QJsonArray{choice}}, {"usage", usage},
+                     {"system_fingerprint", "fp_5f20662549"}, {"service_tier", "default"}};
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+QByteArray anthropicResponse(const QString &content) {
+    QJsonObject block{{"type", "text"}, {"text", content}};
+    QJsonObject usage{{"input_tokens", 812}, {"cache_creation_input_tokens", 0},
+                      {"cache_read_input_tokens", 0}, {"output_tokens", 356}};
+    QJsonObject root{{"id", "msg_01XFDUDYJgAACzvnptvVoYEL"}, {"type", "message"}, {"role", "assistant"},
+                     {"model", "claude-3-5-sonnet-20241022"}, {"content", QJsonArray{block}},
+                     {"stop_reason", "end_turn"}, {"stop_sequence", QJsonValue()}, {"usage", usage}};
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+// Splits content into the word-sized deltas providers stream
+QStringList deltas(const QString &content) {
+    QStringList pieces;
+    qsizetype start = 0;
+    for (qsizetype i = 1; i <= content.size(); ++i) {
+        if (i == content.size() || content[i] == ' ') {
+            pieces.append(content.mid(start, i - start));
+            start = i;
+        }
+    }
+    return pieces;
+}
+
+QList<QByteArray> openAIFrames(const QString &content) {
+    QList<QByteArray> frames;
+    for (const QString &piece : deltas(content)) {
+        QJsonObject choice{{"index", 0}, {"delta", QJsonObject{{"content", piece}}},
+                           {"logprobs", QJsonValue()}, {"finish_reason", QJsonValue()}};
+        QJsonObject root{{"id", "chatcmpl-AjoahzpVYCyRmNyGBsF2QgU3CMiUM"}, {"object", "chat.completion.chunk"},
+                         {"created", 1735689600}, {"model", "gpt-4o-2024-08-06"},
+                         {"system_fingerprint", "fp_5f20662549"}, {"choices", QJsonArray{choice}},
+                         {"usage", QJsonValue()}};
+        frames.append(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    }
+    return frames;
+}
+
+QList<QByteArray> anthropicFrames(const QString &content) {
+    QList<QByteArray> frames;
+    for (const QString &piece : deltas(content)) {
+        QJsonObject root{{"type", "content_block_delta"}, {"index", 0},
+                         {"delta", QJsonObject{{"type", "text_delta"}, {"text", piece}}}};
+        frames.append(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    }
+    return frames;
+}
+
+// The QJsonDocument code the adapters replaced, kept here as the baseline
+
+void domOpenAIResponse(const QByteArray &data, ProviderResult &result) {
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    if (!doc.isObject()) {
+        result.error = "Invalid response format";
+        return;
+    }
+    QJsonObject obj = doc.object();
+    if (obj.contains("error")) {
+        result.error = "API Error: " + obj["error"].toObject()["message"].toString();
+        return;
+    }
+    QJsonArray choices = obj["choices"].toArray();
+    if (!choices.isEmpty()) {
+        QJsonObject message = choices[0].toObject()["message"].toObject();
+        result.text = message["content"].toString();
+    }
+    QJsonObject usage = obj["usage"].toObject();
+    result.inputTokens = usage["prompt_tokens"].toInt();
+    result.outputTokens = usage["completion_tokens"].toInt();
+}
+
+void domAnthropicResponse(const QByteArray &data, ProviderResult &result) {
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    if (!doc.isObject()) {
+        result.error = "Invalid response format";
+        return;
+    }
+    QJsonObject obj = doc.object();
+    if (obj.contains("error")) {
+        result.error = "API Error: " + obj["error"].toObject()["message"].toString();
+        return;
+    }
+    QJsonArray content = obj["content"].toArray();
+    if (!content.isEmpty()) {
+        result.text = content[0].toObject()["text"].toString();
+    }
+    QJsonObject usage = obj["usage"].toObject();
+    result.inputTokens = usage["input_tokens"].toInt();
+    result.outputTokens = usage["output_tokens"].toInt();
+}
+
+QString domOpenAIFrame(const QByteArray &data) {
+    QJsonObject obj = QJsonDocument::fromJson(data).object();
+    QJsonArray choices = obj["choices"].toArray();
+    if (choices.isEmpty()) {
+        return QString();
+    }
+    return choices[0].toObject()["delta"].toObject()["content"].toString();
+}
+
+QString domAnthropicFrame(const QByteArray &data) {
+    QJsonObject obj = QJsonDocument::fromJson(data).object();
+    if (obj["type"].toString() != QLatin1String("content_block_delta")) {
+        return QString();
+    }
+    return obj["delta"].toObject()["text"].toString();
+}
+
+qint64 totalSize(const QList<QByteArray> &frames) {
+    qint64 bytes = 0;
+    for (const QByteArray &frame : frames) {
+        bytes += frame.size();
+    }
+    return bytes;
+}
+
+void compare(const QString &label, qint64 bytes, const std::function<void()> &extractor,
+             const std::function<void()> &dom) {
+    const double fast = Bench::reportThroughput(label + ", extractor", bytes, extractor);
+    const double slow = Bench::reportThroughput(label + ", QJsonDocument", bytes, dom);
+    Bench::note(QString("%1x faster").arg(slow / fast, 0, 'f', 1));
+}
+
+} // namespace
+
+void benchResponseParsing() {
+    auto openAI = ProviderAdapter::create("OpenAI");
+    auto anthropic = ProviderAdapter::create("Anthropic");
+
+    for (int paragraphs : {1, 8, 64}) {
+        const QString content = replyText(paragraphs);
+
+        const QByteArray openAIBody = openAIResponse(content);
+        ProviderResult check;
+        openAI->parseResponse(openAIBody, check);
+        if (check.text != content || check.outputTokens != 356) {
+            Bench::note("OpenAI extractor result differs from the payload");
+        }
+        compare(QString("OpenAI response %1 KB").arg(openAIBody.size() / 1024.0, 0, 'f', 1),
+                openAIBody.size(),
+                [&]() {
+                    ProviderResult result;
+                    openAI->parseResponse(openAIBody, result);
+                    Bench::keep(result);
+                },
+                [&]() {
+                    ProviderResult result;
+                    domOpenAIResponse(openAIBody, result);
+                    Bench::keep(result);
+                });
+
+        const QByteArray anthropicBody = anthropicResponse(content);
+        compare(QString("Anthropic response %1 KB").arg(anthropicBody.size() / 1024.0, 0, 'f', 1),
+                anthropicBody.size(),
+                [&]() {
+                    ProviderResult result;
+                    anthropic->parseResponse(anthropicBody, result);
+                    Bench::keep(result);
+                },
+                [&]() {
+                    ProviderResult result;
+                    domAnthropicResponse(anthropicBody, result);
+                    Bench::keep(result);
+                });
+    }
+
+    // A whole streamed reply, one SSE data payload per delta
+    const QString content = replyText(8);
+    const QList<QByteArray> openAIStream = openAIFrames(content);
+    compare(QString("OpenAI stream, %1 frames").arg(openAIStream.size()), totalSize(openAIStream),
+            [&]() {
+                ProviderResult result;
+                QString text;
+                for (const QByteArray &frame : openAIStream) {
+                    text += openAI->parseStreamFrame(frame, result);
+                }
+                Bench::keep(text);
+            },
+            [&]() {
+                QString text;
+                for (const QByteArray &frame : openAIStream) {
+                    text += domOpenAIFrame(frame);
+                }
+                Bench::keep(text);
+            });
+
+    const QList<QByteArray> anthropicStream = anthropicFrames(content);
+    compare(QString("Anthropic stream, %1 frames").arg(anthropicStream.size()), totalSize(anthropicStream),
+            [&]() {
+                ProviderResult result;
+                QString text;
+                for (const QByteArray &frame : anthropicStream) {
+                    text += anthropic->parseStreamFrame(frame, result);
+                }
+                Bench::keep(text);
+            },
+            [&]() {
+                QString text;
+                for (const QByteArray &frame : anthropicStream) {
+                    text += domAnthropicFrame(frame);
+                }
+                Bench::keep(text);
+            });
+}
@@ -0,0 +1,90 @@
+#include "Benchmark.h"
+#include "services/DatabaseService.h"
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QTemporaryDir>
+
+namespace {
+
+constexpr int Conversations = 400;
+constexpr int MessagesPerConversation = 300;     // 120k messages in all
+constexpr double TargetMs = 10.0;
+
+const QStringList &commonWords() {
+    static const QStringList words = {
+        "the", "a", "and", "is", "it", "you", "i", "to", "of", "what", "why", "how", "do", "like",
+        "dinosaur", "robot", "moon", "planet", "story", "school", "friend", "dog", "cat", "game",
+        "color", "favorite", "happy", "sad", "tell", "me", "about", "big", "small", "fast",
+        "ocean", "space", "rocket", "music", "draw", "read"};
+    return words;
+}
+
+// Mostly common words with a sprinkling from a large rare vocabulary, so
+// both frequent and selective terms are realistic
+QString sentence(QRandomGenerator &random) {
+    QStringList words;
+    const int length = 6 + random.bounded(18);
+    for (int i = 0; i < length; ++i) {
+        if (random.bounded(5) == 0) {
+            words.append(QString("word%1").arg(random.bounded(5000)));
+        } else {
+            words.append(commonWords().at(random.bounded(commonWords().size())));
+        }
+    }
+    return words.join(' ');
+}
+
+void populate(DatabaseService &database) {
+    QRandomGenerator random(42);
+    QDateTime time = QDateTime::currentDateTime().addDays(-365);
+    for (int c = 0; c < Conversations; ++c) {
+        Conversation conversation(QString("Chat %1").arg(c), QString("child-%1").arg(c % 3));
+        for (int m = 0; m < MessagesPerConversation; ++m) {
+            ChatMessage message(m % 2 == 0 ? "user" : "assistant", sentence(random));
+            time = time.addSecs(60);
+            message.timestamp = time;
+            conversation.messages.append(message);
+        }
+        conversation.messageCount = MessagesPerConversation;
+        conversation.updatedAt = time;
+        database.saveConversation(conversation);
+    }
+    database.flush();
+}
+
+void search(DatabaseService &database, const QString &label, const QString &text,
+            const QString &childProfileId = QString()) {
+    int hits = 0;
+    const double ns = Bench::time([&]() {
+        hits = database.searchMessages(text, 50, childProfileId).size();
+    });
+    Bench::report(label, ns, QString("%1 hits, %2").arg(hits).arg(ns / 1e6 < TargetMs ? "under 10 ms" : "OVER 10 ms"));
+}
+
+} // namespace
+
+void benchSearch() {
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        Bench::note("No temporary directory");
+        return;
+    }
+    DatabaseService database(directory.filePath("search.db"));
+    if (!database.isOpen()) {
+        Bench::note("Could not open the database");
+        return;
+    }
+
+    const int total = Conversations * MessagesPerConversation;
+    const double buildNs = Bench::timeOnce([&]() { populate(database); });
+    Bench::report(QString("Store and index %1 messages").arg(total), buildNs,
+                  QString("%1 us/message").arg(buildNs / total / 1e3, 0, 'f', 1));
+    database.checkpoint();
+
+    search(database, "Common word", "dinosaur");
+    search(database, "Rare word", "word1234");
+    search(database, "Two words", "robot word77");
+    search(database, "Prefix", "dino");
+    search(database, "Common word, one child", "dinosaur", "child-1");
+    search(database, "No match", "xylophone");
+}
@@ -0,0 +1,103 @@
+#include "Benchmark.h"
+#include "models/Conversation.h"
+#include "services/ChatHistory.h"
+#include <QCborMap>
+#include <QCborValue>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+
+namespace {
+
+// Alternating turns with the length and punctuation of real chats
+Conversation makeConversation(int messages) {
+    Conversation conversation("Dinosaur questions", "child-1");
+    conversation.personalityId = "friendly";
+    QDateTime time = QDateTime::currentDateTime().addDays(-30);
+    for (int i = 0; i < messages; ++i) {
+        const bool user = i % 2 == 0;
+        ChatMessage message(user ? "user" : "assistant",
+                            user ? QStringLiteral("Why did the dinosaurs go extinct? Was it the asteroid? #%1").arg(i)
+                                 : QStringLiteral("Great question! About 66 million years ago a huge asteroid hit "
+                                                  "Earth near what is now Mexico. Dust blocked the sun, plants "
+                                                  "died, and the big dinosaurs ran out of food. Birds are the "
+                                                  "dinosaurs that survived \U0001F426 (%1)").arg(i));
+        time = time.addSecs(20);
+        message.timestamp = time;
+        conversation.messages.append(message);
+    }
+    conversation.messageCount = messages;
+    conversation.updatedAt = time;
+    return conversation;
+}
+
+// What the JSON backend wrote: indented, ISO-8601 dates
+QByteArray jsonFile(const Conversation &conversation) {
+    return QJsonDocument(conversation.toJson()).toJson(QJsonDocument::Indented);
+}
+
+// What ConversationJournal writes as <id>.snapshot.cbor
+QByteArray cborSnapshot(const Conversation &conversation) {
+    QCborMap root;
+    root.insert(QStringLiteral("v"), 1);
+    root.insert(QStringLiteral("lastSeq"), 0);
+    root.insert(QStringLiteral("conversation"), conversation.toCbor());
+    return root.toCborValue().toCbor();
+}
+
+QString kilobytes(qint64 bytes) {
+    return QString::number(bytes / 1024.0, 'f', 1) + " KB";
+}
+
+} // namespace
+
+void benchStorageFormats() {
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        Bench::note("No temporary directory");
+        return;
+    }
+
+    for (int messages : {100, 1000, 10000}) {
+        const Conversation conversation = makeConversation(messages);
+        const QByteArray json = jsonFile(conversation);
+        const QByteArray cbor = cborSnapshot(conversation);
+        Bench::note(QString("%1 messages: JSON %2, CBOR %3 (%4% of JSON)")
+                        .arg(messages)
+                        .arg(kilobytes(json.size()), kilobytes(cbor.size()))
+                        .arg(100.0 * cbor.size() / json.size(), 0, 'f', 0));
+
+        // Full decode of each format into a Conversation
+        const double jsonNs = Bench::reportThroughput(QString("%1 messages, JSON load").arg(messages), json.size(), [&]() {
+            Conversation loaded = Conversation::fromJson(QJsonDocument::fromJson(json).object());
+            Bench::keep(loaded);
+        });
+        const double cborNs = Bench::reportThroughput(QString("%1 messages, CBOR load").arg(messages), cbor.size(), [&]() {
+            Conversation loaded = Conversation::fromCbor(QCborValue::fromCbor(cbor).toMap());
+            Bench::keep(loaded);
+        });
+        Bench::note(QString("CBOR %1x faster").arg(jsonNs / cborNs, 0, 'f', 1));
+
+        // What opening the conversation costs in the app: ChatHistory maps
+        // the snapshot and indexes it, decoding only the rows shown
+        const QString snapshotPath = directory.filePath(QString("%1.snapshot.cbor").arg(messages));
+        QFile file(snapshotPath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(cbor) != cbor.size()) {
+            Bench::note("Could not write " + snapshotPath);
+            continue;
+        }
+        file.close();
+        const QString journalPath = directory.filePath("none.journal");
+        const double openNs = Bench::time([&]() {
+            ChatHistory history;
+            Conversation header;
+            ChatHistory::ReplayState state;
+            history.open(snapshotPath, journalPath, &header, &state);
+            for (int row = qMax(0, history.size() - 30); row < history.size(); ++row) {
+                Bench::keep(history.at(row));
+            }
+        });
+        Bench::report(QString("%1 messages, ChatHistory open + last 30").arg(messages), openNs,
+                      QString("%1x faster than JSON").arg(jsonNs / openNs, 0, 'f', 1));
+    }
+}
@@ -0,0 +1,97 @@
+#include "Benchmark.h"
+#include "utils/TokenEstimator.h"
+#include <QJsonObject>
+#include <QList>
+#include <QRandomGenerator>
+#include <iterator>
+
+namespace {
+
+// Chat-like turns: mostly English words with numbers, punctuation, the odd
+// emoji and a little non-Latin text, so every branch of the classifier runs
+QString makeTurn(QRandomGenerator &random, int targetChars) {
+    static const char *const words[] = {
+        "the", "robot", "likes", "dinosaurs", "because", "they're", "enormous", "and", "today",
+        "we", "counted", "planets", "spelling", "practice", "wonderful", "question", "why",
+        "does", "the", "moon", "change", "shape", "every", "night", "photosynthesis", "I",
+        "think", "maybe", "elephants", "remember", "everything", "ok", "let's", "try", "again",
+    };
+    static const QString extras[] = {
+        QStringLiteral("42"), QStringLiteral("3.14"), QStringLiteral("?!"), QStringLiteral("..."),
+        QStringLiteral("\U0001F996"), QStringLiteral("école"), QStringLiteral("こんにちは"),
+        QStringLiteral("\n\n"),
+    };
+
+    QString text;
+    text.reserve(targetChars + 32);
+    while (text.size() < targetChars) {
+        if (random.bounded(12) == 0) {
+            text += extras[random.bounded(int(std::size(extras)))];
+        } else {
+            text += QLatin1String(words[random.bounded(int(std::size(words)))]);
+        }
+        text += random.bounded(10) == 0 ? QStringLiteral(", ") : QStringLiteral(" ");
+    }
+    return text;
+}
+
+QList<QJsonObject> makeConversation(int totalChars, int turnChars) {
+    QRandomGenerator random(5);
+    QList<QJsonObject> messages;
+    messages.append(QJsonObject{{"role", "system"}, {"content", makeTurn(random, 400)}});
+    int chars = 400;
+    bool user = true;
+    while (chars < totalChars) {
+        const QString content = makeTurn(random, turnChars);
+        chars += content.size();
+        messages.append(QJsonObject{{"role", user ? "user" : "assistant"}, {"content", content}});
+        user = !user;
+    }
+    return messages;
+}
+
+qint64 utf16Bytes(const QList<QJsonObject> &messages) {
+    qint64 bytes = 0;
+    for (const auto &msg : messages) {
+        bytes += msg["content"].toString().size() * qint64(sizeof(QChar));
+    }
+    return bytes;
+}
+
+} // namespace
+
+void benchTokenEstimator() {
+    struct Case {
+        const char *label;
+        int totalChars;
+        int turnChars;
+    };
+    const Case cases[] = {
+        {"2 KB", 2 * 1024, 200},
+        {"8 KB", 8 * 1024, 300},
+        {"32 KB", 32 * 1024, 500},
+        {"128 KB", 128 * 1024, 800},
+    };
+    const char *const models[] = {"gpt-4o", "claude-3-5-sonnet", "llama3.2"};
+
+    for (const Case &c : cases) {
+        const QList<QJsonObject> messages = makeConversation(c.totalChars, c.turnChars);
+        const qint64 bytes = utf16Bytes(messages);
+        for (const char *model : models) {
+            const QString name = QString::fromLatin1(model);
+            Bench::reportThroughput(
+                QString("countMessages %1, %2 turns, %3").arg(c.label).arg(messages.size()).arg(name),
+                bytes, [&]() {
+                    Bench::keep(TokenEstimator::countMessages(messages, name));
+                });
+        }
+    }
+
+    // Single long text, the shape ContextWindowManager walks turn by turn
+    QRandomGenerator random(9);
+    const QString text = makeTurn(random, 64 * 1024);
+    const auto encoding = TokenEstimator::encodingForModel("gpt-4o");
+    Bench::reportThroughput("countText 64 KB, o200k", text.size() * qint64(sizeof(QChar)), [&]() {
+        Bench::keep(TokenEstimator::countText(QStringView(text), encoding));
+    });
+}
@@ -0,0 +1,156 @@
+#include "Benchmark.h"
+#include "services/UsageAggregates.h"
+#include <QList>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QSet>
+
+namespace {
+
+constexpr int Records = 1000000;
+constexpr int Days = 365;
+
+// A year of usage from three children across five models, oldest first,
+// with every string allocated separately as it is when read from the database
+QList<UsageRecord> makeRecords() {
+    static const char *models[] = {"gpt-4", "gpt-3.5-turbo", "claude-3-haiku", "llama3", "mistral"};
+    QRandomGenerator random(7);
+    QList<UsageRecord> records;
+    records.reserve(Records);
+    const QDateTime start = QDateTime::currentDateTime().addDays(-Days);
+    const qint64 stepMs = qint64(Days) * 24 * 60 * 60 * 1000 / Records;
+    for (int i = 0; i < Records; ++i) {
+        UsageRecord record(QString("child-%1").arg(random.bounded(3)), QString("chat"),
+                           QString(models[random.bounded(5)]));
+        record.id = QString("usage-%1").arg(i);
+        record.sessionId = QString("session-%1").arg(i / 20);
+        record.tokensUsed = 50 + random.bounded(1500);
+        record.estimatedCost = record.calculateCost(record.tokensUsed, record.aiModel);
+        record.timestamp = start.addMSecs(i * stepMs);
+        record.durationSeconds = random.bounded(120);
+        records.append(record);
+    }
+    return records;
+}
+
+// The statistics as UsageViewModel computed them before, one pass each
+struct ScanStatistics {
+    double today = 0.0;
+    double week = 0.0;
+    double month = 0.0;
+    qint64 tokens = 0;
+    int sessions = 0;
+    QString model;
+    QString child;
+};
+
+QString leader(const QMap<QString, int> &counts) {
+    QString best;
+    int bestCount = 0;
+    for (auto it = counts.begin(); it != counts.end(); ++it) {
+        if (it.value() > bestCount) {
+            bestCount = it.value();
+            best = it.key();
+        }
+    }
+    return best;
+}
+
+ScanStatistics scan(const QList<UsageRecord> &records) {
+    ScanStatistics stats;
+    const QDateTime now = QDateTime::currentDateTime();
+    for (const auto &record : records) {
+        if (record.timestamp.date() == now.date()) {
+            stats.today += record.estimatedCost;
+        }
+    }
+    const QDateTime weekAgo = now.addDays(-7);
+    for (const auto &record : records) {
+        if (record.timestamp >= weekAgo) {
+            stats.week += record.estimatedCost;
+        }
+    }
+    const QDateTime monthAgo = now.addMonths(-1);
+    for (const auto &record : records) {
+        if (record.timestamp >= monthAgo) {
+            stats.month += record.estimatedCost;
+        }
+    }
+    for (const auto &record : records) {
+        stats.tokens += record.tokensUsed;
+    }
+    QSet<QString> sessions;
+    for (const auto &record : records) {
+        sessions.insert(record.sessionId);
+    }
+    stats.sessions = sessions.size();
+    QMap<QString, int> models;
+    for (const auto &record : records) {
+        models[record.aiModel]++;
+    }
+    stats.model = leader(models);
+    QMap<QString, int> children;
+    for (const auto &record : records) {
+        children[record.childProfileId]++;
+    }
+    stats.child = leader(children);
+    return stats;
+}
+
+ScanStatistics readAggregates(const UsageAggregates &aggregates) {
+    ScanStatistics stats;
+    const QDate today = QDate::currentDate();
+    stats.today = aggregates.costOn(today);
+    stats.week = aggregates.costBetween(today.addDays(-6), today);
+    stats.month = aggregates.costBetween(today.addMonths(-1), today);
+    stats.tokens = aggregates.totalTokens();
+    stats.sessions = aggregates.sessionCount();
+    stats.model = aggregates.mostUsedModel();
+    stats.child = aggregates.mostActiveChild();
+    return stats;
+}
+
+} // namespace
+
+void benchUsageAggregates() {
+    const QList<UsageRecord> records = makeRecords();
+
+    UsageAggregates aggregates;
+    const double buildNs = Bench::timeOnce([&]() {
+        for (const auto &record : records) {
+            aggregates.add(record);
+        }
+    });
+    Bench::report(QString("Aggregates, add %1 records").arg(Records), buildNs,
+                  QString("%1 ns/record").arg(buildNs / Records, 0, 'f', 0));
+
+    const double scanNs = Bench::time([&]() { Bench::keep(scan(records)); });
+    Bench::report(QString("Old scan, all statistics, %1 records").arg(Records), scanNs);
+    const double readNs = Bench::time([&]() { Bench::keep(readAggregates(aggregates)); });
+    Bench::report("Aggregates, all statistics", readNs,
+                  QString("%1x faster").arg(scanNs / readNs, 0, 'f', 0));
+
+    // The leader is recounted after it loses a record, over distinct keys only
+    const double leaderNs = Bench::time([&]() {
+        aggregates.remove(records.last());
+        aggregates.add(records.last());
+        Bench::keep(aggregates.mostUsedModel());
+        Bench::keep(aggregates.mostActiveChild());
+    });
+    Bench::report("Aggregates, remove + add + leaders", leaderNs);
+
+    // Expiry of the oldest day, as the view model does on a roll-up
+    const QDate firstDay = records.first().timestamp.date();
+    int expired = 0;
+    const double expireNs = Bench::timeOnce([&]() {
+        for (const auto &record : records) {
+            if (record.timestamp.date() != firstDay) {
+                break;
+            }
+            aggregates.remove(record);
+            ++expired;
+        }
+    });
+    Bench::report("Aggregates, expire the oldest day", expireNs,
+                  QString("%1 records").arg(expired));
+}
@@ -0,0 +1,204 @@
+#include "Benchmark.h"
+#include "services/UsageStore.h"
+#include "services/UsageView.h"
+#include <QFile>
+#include <QList>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QUuid>
+#include <unistd.h>
+
+namespace {
+
+constexpr int Records = 1000000;
+constexpr int Days = 365;
+
+// A deep copy, as every string read from the database is its own allocation
+QString copyOf(const QString &string) {
+    return QString(string.constData(), string.size());
+}
+
+// A year of usage from three children across five models, oldest first. Ids
+// are UUIDs as in the app; record ids and error messages are left unset.
+QList<UsageRecord> makeRecords() {
+    static const char *models[] = {"gpt-4", "gpt-3.5-turbo", "claude-3-haiku", "llama3", "mistral"};
+    QRandomGenerator random(7);
+    QStringList children;
+    for (int i = 0; i < 3; ++i) {
+        children.append(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    }
+    QString session;
+    QList<UsageRecord> records;
+    records.reserve(Records);
+    const QDateTime start = QDateTime::currentDateTime().addDays(-Days);
+    const qint64 stepMs = qint64(Days) * 24 * 60 * 60 * 1000 / Records;
+    for (int i = 0; i < Records; ++i) {
+        if (i % 20 == 0) {
+            session = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        }
+        UsageRecord record(copyOf(children.at(random.bounded(3))), QString("chat"),
+                           QString(models[random.bounded(5)]));
+        record.sessionId = copyOf(session);
+        record.tokensUsed = 50 + random.bounded(1500);
+        record.estimatedCost = record.calculateCost(record.tokensUsed, record.aiModel);
+        record.timestamp = start.addMSecs(i * stepMs);
+        record.durationSeconds = random.bounded(120);
+        records.append(record);
+    }
+    return records;
+}
+
+// Resident set size in bytes, or -1 where /proc is unavailable
+qint64 residentBytes() {
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) : -1;
+}
+
+template <typename T>
+qint64 columnBytes(const QList<T> &column) {
+    return column.capacity() * qint64(sizeof(T));
+}
+
+qint64 stringBytes(const QString &string) {
+    return qint64(sizeof(QString)) + (string.isNull() ? 0 : 2 * (string.size() + 1));
+}
+
+// Heap held by the store's columns, posting lists, sparse tables and string
+// dictionary, counting unused list capacity but not allocator overhead
+qint64 storeBytes(const UsageStore &store) {
+    qint64 bytes = 0;
+    for (const UsageStore::Partition &part : store.partitions()) {
+        bytes += sizeof(UsageStore::Partition);
+        bytes += columnBytes(part.timestamps) + columnBytes(part.children) + columnBytes(part.features)
+            + columnBytes(part.models) + columnBytes(part.sessions) + columnBytes(part.tokens)
+            + columnBytes(part.durations) + columnBytes(part.costs) + columnBytes(part.successful);
+        for (const QString &id : part.ids) {
+            bytes += sizeof(int) + stringBytes(id);
+        }
+        for (const QString &error : part.errors) {
+            bytes += sizeof(int) + stringBytes(error);
+        }
+    }
+    for (int code = 0; code < store.stringCount(); ++code) {
+        // Once in the list and once as a hash key
+        bytes += 2 * stringBytes(store.string(code)) + sizeof(quint32);
+        bytes += columnBytes(store.childRows(code)) + columnBytes(store.modelRows(code));
+    }
+    return bytes;
+}
+
+QString perRecord(qint64 bytes) {
+    return QString::number(double(bytes) / Records, 'f', 1) + " bytes/record";
+}
+
+// What UsageViewModel did before: copy the matching records into a second list
+QList<UsageRecord> filterList(const QList<UsageRecord> &records, const UsageView::Filter &filter) {
+    QList<UsageRecord> result;
+    for (const auto &record : records) {
+        if (!filter.childProfileId.isEmpty() && record.childProfileId != filter.childProfileId) {
+            continue;
+        }
+        if (!filter.aiModel.isEmpty() && record.aiModel != filter.aiModel) {
+            continue;
+        }
+        if (filter.start.isValid() && record.timestamp < filter.start) {
+            continue;
+        }
+        if (filter.end.isValid() && record.timestamp > filter.end) {
+            continue;
+        }
+        result.append(record);
+    }
+    return result;
+}
+
+struct Totals {
+    qint64 tokens = 0;
+    double cost = 0.0;
+};
+
+Totals sumList(const QList<UsageRecord> &records) {
+    Totals totals;
+    for (const auto &record : records) {
+        totals.tokens += record.tokensUsed;
+        totals.cost += record.estimatedCost;
+    }
+    return totals;
+}
+
+// Walks the view's rows partition by partition, reading only two columns
+Totals sumView(const UsageStore &store, const UsageView &view) {
+    Totals totals;
+    const auto &partitions = store.partitions();
+    int p = 0;
+    for (int i = 0; i < view.size(); ++i) {
+        const int row = view.rowAt(i);
+        while (p + 1 < partitions.size() && store.partitionStart(p + 1) <= row) {
+            ++p;
+        }
+        const int offset = row - store.partitionStart(p);
+        totals.tokens += partitions[p].tokens.at(offset);
+        totals.cost += partitions[p].costs.at(offset);
+    }
+    return totals;
+}
+
+QString recordsPerSecond(qsizetype records, double ns) {
+    return QString::number(records / ns * 1e3, 'f', 1) + " M records/s";
+}
+
+void compare(const QList<UsageRecord> &records, const UsageStore &store, const QString &label,
+             const UsageView::Filter &filter) {
+    QList<UsageRecord> filtered;
+    const double listNs = Bench::time([&]() { filtered = filterList(records, filter); });
+    Bench::report(label + ", QList filter", listNs, recordsPerSecond(records.size(), listNs));
+
+    UsageView view(&store);
+    const double viewNs = Bench::time([&]() { view.setFilter(filter); });
+    Bench::report(label + ", UsageView", viewNs,
+                  QString("%1 rows, %2x faster").arg(view.size()).arg(listNs / viewNs, 0, 'f', 0));
+    if (view.size() != filtered.size()) {
+        Bench::note(QString("MISMATCH: list has %1 rows").arg(filtered.size()));
+    }
+
+    const double listSumNs = Bench::time([&]() { Bench::keep(sumList(filtered)); });
+    Bench::report(label + ", QList sum", listSumNs, recordsPerSecond(filtered.size(), listSumNs));
+    const double viewSumNs = Bench::time([&]() { Bench::keep(sumView(store, view)); });
+    Bench::report(label + ", column sum", viewSumNs, recordsPerSecond(view.size(), viewSumNs));
+}
+
+} // namespace
+
+void benchUsageStore() {
+    const qint64 before = residentBytes();
+    const QList<UsageRecord> records = makeRecords();
+    const qint64 afterList = residentBytes();
+
+    UsageStore store;
+    const double buildNs = Bench::timeOnce([&]() {
+        for (const auto &record : records) {
+            store.insert(record);
+        }
+    });
+    const qint64 afterStore = residentBytes();
+    Bench::report(QString("UsageStore, insert %1 records").arg(Records), buildNs,
+                  QString("%1 ns/record").arg(buildNs / Records, 0, 'f', 0));
+
+    Bench::note(QString("UsageStore payload: %1").arg(perRecord(storeBytes(store))));
+    if (before >= 0) {
+        Bench::note(QString("Resident: QList<UsageRecord> %1, UsageStore %2")
+                        .arg(perRecord(afterList - before), perRecord(afterStore - afterList)));
+    }
+
+    const QString child = records.first().childProfileId;
+    const QDateTime end = records.last().timestamp;
+    const QDateTime monthAgo = end.addMonths(-1);
+    compare(records, store, "Last month", {QString(), QString(), monthAgo, end});
+    compare(records, store, "One child", {child, QString(), QDateTime(), QDateTime()});
+    compare(records, store, "One child, last month", {child, QString(), monthAgo, end});
+    compare(records, store, "One child and model", {child, QString("gpt-4"), QDateTime(), QDateTime()});
+}
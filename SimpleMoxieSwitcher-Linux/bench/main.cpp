@@ -0,0 +1,34 @@
+#include "Benchmark.h"
+#include <QCoreApplication>
+#include <QStringList>
+
+// moxie_bench [suite...]
+// Runs the named suites, or all of them. Build with -DBUILD_BENCHMARKS=ON
+// and a Release build type; debug timings mean little.
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    struct Suite {
+        const char *name;
+        void (*run)();
+    };
+    const Suite suites[] = {
+        {"tokens", benchTokenEstimator},
+        {"parsing", benchResponseParsing},
+        {"formats", benchStorageFormats},
+        {"search", benchSearch},
+        {"usage", benchUsageAggregates},
+        {"store", benchUsageStore},
+    };
+
+    const QStringList selected = app.arguments().mid(1);
+    for (const Suite &suite : suites) {
+        if (!selected.isEmpty() && !selected.contains(QLatin1String(suite.name))) {
+            continue;
+        }
+        Bench::out() << suite.name << Qt::endl;
+        suite.run();
+        Bench::out() << Qt::endl;
+    }
+    return 0;
+}
@@ -5,6 +5,8 @@
 #include <QList>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QUuid>
+#include "../utils/CborUtils.h"
 
 // ChatMessage represents a single message in a conversation
 struct ChatMessage {
@@ -26,7 +28,8 @@ public:
         : role(msgRole)
         , content(msgContent)
         , timestamp(QDateTime::currentDateTime()) {
-        id = QString::number(QDateTime::currentMSecsSinceEpoch());
+        // Journal records refer to messages by id, so ids must never collide
+        id = QUuid::createUuid().toString(QUuid::WithoutBraces);
     }
 
     QJsonObject toJson() const {
@@ -46,6 +49,24 @@ public:
         m.timestamp = QDateTime::fromString(json["timestamp"].toString(), Qt::ISODate);
         return m;
     }
+
+    QCborMap toCbor() const {
+        QCborMap map;
+        map.insert(QStringLiteral("id"), id);
+        map.insert(QStringLiteral("role"), role);
+        map.insert(QStringLiteral("content"), content);
+        map.insert(QStringLiteral("timestamp"), CborUtils::fromDateTime(timestamp));
+        return map;
+    }
+
+    static ChatMessage fromCbor(const QCborMap& map) {
+        ChatMessage m;
+        m.id = map.value(QStringLiteral("id")).toString();
+        m.role = map.value(QStringLiteral("role")).toString();
+        m.content = map.value(QStringLiteral("content")).toString();
+        m.timestamp = CborUtils::toDateTime(map.value(QStringLiteral("timestamp")));
+        return m;
+    }
 };
 
 Q_DECLARE_METATYPE(ChatMessage)
@@ -73,6 +94,11 @@ public:
     int messageCount = 0;
     bool isArchived = false;
 
+    // Rolling summary of the first summarizedCount messages, kept so a
+    // reopened chat still remembers turns that no longer fit the prompt
+    QString summary;
+    int summarizedCount = 0;
+
     Conversation() = default;
 
     Conversation(const QString& conversationTitle, const QString& profileId)
@@ -80,7 +106,7 @@ public:
         , childProfileId(profileId)
         , createdAt(QDateTime::currentDateTime())
         , updatedAt(QDateTime::currentDateTime()) {
-        id = QString::number(QDateTime::currentMSecsSinceEpoch());
+        id = QUuid::createUuid().toString(QUuid::WithoutBraces);
     }
 
     void addMessage(const ChatMessage& msg) {
@@ -99,6 +125,8 @@ public:
         obj["updatedAt"] = updatedAt.toString(Qt::ISODate);
         obj["messageCount"] = messageCount;
         obj["isArchived"] = isArchived;
+        obj["summary"] = summary;
+        obj["summarizedCount"] = summarizedCount;
 
         QJsonArray msgArray;
         for (const auto& msg : messages) {
@@ -119,6 +147,8 @@ public:
         c.updatedAt = QDateTime::fromString(json["updatedAt"].toString(), Qt::ISODate);
         c.messageCount = json["messageCount"].toInt(0);
         c.isArchived = json["isArchived"].toBool(false);
+        c.summary = json["summary"].toString();
+        c.summarizedCount = json["summarizedCount"].toInt(0);
 
         QJsonArray msgArray = json["messages"].toArray();
         for (const auto& m : msgArray) {
@@ -127,6 +157,49 @@ public:
 
         return c;
     }
+
+    QCborMap toCbor() const {
+        QCborMap map;
+        map.insert(QStringLiteral("id"), id);
+        map.insert(QStringLiteral("title"), title);
+        map.insert(QStringLiteral("childProfileId"), childProfileId);
+        map.insert(QStringLiteral("personalityId"), personalityId);
+        map.insert(QStringLiteral("createdAt"), CborUtils::fromDateTime(createdAt));
+        map.insert(QStringLiteral("updatedAt"), CborUtils::fromDateTime(updatedAt));
+        map.insert(QStringLiteral("isArchived"), isArchived);
+        map.insert(QStringLiteral("summary"), summary);
+        map.insert(QStringLiteral("summarizedCount"), summarizedCount);
+
+        QCborArray msgArray;
+        for (const auto& msg : messages) {
+            msgArray.append(msg.toCbor());
+        }
+        map.insert(QStringLiteral("messages"), msgArray);
+
+        return map;
+    }
+
+    static Conversation fromCbor(const QCborMap& map) {
+        Conversation c;
+        c.id = map.value(QStringLiteral("id")).toString();
+        c.title = map.value(QStringLiteral("title")).toString();
+        c.childProfileId = map.value(QStringLiteral("childProfileId")).toString();
+        c.personalityId = map.value(QStringLiteral("personalityId")).toString();
+        c.createdAt = CborUtils::toDateTime(map.value(QStringLiteral("createdAt")));
+        c.updatedAt = CborUtils::toDateTime(map.value(QStringLiteral("updatedAt")));
+        c.isArchived = map.value(QStringLiteral("isArchived")).toBool(false);
+        c.summary = map.value(QStringLiteral("summary")).toString();
+        c.summarizedCount = static_cast<int>(map.value(QStringLiteral("summarizedCount")).toInteger(0));
+
+        const QCborArray msgArray = map.value(QStringLiteral("messages")).toArray();
+        c.messages.reserve(msgArray.size());
+        for (const auto& m : msgArray) {
+            c.messages.append(ChatMessage::fromCbor(m.toMap()));
+        }
+        c.messageCount = c.messages.size();
+
+        return c;
+    }
 };
 
 Q_DECLARE_METATYPE(Conversation)
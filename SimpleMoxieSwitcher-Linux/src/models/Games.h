@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QDateTime>
 #include <QList>
+#include <QJsonObject>
+#include <QJsonArray>
 
 enum class GameType {
     Trivia,
@@ -19,6 +21,63 @@ enum class Difficulty {
     Hard
 };
 
+inline QString gameTypeToString(GameType type) {
+    switch (type) {
+        case GameType::Trivia: return "Trivia";
+        case GameType::SpellingBee: return "SpellingBee";
+        case GameType::MovieLines: return "MovieLines";
+        case GameType::VideoGames: return "VideoGames";
+        case GameType::KnowledgeQuest: return "KnowledgeQuest";
+    }
+    return "Trivia";
+}
+
+inline GameType gameTypeFromString(const QString& name) {
+    const QString key = name.toLower().remove(' ').remove('_');
+    if (key == "spellingbee" || key == "spelling") return GameType::SpellingBee;
+    if (key == "movielines" || key == "movies") return GameType::MovieLines;
+    if (key == "videogames") return GameType::VideoGames;
+    if (key == "knowledgequest") return GameType::KnowledgeQuest;
+    return GameType::Trivia;
+}
+
+inline QString difficultyToString(Difficulty difficulty) {
+    switch (difficulty) {
+        case Difficulty::Easy: return "Easy";
+        case Difficulty::Medium: return "Medium";
+        case Difficulty::Hard: return "Hard";
+    }
+    return "Easy";
+}
+
+inline Difficulty difficultyFromString(const QString& name) {
+    const QString key = name.toLower();
+    if (key == "medium") return Difficulty::Medium;
+    if (key == "hard") return Difficulty::Hard;
+    return Difficulty::Easy;
+}
+
+inline int pointsForDifficulty(Difficulty difficulty) {
+    switch (difficulty) {
+        case Difficulty::Easy: return 10;
+        case Difficulty::Medium: return 20;
+        case Difficulty::Hard: return 30;
+    }
+    return 10;
+}
+
+inline QJsonArray toJsonArray(const QStringList& list) {
+    return QJsonArray::fromStringList(list);
+}
+
+inline QStringList toStringList(const QJsonArray& array) {
+    QStringList list;
+    for (const auto& value : array) {
+        list.append(value.toString());
+    }
+    return list;
+}
+
 struct TriviaQuestion {
     QString question;
     QStringList options;
@@ -27,6 +86,33 @@ struct TriviaQuestion {
     Difficulty difficulty;
     int points;
     int userAnswer = -1;
+
+    bool isValid() const {
+        return !question.isEmpty() && options.size() >= 2
+            && correctAnswer >= 0 && correctAnswer < options.size();
+    }
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["question"] = question;
+        obj["options"] = toJsonArray(options);
+        obj["correctAnswer"] = correctAnswer;
+        obj["category"] = category;
+        obj["difficulty"] = difficultyToString(difficulty);
+        obj["points"] = points;
+        return obj;
+    }
+
+    static TriviaQuestion fromJson(const QJsonObject& json) {
+        TriviaQuestion q;
+        q.question = json["question"].toString();
+        q.options = toStringList(json["options"].toArray());
+        q.correctAnswer = json["correctAnswer"].toInt(-1);
+        q.category = json["category"].toString();
+        q.difficulty = difficultyFromString(json["difficulty"].toString());
+        q.points = json["points"].toInt(pointsForDifficulty(q.difficulty));
+        return q;
+    }
 };
 
 struct SpellingWord {
@@ -37,6 +123,28 @@ struct SpellingWord {
     int points;
     QString userSpelling;
     int attempts = 0;
+
+    bool isValid() const { return !word.isEmpty() && !definition.isEmpty(); }
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["word"] = word;
+        obj["definition"] = definition;
+        obj["audioHint"] = audioHint;
+        obj["difficulty"] = difficultyToString(difficulty);
+        obj["points"] = points;
+        return obj;
+    }
+
+    static SpellingWord fromJson(const QJsonObject& json) {
+        SpellingWord w;
+        w.word = json["word"].toString();
+        w.definition = json["definition"].toString();
+        w.audioHint = json["audioHint"].toString();
+        w.difficulty = difficultyFromString(json["difficulty"].toString());
+        w.points = json["points"].toInt(pointsForDifficulty(w.difficulty));
+        return w;
+    }
 };
 
 struct MovieLineChallenge {
@@ -46,6 +154,30 @@ struct MovieLineChallenge {
     Difficulty difficulty;
     int points;
     int userAnswer = -1;
+
+    bool isValid() const {
+        return !movieLine.isEmpty() && options.size() >= 2 && options.contains(correctMovie);
+    }
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["movieLine"] = movieLine;
+        obj["correctMovie"] = correctMovie;
+        obj["options"] = toJsonArray(options);
+        obj["difficulty"] = difficultyToString(difficulty);
+        obj["points"] = points;
+        return obj;
+    }
+
+    static MovieLineChallenge fromJson(const QJsonObject& json) {
+        MovieLineChallenge c;
+        c.movieLine = json["movieLine"].toString();
+        c.correctMovie = json["correctMovie"].toString();
+        c.options = toStringList(json["options"].toArray());
+        c.difficulty = difficultyFromString(json["difficulty"].toString());
+        c.points = json["points"].toInt(pointsForDifficulty(c.difficulty));
+        return c;
+    }
 };
 
 struct VideoGameChallenge {
@@ -56,6 +188,32 @@ struct VideoGameChallenge {
     Difficulty difficulty;
     int points;
     int userAnswer = -1;
+
+    bool isValid() const {
+        return !clue.isEmpty() && options.size() >= 2 && options.contains(correctGame);
+    }
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["clue"] = clue;
+        obj["correctGame"] = correctGame;
+        obj["franchise"] = franchise;
+        obj["options"] = toJsonArray(options);
+        obj["difficulty"] = difficultyToString(difficulty);
+        obj["points"] = points;
+        return obj;
+    }
+
+    static VideoGameChallenge fromJson(const QJsonObject& json) {
+        VideoGameChallenge c;
+        c.clue = json["clue"].toString();
+        c.correctGame = json["correctGame"].toString();
+        c.franchise = json["franchise"].toString();
+        c.options = toStringList(json["options"].toArray());
+        c.difficulty = difficultyFromString(json["difficulty"].toString());
+        c.points = json["points"].toInt(pointsForDifficulty(c.difficulty));
+        return c;
+    }
 };
 
 struct GameSession {
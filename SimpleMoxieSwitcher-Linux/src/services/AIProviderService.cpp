@@ -1,28 +1,227 @@
 #include "AIProviderService.h"
+#include "StorageService.h"
+#include "../utils/DIContainer.h"
+#include "../utils/TokenEstimator.h"
 #include <QNetworkRequest>
 #include <QJsonDocument>
-#include <QJsonArray>
+#include <QMetaEnum>
+#include <QDateTime>
 #include <QDebug>
-#include <QUrlQuery>
+#include <QTimer>
+#if QT_CONFIG(ssl)
+#include <QSslConfiguration>
+#endif
 
 AIProviderService::AIProviderService(QObject *parent)
     : QObject(parent)
-    , m_networkManager(new QNetworkAccessManager(this)) {
+    , m_networkManager(new QNetworkAccessManager(this))
+    , m_storage(DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this))
+    , m_responseCache(m_storage->dataPath() + "/cache/responses", m_storage, this)
+    , m_keepAliveTimer(new QTimer(this)) {
 
     connect(m_networkManager, &QNetworkAccessManager::finished,
             this, &AIProviderService::handleNetworkReply);
 
     // Default to Ollama (free, no API key required)
     m_currentProvider = "Ollama";
+
+    const QMetaEnum providers = QMetaEnum::fromType<AIProvider>();
+    for (int i = 0; i < providers.keyCount(); ++i) {
+        m_adapters[providers.value(i)] = ProviderAdapter::create(QString::fromLatin1(providers.key(i)));
+    }
+    syncOllamaKeepAlive();
+
+    // Local inference serializes on the GPU and Gemini's free tier is rate limited
+    m_concurrencyLimits = {
+        {"Ollama", 2},
+        {"Gemini", 2},
+        {"GroqCloud", 4},
+        {"DeepSeek", 4},
+        {"OpenAI", 4},
+        {"Anthropic", 4}
+    };
+
+    // Qt drops idle pooled connections after two minutes, so probe inside that
+    m_keepAliveTimer->setInterval(60 * 1000);
+    connect(m_keepAliveTimer, &QTimer::timeout, this, &AIProviderService::warmUp);
+    m_keepAliveTimer->start();
+
+    // Warm the default provider once the event loop is running
+    QMetaObject::invokeMethod(this, [this]() {
+        warmUp();
+        preloadModel();
+    }, Qt::QueuedConnection);
 }
 
 void AIProviderService::setCurrentProvider(const QString &provider) {
     if (m_currentProvider != provider) {
         m_currentProvider = provider;
         emit currentProviderChanged();
+        warmUp();
+        preloadModel();
+    }
+}
+
+ProviderAdapter *AIProviderService::adapterFor(const QString &provider) const {
+    bool ok = false;
+    int value = QMetaEnum::fromType<AIProvider>().keyToValue(provider.toLatin1().constData(), &ok);
+    return ok ? m_adapters[value].get() : nullptr;
+}
+
+void AIProviderService::warmUp() {
+    // Nothing useful can be sent without a key, so don't hold a socket open for it
+    ProviderAdapter *adapter = adapterFor(m_currentProvider);
+    if (!adapter || (adapter->requiresApiKey() && adapter->apiKey().isEmpty())) {
+        return;
+    }
+
+    QUrl origin = adapter->origin();
+
+    // Reuses the pooled connection when one is already open, so this doubles
+    // as the idle probe that keeps it from expiring
+    if (origin.scheme() == "https") {
+#if QT_CONFIG(ssl)
+        QSslConfiguration ssl = QSslConfiguration::defaultConfiguration();
+        ssl.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2,
+                                     QSslConfiguration::NextProtocolHttp1_1});
+        m_networkManager->connectToHostEncrypted(origin.host(), 443, ssl);
+#endif
+    } else {
+        m_networkManager->connectToHost(origin.host(), origin.port(80));
+    }
+}
+
+QJsonValue AIProviderService::ollamaKeepAliveValue() const {
+    return m_sleepMode ? QJsonValue(0) : QJsonValue(m_ollamaKeepAlive);
+}
+
+void AIProviderService::setOllamaKeepAlive(const QString &duration) {
+    m_ollamaKeepAlive = duration;
+    syncOllamaKeepAlive();
+}
+
+void AIProviderService::syncOllamaKeepAlive() {
+    if (auto *ollama = static_cast<OllamaAdapter *>(m_adapters[Ollama].get())) {
+        ollama->setKeepAlive(ollamaKeepAliveValue());
     }
 }
 
+void AIProviderService::postOllamaLoad(const QString &model, const QJsonValue &keepAlive) {
+    // A generate call with no prompt only loads or unloads the model
+    QUrl url = m_adapters[Ollama]->origin();
+    url.setPath("/api/generate");
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    QJsonObject json;
+    json["model"] = model;
+    json["keep_alive"] = keepAlive;
+
+    // Untracked reply: handleNetworkReply releases it without reporting
+    m_networkManager->post(request, QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+void AIProviderService::preloadModel(const QString &model) {
+    if (m_currentProvider != "Ollama") {
+        return;
+    }
+    if (!model.isEmpty()) {
+        m_ollamaModel = model;
+    }
+    if (m_sleepMode) {
+        return;
+    }
+
+    QString actualModel = m_ollamaModel.isEmpty() ? getDefaultModel() : m_ollamaModel;
+    if (actualModel == m_loadedOllamaModel) {
+        return;
+    }
+
+    // Free the previous model rather than letting both sit in memory
+    if (!m_loadedOllamaModel.isEmpty()) {
+        postOllamaLoad(m_loadedOllamaModel, QJsonValue(0));
+    }
+    m_loadedOllamaModel = actualModel;
+    postOllamaLoad(actualModel, ollamaKeepAliveValue());
+}
+
+void AIProviderService::unloadModel() {
+    if (m_loadedOllamaModel.isEmpty()) {
+        return;
+    }
+    postOllamaLoad(m_loadedOllamaModel, QJsonValue(0));
+    m_loadedOllamaModel.clear();
+}
+
+void AIProviderService::setSleepMode(bool sleeping) {
+    if (m_sleepMode == sleeping) {
+        return;
+    }
+    m_sleepMode = sleeping;
+    syncOllamaKeepAlive();
+
+    if (sleeping) {
+        unloadModel();
+        m_keepAliveTimer->stop();
+    } else {
+        m_keepAliveTimer->start();
+        warmUp();
+        preloadModel();
+    }
+}
+
+int AIProviderService::keepAliveIntervalMs() const {
+    return m_keepAliveTimer->isActive() ? m_keepAliveTimer->interval() : 0;
+}
+
+void AIProviderService::setKeepAliveIntervalMs(int ms) {
+    // 0 stops the probes; the next provider change still warms once
+    if (ms <= 0) {
+        m_keepAliveTimer->stop();
+        return;
+    }
+    m_keepAliveTimer->start(ms);
+}
+
+void AIProviderService::setStreamingEnabled(bool enabled) {
+    if (m_streamingEnabled != enabled) {
+        m_streamingEnabled = enabled;
+        emit streamingEnabledChanged();
+    }
+}
+
+void AIProviderService::setFailoverEnabled(bool enabled) {
+    if (m_failoverEnabled != enabled) {
+        m_failoverEnabled = enabled;
+        emit routingChanged();
+    }
+}
+
+void AIProviderService::setFallbackChain(const QStringList &chain) {
+    if (m_router.fallbackChain() != chain) {
+        m_router.setFallbackChain(chain);
+        emit routingChanged();
+    }
+}
+
+void AIProviderService::setHedgeDelayMs(int ms) {
+    ms = qMax(0, ms);
+    if (m_hedgeDelayMs != ms) {
+        m_hedgeDelayMs = ms;
+        emit routingChanged();
+    }
+}
+
+QVariantMap AIProviderService::providerHealth(const QString &provider) const {
+    ProviderRouter::Health health = m_router.health(provider);
+    QVariantMap map;
+    map["latencyMs"] = health.latencyMs;
+    map["errorRate"] = health.errorRate;
+    map["available"] = m_router.isAvailable(provider);
+    map["cooldownUntil"] = health.openUntil;
+    return map;
+}
+
 QStringList AIProviderService::availableProviders() const {
     return {
         "Ollama",      // Free - local
@@ -35,455 +234,622 @@ QStringList AIProviderService::availableProviders() const {
 }
 
 bool AIProviderService::providerRequiresApiKey(const QString &provider) const {
-    return provider != "Ollama";  // Only Ollama doesn't need an API key
+    ProviderAdapter *adapter = adapterFor(provider);
+    return adapter ? adapter->requiresApiKey() : true;
 }
 
 QString AIProviderService::getProviderInfo(const QString &provider) const {
-    if (provider == "Ollama") {
-        return "100% FREE - Runs locally on your computer. Install from https://ollama.ai";
-    } else if (provider == "GroqCloud") {
-        return "FREE tier: 14,400 requests/day. Ultra-fast inference. Get key at https://console.groq.com";
-    } else if (provider == "Gemini") {
-        return "FREE tier: 15 requests/minute. Get key at https://aistudio.google.com/apikey";
-    } else if (provider == "DeepSeek") {
-        return "Very affordable pricing. Get key at https://platform.deepseek.com";
-    } else if (provider == "OpenAI") {
-        return "Industry standard. Pay-as-you-go. Get key at https://platform.openai.com/api-keys";
-    } else if (provider == "Anthropic") {
-        return "Claude models. Pay-as-you-go. Get key at https://console.anthropic.com";
-    }
-    return "";
+    ProviderAdapter *adapter = adapterFor(provider);
+    return adapter ? adapter->info() : QString();
 }
 
 QString AIProviderService::getDefaultModel() const {
-    if (m_currentProvider == "Ollama") {
-        return "llama3.2";
-    } else if (m_currentProvider == "GroqCloud") {
-        return "llama-3.3-70b-versatile";
-    } else if (m_currentProvider == "Gemini") {
-        return "gemini-1.5-flash";
-    } else if (m_currentProvider == "DeepSeek") {
-        return "deepseek-chat";
-    } else if (m_currentProvider == "OpenAI") {
-        return "gpt-4o";
-    } else if (m_currentProvider == "Anthropic") {
-        return "claude-3-5-sonnet-20241022";
-    }
-    return "llama3.2";
-}
-
-void AIProviderService::sendRequest(const QString &prompt, const QString &model, double temperature) {
-    if (m_isProcessing) {
-        emit errorOccurred("Already processing a request");
-        return;
-    }
+    ProviderAdapter *adapter = adapterFor(m_currentProvider);
+    return adapter ? adapter->defaultModel() : QStringLiteral("llama3.2");
+}
 
-    // Check if API key is required
-    if (providerRequiresApiKey(m_currentProvider) && m_apiKey.isEmpty()) {
-        emit errorOccurred("API key not configured for " + m_currentProvider);
-        return;
-    }
+int AIProviderService::sendRequest(const QString &prompt, const QString &model, double temperature,
+                                   RequestPriority priority) {
+    return sendRequest(prompt, model, temperature, priority, nullptr);
+}
 
-    m_isProcessing = true;
-    emit isProcessingChanged();
+int AIProviderService::sendRequest(const QString &prompt, const QString &model, double temperature,
+                                   RequestPriority priority, ResponseCallback callback) {
+    PendingRequest pending;
+    pending.priority = priority;
+    pending.callback = std::move(callback);
+    pending.messages = {QJsonObject{{"role", "user"}, {"content", prompt}}};
+    pending.requestedModel = model;
+    pending.temperature = temperature;
+    return dispatchNew(std::move(pending));
+}
 
-    QString actualModel = model.isEmpty() ? getDefaultModel() : model;
-    QNetworkRequest request;
-    QJsonObject json;
+int AIProviderService::sendChatRequest(const QList<QJsonObject> &messages, const QString &model,
+                                       double temperature, RequestPriority priority) {
+    return sendChatRequest(messages, model, temperature, priority, nullptr);
+}
 
-    if (m_currentProvider == "OpenAI") {
-        request.setUrl(QUrl("https://api.openai.com/v1/chat/completions"));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        request.setRawHeader("Authorization", QString("Bearer %1").arg(m_apiKey).toUtf8());
-        json = createOpenAIRequest(prompt, actualModel, temperature);
-    } else if (m_currentProvider == "Anthropic") {
-        request.setUrl(QUrl("https://api.anthropic.com/v1/messages"));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        request.setRawHeader("x-api-key", m_apiKey.toUtf8());
-        request.setRawHeader("anthropic-version", "2023-06-01");
-        json = createAnthropicRequest(prompt, actualModel, temperature);
-    } else if (m_currentProvider == "Gemini") {
-        QString url = QString("https://generativelanguage.googleapis.com/v1beta/models/%1:generateContent?key=%2")
-            .arg(actualModel).arg(m_apiKey);
-        request.setUrl(QUrl(url));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        json = createGeminiRequest(prompt, actualModel, temperature);
-    } else if (m_currentProvider == "DeepSeek" || m_currentProvider == "GroqCloud") {
-        QString endpoint = (m_currentProvider == "DeepSeek")
-            ? "https://api.deepseek.com/v1/chat/completions"
-            : "https://api.groq.com/openai/v1/chat/completions";
-        request.setUrl(QUrl(endpoint));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        request.setRawHeader("Authorization", QString("Bearer %1").arg(m_apiKey).toUtf8());
-        json = createOpenAIRequest(prompt, actualModel, temperature);  // OpenAI-compatible
-    } else if (m_currentProvider == "Ollama") {
-        request.setUrl(QUrl("http://localhost:11434/api/chat"));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        json = createOllamaRequest(prompt, actualModel, temperature);
-    } else {
-        m_isProcessing = false;
-        emit isProcessingChanged();
-        emit errorOccurred("Unsupported provider: " + m_currentProvider);
-        return;
+int AIProviderService::sendChatRequest(const QList<QJsonObject> &messages, const QString &model,
+                                       double temperature, RequestPriority priority, ResponseCallback callback) {
+    PendingRequest pending;
+    pending.priority = priority;
+    pending.callback = std::move(callback);
+    pending.messages = messages;
+    pending.requestedModel = model;
+    pending.temperature = temperature;
+    return dispatchNew(std::move(pending));
+}
+
+int AIProviderService::dispatchNew(PendingRequest pending) {
+    pending.preferredProvider = m_currentProvider;
+    pending.streaming = m_streamingEnabled;
+
+    QStringList route = routeFor(m_currentProvider, QStringList());
+    if (route.isEmpty()) {
+        pending.provider = m_currentProvider;
+        QString error = adapterFor(m_currentProvider)
+            ? "API key not configured for " + m_currentProvider
+            : "Unsupported provider: " + m_currentProvider;
+        return enqueueRequest(std::move(pending), error);
     }
 
-    QJsonDocument doc(json);
-    m_currentReply = m_networkManager->post(request, doc.toJson());
+    QString error = buildRequest(pending, route.first());
+    return enqueueRequest(std::move(pending), error);
 }
 
-void AIProviderService::sendChatRequest(const QList<QJsonObject> &messages, const QString &model) {
-    if (m_isProcessing) {
-        emit errorOccurred("Already processing a request");
-        return;
+QStringList AIProviderService::routeFor(const QString &preferred, const QStringList &exclude) const {
+    QStringList route = m_failoverEnabled
+        ? m_router.route(preferred, exclude)
+        : (exclude.contains(preferred) ? QStringList() : QStringList{preferred});
+
+    // A provider without credentials cannot serve anything, skip it
+    QStringList usable;
+    for (const auto &provider : route) {
+        ProviderAdapter *adapter = adapterFor(provider);
+        if (adapter && (!adapter->requiresApiKey() || !adapter->apiKey().isEmpty())) {
+            usable.append(provider);
+        }
     }
+    return usable;
+}
 
-    if (providerRequiresApiKey(m_currentProvider) && m_apiKey.isEmpty()) {
-        emit errorOccurred("API key not configured for " + m_currentProvider);
+void AIProviderService::cancelRequest(int requestId) {
+    // The handle may be carried by a hedge after the original lost or failed
+    QList<int> ids;
+    if (m_requests.contains(requestId)) {
+        ids.append(requestId);
+    }
+    for (auto it = m_requests.cbegin(); it != m_requests.cend(); ++it) {
+        if (it->hedgeOf == requestId) {
+            ids.append(it->id);
+        }
+    }
+    if (ids.isEmpty()) {
         return;
     }
+    for (int id : ids) {
+        discardRequest(id);
+    }
 
-    m_isProcessing = true;
-    emit isProcessingChanged();
-
-    QString actualModel = model.isEmpty() ? getDefaultModel() : model;
-    QNetworkRequest request;
+    updateProcessingState();
+    startQueuedRequests();
+}
 
-    // Build messages array
-    QJsonArray messagesArray;
-    for (const auto &msg : messages) {
-        messagesArray.append(msg);
+void AIProviderService::discardRequest(int requestId) {
+    auto it = m_requests.find(requestId);
+    if (it == m_requests.end()) {
+        return;
     }
 
-    QJsonObject json;
+    QNetworkReply *reply = it->reply;
+    QString provider = it->provider;
+    m_requests.erase(it);
+    m_queue.removeAll(requestId);
+
+    if (reply) {
+        // Forget the reply first so the aborted finished() signal is ignored
+        m_replyIds.remove(reply);
+        m_activeCount[provider]--;
+        m_router.recordCancelled(provider);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
 
-    if (m_currentProvider == "Ollama") {
-        request.setUrl(QUrl("http://localhost:11434/api/chat"));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        json["model"] = actualModel;
-        json["messages"] = messagesArray;
-        json["stream"] = false;
-    } else if (m_currentProvider == "OpenAI" || m_currentProvider == "DeepSeek" || m_currentProvider == "GroqCloud") {
-        QString endpoint;
-        if (m_currentProvider == "OpenAI") {
-            endpoint = "https://api.openai.com/v1/chat/completions";
-        } else if (m_currentProvider == "DeepSeek") {
-            endpoint = "https://api.deepseek.com/v1/chat/completions";
-        } else {
-            endpoint = "https://api.groq.com/openai/v1/chat/completions";
-        }
-        request.setUrl(QUrl(endpoint));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        request.setRawHeader("Authorization", QString("Bearer %1").arg(m_apiKey).toUtf8());
-        json["model"] = actualModel;
-        json["messages"] = messagesArray;
-        json["temperature"] = 0.7;
-    } else if (m_currentProvider == "Anthropic") {
-        request.setUrl(QUrl("https://api.anthropic.com/v1/messages"));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-        request.setRawHeader("x-api-key", m_apiKey.toUtf8());
-        request.setRawHeader("anthropic-version", "2023-06-01");
-        json["model"] = actualModel;
-        json["messages"] = messagesArray;
-        json["max_tokens"] = 4096;
-    } else if (m_currentProvider == "Gemini") {
-        QString url = QString("https://generativelanguage.googleapis.com/v1beta/models/%1:generateContent?key=%2")
-            .arg(actualModel).arg(m_apiKey);
-        request.setUrl(QUrl(url));
-        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-
-        // Convert to Gemini format
-        QJsonArray contents;
-        for (const auto &msg : messages) {
-            QJsonObject content;
-            QString role = msg["role"].toString();
-            content["role"] = (role == "assistant") ? "model" : "user";
-            QJsonArray parts;
-            QJsonObject textPart;
-            textPart["text"] = msg["content"].toString();
-            parts.append(textPart);
-            content["parts"] = parts;
-            contents.append(content);
+int AIProviderService::partnerOf(const PendingRequest &pending) const {
+    if (pending.hedgeOf) {
+        return m_requests.contains(pending.hedgeOf) ? pending.hedgeOf : 0;
+    }
+    for (auto it = m_requests.cbegin(); it != m_requests.cend(); ++it) {
+        if (it->hedgeOf == pending.id) {
+            return it->id;
         }
-        json["contents"] = contents;
     }
-
-    QJsonDocument doc(json);
-    m_currentReply = m_networkManager->post(request, doc.toJson());
+    return 0;
 }
 
-QString AIProviderService::getApiKey() const {
-    return m_apiKey;
+void AIProviderService::markFirstOutput(PendingRequest &pending) {
+    if (pending.firstOutputMs < 0) {
+        pending.firstOutputMs = QDateTime::currentMSecsSinceEpoch() - pending.dispatchedAt;
+    }
 }
 
-void AIProviderService::setApiKey(const QString &key) {
-    m_apiKey = key;
+void AIProviderService::resolveHedge(int winnerId) {
+    auto it = m_requests.find(winnerId);
+    if (it == m_requests.end()) {
+        return;
+    }
+    // The first racer to produce output keeps the handle, the other is dropped
+    if (int loser = partnerOf(*it)) {
+        discardRequest(loser);
+        updateProcessingState();
+    }
 }
 
-QStringList AIProviderService::availableModels() const {
-    if (m_currentProvider == "OpenAI") {
-        return {"gpt-4o", "gpt-4-turbo", "gpt-4", "gpt-3.5-turbo"};
-    } else if (m_currentProvider == "Anthropic") {
-        return {"claude-3-5-sonnet-20241022", "claude-3-opus-20240229", "claude-3-sonnet-20240229", "claude-3-haiku-20240307"};
-    } else if (m_currentProvider == "Gemini") {
-        return {"gemini-2.0-flash-exp", "gemini-1.5-pro", "gemini-1.5-flash"};
-    } else if (m_currentProvider == "DeepSeek") {
-        return {"deepseek-chat", "deepseek-coder", "deepseek-reasoner"};
-    } else if (m_currentProvider == "Ollama") {
-        return {"llama3.2", "llama3.1", "mistral", "phi3", "gemma2", "qwen2.5"};
-    } else if (m_currentProvider == "GroqCloud") {
-        return {"llama-3.3-70b-versatile", "llama-3.1-8b-instant", "mixtral-8x7b-32768", "gemma2-9b-it"};
-    }
-    return {};
+void AIProviderService::launchHedge(int requestId) {
+    auto it = m_requests.find(requestId);
+    if (it == m_requests.end() || !it->reply || it->firstOutputMs >= 0 || partnerOf(*it)) {
+        return;
+    }
+
+    QStringList route = routeFor(it->preferredProvider, it->attempted);
+    if (route.isEmpty()) {
+        return;
+    }
+
+    PendingRequest hedge;
+    hedge.hedgeOf = requestId;
+    hedge.priority = it->priority;
+    hedge.callback = it->callback;
+    hedge.messages = it->messages;
+    hedge.requestedModel = it->requestedModel;
+    hedge.temperature = it->temperature;
+    hedge.preferredProvider = it->preferredProvider;
+    hedge.streaming = it->streaming;
+    hedge.attempted = it->attempted;
+    hedge.announced = true;
+    hedge.hedgeArmed = true;
+    if (!buildRequest(hedge, route.first()).isEmpty()) {
+        return;
+    }
+    it->attempted.append(hedge.provider);
+
+    hedge.id = m_nextRequestId++;
+    int hedgeId = hedge.id;
+    m_requests.insert(hedgeId, std::move(hedge));
+    m_queue.prepend(hedgeId);
+    updateProcessingState();
+    startQueuedRequests();
 }
 
-double AIProviderService::estimateCost(int tokens, const QString &model) const {
-    // Rough estimates per 1K tokens
-    if (model.contains("gpt-4")) {
-        return (tokens / 1000.0) * 0.03;
-    } else if (model.contains("gpt-3.5")) {
-        return (tokens / 1000.0) * 0.002;
-    } else if (model.contains("claude-3-opus")) {
-        return (tokens / 1000.0) * 0.015;
-    } else if (model.contains("claude-3-sonnet") || model.contains("claude-3-5")) {
-        return (tokens / 1000.0) * 0.003;
-    } else if (model.contains("deepseek")) {
-        return (tokens / 1000.0) * 0.0002;  // Very cheap
-    } else if (model.contains("llama") || model.contains("ollama") || model.contains("groq")) {
-        return 0.0;  // Free
-    } else if (model.contains("gemini")) {
-        return 0.0;  // Free tier
+bool AIProviderService::failOver(PendingRequest &pending) {
+    QStringList route = routeFor(pending.preferredProvider, pending.attempted);
+    if (route.isEmpty()) {
+        return false;
     }
-    return 0.0;
+
+    QString previous = pending.provider;
+    if (!buildRequest(pending, route.first()).isEmpty()) {
+        return false;
+    }
+
+    pending.reply = nullptr;
+    pending.streamBuffer.clear();
+    pending.result.text.clear();
+    pending.result.error.clear();
+    pending.result.inputTokens = 0;
+    pending.result.outputTokens = 0;
+    pending.firstOutputMs = -1;
+
+    // It already waited its turn once, so it goes to the front
+    int requestId = pending.id;
+    int handle = publicId(pending);
+    QString next = pending.provider;
+    m_requests.insert(requestId, std::move(pending));
+    m_queue.prepend(requestId);
+    emit requestFailedOver(handle, previous, next);
+    return true;
 }
 
-void AIProviderService::handleNetworkReply(QNetworkReply *reply) {
-    reply->deleteLater();
+void AIProviderService::clearResponseCache() {
+    m_responseCache.clear();
+    m_cacheHits = 0;
+    m_cacheMisses = 0;
+    emit cacheStatsChanged();
+}
 
-    if (reply != m_currentReply) {
+void AIProviderService::assignCacheKey(PendingRequest &pending, const QJsonObject &json, double temperature) {
+    if (temperature > 0.0) {
         return;
     }
+    pending.cacheKey = ResponseCache::makeKey(pending.provider, pending.model, temperature, json);
+}
 
-    m_isProcessing = false;
-    emit isProcessingChanged();
+bool AIProviderService::serveFromCache(int requestId) {
+    PendingRequest &pending = m_requests[requestId];
+    ResponseCache::Entry entry;
+    if (m_responseCache.lookup(pending.cacheKey, &entry)) {
+        deliverCached(requestId, entry);
+        return true;
+    }
+    if (!m_responseCache.mayBeOnDisk(pending.cacheKey)) {
+        m_cacheMisses++;
+        emit cacheStatsChanged();
+        return false;
+    }
 
-    if (reply->error() != QNetworkReply::NoError) {
-        QString errorMsg = reply->errorString();
-        if (m_currentProvider == "Ollama" && reply->error() == QNetworkReply::ConnectionRefusedError) {
-            errorMsg = "Cannot connect to Ollama. Please ensure Ollama is installed and running (https://ollama.ai)";
+    // Held out of the queue while the disk tier is read on the I/O thread
+    m_responseCache.load(pending.cacheKey).then(this, [this, requestId](const ResponseCache::Entry &loaded) {
+        if (!m_requests.contains(requestId)) {
+            return;     // cancelled meanwhile
         }
-        emit errorOccurred("Network error: " + errorMsg);
-        return;
-    }
+        if (!loaded.response.isEmpty()) {
+            deliverCached(requestId, loaded);
+            return;
+        }
+        m_cacheMisses++;
+        emit cacheStatsChanged();
+        queueRequest(requestId);
+        startQueuedRequests();
+    });
+    return true;
+}
 
-    QByteArray data = reply->readAll();
+void AIProviderService::deliverCached(int requestId, const ResponseCache::Entry &entry) {
+    PendingRequest &pending = m_requests[requestId];
+    m_cacheHits++;
+    emit cacheStatsChanged();
 
-    if (m_currentProvider == "OpenAI" || m_currentProvider == "DeepSeek" || m_currentProvider == "GroqCloud") {
-        parseOpenAIResponse(data);
-    } else if (m_currentProvider == "Anthropic") {
-        parseAnthropicResponse(data);
-    } else if (m_currentProvider == "Gemini") {
-        parseGeminiResponse(data);
-    } else if (m_currentProvider == "Ollama") {
-        parseOllamaResponse(data);
-    }
+    // Cached replies consume no quota, so no token usage is reported
+    pending.result.text = entry.response;
+    pending.fromCache = true;
+
+    QMetaObject::invokeMethod(this, [this, requestId]() {
+        auto it = m_requests.find(requestId);
+        if (it == m_requests.end()) {
+            return;
+        }
+        PendingRequest cached = std::move(*it);
+        m_requests.erase(it);
+        updateProcessingState();
+        // Same signal order as a reply from the network
+        emit requestStarted(cached.id);
+        if (cached.streaming) {
+            emit requestStreamingData(cached.id, cached.result.text);
+            emit streamingData(cached.result.text);
+        }
+        finishRequest(cached);
+    }, Qt::QueuedConnection);
 }
 
-void AIProviderService::handleStreamingReply() {
-    // TODO: Implement streaming support
+int AIProviderService::concurrencyLimit(const QString &provider) const {
+    return m_concurrencyLimits.value(provider, 4);
 }
 
-QJsonObject AIProviderService::createOpenAIRequest(const QString &prompt, const QString &model, double temperature) {
-    QJsonObject json;
-    json["model"] = model;
+void AIProviderService::setConcurrencyLimit(const QString &provider, int limit) {
+    m_concurrencyLimits[provider] = qMax(1, limit);
+    startQueuedRequests();
+}
 
-    QJsonArray messages;
-    QJsonObject userMessage;
-    userMessage["role"] = "user";
-    userMessage["content"] = prompt;
-    messages.append(userMessage);
+int AIProviderService::enqueueRequest(PendingRequest pending, const QString &buildError) {
+    pending.id = m_nextRequestId++;
+    int requestId = pending.id;
+
+    if (!buildError.isEmpty()) {
+        // Deliver asynchronously so callers always see the handle before any result
+        pending.result.error = buildError;
+        m_requests.insert(requestId, std::move(pending));
+        updateProcessingState();
+        QMetaObject::invokeMethod(this, [this, requestId]() {
+            auto it = m_requests.find(requestId);
+            if (it == m_requests.end()) {
+                return;
+            }
+            PendingRequest failed = std::move(*it);
+            m_requests.erase(it);
+            updateProcessingState();
+            finishRequest(failed);
+        }, Qt::QueuedConnection);
+        return requestId;
+    }
 
-    json["messages"] = messages;
-    json["temperature"] = temperature;
-    json["stream"] = false;
+    bool cacheable = !pending.cacheKey.isEmpty();
+    m_requests.insert(requestId, std::move(pending));
+    if (cacheable && serveFromCache(requestId)) {
+        updateProcessingState();
+        return requestId;
+    }
 
-    return json;
+    queueRequest(requestId);
+    updateProcessingState();
+    startQueuedRequests();
+    return requestId;
 }
 
-QJsonObject AIProviderService::createAnthropicRequest(const QString &prompt, const QString &model, double temperature) {
-    QJsonObject json;
-    json["model"] = model;
+void AIProviderService::queueRequest(int requestId) {
+    // Interactive work jumps ahead of queued background requests
+    int position = m_queue.size();
+    if (m_requests[requestId].priority == Interactive) {
+        for (int i = 0; i < m_queue.size(); ++i) {
+            if (m_requests[m_queue[i]].priority == Background) {
+                position = i;
+                break;
+            }
+        }
+    }
+    m_queue.insert(position, requestId);
+}
 
-    QJsonArray messages;
-    QJsonObject userMessage;
-    userMessage["role"] = "user";
-    userMessage["content"] = prompt;
-    messages.append(userMessage);
+void AIProviderService::startQueuedRequests() {
+    for (int i = 0; i < m_queue.size();) {
+        PendingRequest &pending = m_requests[m_queue[i]];
+        if (m_activeCount.value(pending.provider) >= concurrencyLimit(pending.provider)) {
+            ++i;
+            continue;
+        }
+
+        m_queue.removeAt(i);
+        m_activeCount[pending.provider]++;
+        m_router.beginAttempt(pending.provider);
 
-    json["messages"] = messages;
-    json["max_tokens"] = 4096;
-    json["temperature"] = temperature;
+        pending.dispatchedAt = QDateTime::currentMSecsSinceEpoch();
+        pending.reply = m_networkManager->post(pending.request, pending.body);
+        m_replyIds.insert(pending.reply, pending.id);
+        if (pending.streaming) {
+            connect(pending.reply, &QNetworkReply::readyRead,
+                    this, &AIProviderService::handleStreamingReply);
+        }
 
-    return json;
+        if (m_hedgeDelayMs > 0 && pending.priority == Interactive && !pending.hedgeArmed) {
+            pending.hedgeArmed = true;
+            int requestId = pending.id;
+            QTimer::singleShot(m_hedgeDelayMs, this, [this, requestId]() { launchHedge(requestId); });
+        }
+        if (!pending.announced) {
+            pending.announced = true;
+            emit requestStarted(pending.id);
+        }
+    }
 }
 
-QJsonObject AIProviderService::createGeminiRequest(const QString &prompt, const QString &model, double temperature) {
-    Q_UNUSED(model);
+void AIProviderService::updateProcessingState() {
+    // pendingRequests shares this notifier, so it fires on every change
+    m_isProcessing = !m_requests.isEmpty();
+    emit isProcessingChanged();
+}
 
-    QJsonObject json;
-    QJsonArray contents;
-    QJsonObject content;
-    content["role"] = "user";
+void AIProviderService::finishRequest(PendingRequest &pending) {
+    const int requestId = publicId(pending);
+    if (!pending.result.error.isEmpty()) {
+        emit requestFailed(requestId, pending.result.error);
+        emit errorOccurred(pending.result.error);
+        if (pending.callback) {
+            pending.callback(QString(), pending.result.error);
+        }
+        return;
+    }
 
-    QJsonArray parts;
-    QJsonObject textPart;
-    textPart["text"] = prompt;
-    parts.append(textPart);
-    content["parts"] = parts;
-    contents.append(content);
+    if (pending.fromCache) {
+        emit requestFinished(requestId, pending.result.text);
+        emit responseReceived(pending.result.text);
+        if (pending.callback) {
+            pending.callback(pending.result.text, QString());
+        }
+        return;
+    }
 
-    json["contents"] = contents;
+    if (pending.result.inputTokens == 0 && pending.result.outputTokens == 0) {
+        pending.result.inputTokens = pending.estimatedInputTokens;
+        pending.result.outputTokens = TokenEstimator::countText(pending.result.text, pending.model);
+    }
 
-    QJsonObject generationConfig;
-    generationConfig["temperature"] = temperature;
-    generationConfig["maxOutputTokens"] = 4096;
-    json["generationConfig"] = generationConfig;
+    if (!pending.cacheKey.isEmpty() && !pending.result.text.isEmpty()) {
+        ResponseCache::Entry entry;
+        entry.response = pending.result.text;
+        entry.inputTokens = pending.result.inputTokens;
+        entry.outputTokens = pending.result.outputTokens;
+        entry.createdAt = QDateTime::currentMSecsSinceEpoch();
+        m_responseCache.insert(pending.cacheKey, entry);
+    }
 
-    return json;
+    emit requestFinished(requestId, pending.result.text);
+    emit responseReceived(pending.result.text);
+    if (pending.result.inputTokens > 0 || pending.result.outputTokens > 0) {
+        emit requestTokensUsed(requestId, pending.result.inputTokens, pending.result.outputTokens);
+        emit tokensUsed(pending.result.inputTokens, pending.result.outputTokens);
+    }
+    if (pending.callback) {
+        pending.callback(pending.result.text, QString());
+    }
 }
 
-QJsonObject AIProviderService::createOllamaRequest(const QString &prompt, const QString &model, double temperature) {
-    QJsonObject json;
-    json["model"] = model;
+QString AIProviderService::buildRequest(PendingRequest &pending, const QString &provider) {
+    pending.provider = provider;
+    pending.attempted.append(provider);
+    pending.cacheKey.clear();
+
+    pending.adapter = adapterFor(provider);
+    if (!pending.adapter) {
+        return "Unsupported provider: " + provider;
+    }
+    if (pending.adapter->requiresApiKey() && pending.adapter->apiKey().isEmpty()) {
+        return "API key not configured for " + provider;
+    }
 
-    QJsonArray messages;
-    QJsonObject userMessage;
-    userMessage["role"] = "user";
-    userMessage["content"] = prompt;
-    messages.append(userMessage);
+    // An explicit model only makes sense for the provider it was chosen for
+    pending.model = (provider == pending.preferredProvider && !pending.requestedModel.isEmpty())
+        ? pending.requestedModel
+        : pending.adapter->defaultModel();
+    pending.estimatedInputTokens = TokenEstimator::countMessages(pending.messages, pending.model);
+
+    QJsonObject json = pending.adapter->body(pending.messages, pending.model, pending.temperature, pending.streaming);
+    pending.request = pending.adapter->request(pending.model, pending.streaming);
+    assignCacheKey(pending, json, pending.temperature);
+    pending.body = QJsonDocument(json).toJson(QJsonDocument::Compact);
+    return QString();
+}
 
-    json["messages"] = messages;
-    json["stream"] = false;
+QString AIProviderService::getApiKey() const {
+    return apiKeyForProvider(m_currentProvider);
+}
 
-    QJsonObject options;
-    options["temperature"] = temperature;
-    json["options"] = options;
+void AIProviderService::setApiKey(const QString &key) {
+    setApiKeyForProvider(m_currentProvider, key);
+}
 
-    return json;
+QString AIProviderService::apiKeyForProvider(const QString &provider) const {
+    ProviderAdapter *adapter = adapterFor(provider);
+    return adapter ? adapter->apiKey() : QString();
 }
 
-void AIProviderService::parseOpenAIResponse(const QByteArray &data) {
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if (!doc.isObject()) {
-        emit errorOccurred("Invalid response format");
-        return;
+void AIProviderService::setApiKeyForProvider(const QString &provider, const QString &key) {
+    ProviderAdapter *adapter = adapterFor(provider);
+    if (adapter && adapter->apiKey() != key) {
+        adapter->setApiKey(key);
+        emit apiKeyChanged(provider);
     }
+}
 
-    QJsonObject obj = doc.object();
+QStringList AIProviderService::availableModels() const {
+    ProviderAdapter *adapter = adapterFor(m_currentProvider);
+    return adapter ? adapter->models() : QStringList();
+}
 
-    if (obj.contains("error")) {
-        QJsonObject error = obj["error"].toObject();
-        emit errorOccurred("API Error: " + error["message"].toString());
-        return;
+double AIProviderService::estimateCost(int tokens, const QString &model) const {
+    // Rough estimates per 1K tokens
+    if (model.contains("gpt-4")) {
+        return (tokens / 1000.0) * 0.03;
+    } else if (model.contains("gpt-3.5")) {
+        return (tokens / 1000.0) * 0.002;
+    } else if (model.contains("claude-3-opus")) {
+        return (tokens / 1000.0) * 0.015;
+    } else if (model.contains("claude-3-sonnet") || model.contains("claude-3-5")) {
+        return (tokens / 1000.0) * 0.003;
+    } else if (model.contains("deepseek")) {
+        return (tokens / 1000.0) * 0.0002;  // Very cheap
+    } else if (model.contains("llama") || model.contains("ollama") || model.contains("groq")) {
+        return 0.0;  // Free
+    } else if (model.contains("gemini")) {
+        return 0.0;  // Free tier
     }
+    return 0.0;
+}
 
-    if (obj.contains("choices")) {
-        QJsonArray choices = obj["choices"].toArray();
-        if (!choices.isEmpty()) {
-            QJsonObject choice = choices[0].toObject();
-            QJsonObject message = choice["message"].toObject();
-            QString content = message["content"].toString();
-            emit responseReceived(content);
-
-            // Extract token usage
-            if (obj.contains("usage")) {
-                QJsonObject usage = obj["usage"].toObject();
-                int promptTokens = usage["prompt_tokens"].toInt();
-                int completionTokens = usage["completion_tokens"].toInt();
-                emit tokensUsed(promptTokens, completionTokens);
-            }
-        }
-    }
+int AIProviderService::estimateTokens(const QString &text, const QString &model) const {
+    return TokenEstimator::countText(text, model.isEmpty() ? getDefaultModel() : model);
 }
 
-void AIProviderService::parseAnthropicResponse(const QByteArray &data) {
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if (!doc.isObject()) {
-        emit errorOccurred("Invalid response format");
-        return;
-    }
+double AIProviderService::estimateRequestCost(const QList<QJsonObject> &messages, const QString &model,
+                                              int expectedOutputTokens) const {
+    QString actualModel = model.isEmpty() ? getDefaultModel() : model;
+    int tokens = TokenEstimator::countMessages(messages, actualModel) + expectedOutputTokens;
+    return estimateCost(tokens, actualModel);
+}
 
-    QJsonObject obj = doc.object();
+void AIProviderService::handleNetworkReply(QNetworkReply *reply) {
+    reply->deleteLater();
 
-    if (obj.contains("error")) {
-        QJsonObject error = obj["error"].toObject();
-        emit errorOccurred("API Error: " + error["message"].toString());
-        return;
+    auto idIt = m_replyIds.find(reply);
+    if (idIt == m_replyIds.end()) {
+        return;  // cancelled
     }
+    int requestId = idIt.value();
+    m_replyIds.erase(idIt);
 
-    if (obj.contains("content")) {
-        QJsonArray content = obj["content"].toArray();
-        if (!content.isEmpty()) {
-            QJsonObject contentObj = content[0].toObject();
-            QString text = contentObj["text"].toString();
-            emit responseReceived(text);
+    PendingRequest pending = m_requests.take(requestId);
+    m_activeCount[pending.provider]--;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        QString errorMsg = reply->errorString();
+        if (pending.provider == "Ollama" && reply->error() == QNetworkReply::ConnectionRefusedError) {
+            errorMsg = "Cannot connect to Ollama. Please ensure Ollama is installed and running (https://ollama.ai)";
         }
+        pending.result.error = "Network error: " + errorMsg;
+    } else if (pending.streaming) {
+        // The final frame may arrive without a trailing newline
+        pending.streamBuffer += reply->readAll();
+        const QList<QByteArray> lines = pending.streamBuffer.split('\n');
+        for (const auto &line : lines) {
+            processStreamLine(line, pending);
+        }
+        pending.streamBuffer.clear();
+    } else {
+        pending.adapter->parseResponse(reply->readAll(), pending.result);
     }
 
-    // Extract token usage
-    if (obj.contains("usage")) {
-        QJsonObject usage = obj["usage"].toObject();
-        int inputTokens = usage["input_tokens"].toInt();
-        int outputTokens = usage["output_tokens"].toInt();
-        emit tokensUsed(inputTokens, outputTokens);
+    if (pending.result.error.isEmpty()) {
+        markFirstOutput(pending);
+        m_router.recordSuccess(pending.provider, pending.firstOutputMs);
+        if (int loser = partnerOf(pending)) {
+            discardRequest(loser);
+        }
+    } else {
+        m_router.recordFailure(pending.provider);
+
+        // A racing hedge still owns the handle; otherwise retry elsewhere as
+        // long as nothing has been shown to the user yet
+        if (partnerOf(pending) || (pending.result.text.isEmpty() && failOver(pending))) {
+            updateProcessingState();
+            startQueuedRequests();
+            return;
+        }
     }
+
+    updateProcessingState();
+    finishRequest(pending);
+    startQueuedRequests();
 }
 
-void AIProviderService::parseGeminiResponse(const QByteArray &data) {
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if (!doc.isObject()) {
-        emit errorOccurred("Invalid response format");
+void AIProviderService::handleStreamingReply() {
+    auto *reply = qobject_cast<QNetworkReply *>(sender());
+    if (!reply || !m_replyIds.contains(reply)) {
         return;
     }
 
-    QJsonObject obj = doc.object();
-
-    if (obj.contains("error")) {
-        QJsonObject error = obj["error"].toObject();
-        emit errorOccurred("API Error: " + error["message"].toString());
+    // Error bodies are plain JSON, leave them for handleNetworkReply
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status >= 400) {
         return;
     }
 
-    if (obj.contains("candidates")) {
-        QJsonArray candidates = obj["candidates"].toArray();
-        if (!candidates.isEmpty()) {
-            QJsonObject candidate = candidates[0].toObject();
-            QJsonObject content = candidate["content"].toObject();
-            QJsonArray parts = content["parts"].toArray();
-            if (!parts.isEmpty()) {
-                QString text = parts[0].toObject()["text"].toString();
-                emit responseReceived(text);
-            }
-        }
+    int requestId = m_replyIds.value(reply);
+    PendingRequest &pending = m_requests[requestId];
+    bool hadOutput = pending.firstOutputMs >= 0;
+    pending.streamBuffer += reply->readAll();
+
+    // SSE frames and Ollama NDJSON are both newline-delimited; keep any partial tail
+    qsizetype start = 0;
+    qsizetype newline;
+    while ((newline = pending.streamBuffer.indexOf('\n', start)) != -1) {
+        processStreamLine(pending.streamBuffer.mid(start, newline - start), pending);
+        start = newline + 1;
+    }
+    pending.streamBuffer.remove(0, start);
+
+    // Resolved after the loop since dropping the loser may move hash entries
+    if (!hadOutput && pending.firstOutputMs >= 0) {
+        resolveHedge(requestId);
     }
 }
 
-void AIProviderService::parseOllamaResponse(const QByteArray &data) {
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if (!doc.isObject()) {
-        emit errorOccurred("Invalid response format from Ollama");
+void AIProviderService::processStreamLine(const QByteArray &rawLine, PendingRequest &pending) {
+    QByteArrayView line = QByteArrayView(rawLine).trimmed();
+    if (line.isEmpty() || line.startsWith(':') || line.startsWith("event:")) {
         return;
     }
 
-    QJsonObject obj = doc.object();
-
-    if (obj.contains("error")) {
-        emit errorOccurred("Ollama Error: " + obj["error"].toString());
-        return;
+    if (line.startsWith("data:")) {
+        line = line.sliced(5).trimmed();
+        if (line == "[DONE]") {
+            return;
+        }
     }
 
-    if (obj.contains("message")) {
-        QJsonObject message = obj["message"].toObject();
-        QString content = message["content"].toString();
-        emit responseReceived(content);
+    QString chunk = pending.adapter->parseStreamFrame(line, pending.result);
+    if (!chunk.isEmpty()) {
+        markFirstOutput(pending);
+        pending.result.text += chunk;
+        emit requestStreamingData(publicId(pending), chunk);
+        emit streamingData(chunk);
     }
 }
@@ -2,12 +2,34 @@
 #include <QObject>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QNetworkRequest>
 #include <QJsonObject>
+#include <QJsonValue>
+#include <QHash>
+#include <QVariantMap>
+#include <QTimer>
+#include <array>
+#include <functional>
+#include <memory>
+#include "ResponseCache.h"
+#include "ProviderRouter.h"
+#include "ProviderAdapter.h"
+
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
 
 class AIProviderService : public QObject {
     Q_OBJECT
     Q_PROPERTY(bool isProcessing READ isProcessing NOTIFY isProcessingChanged)
     Q_PROPERTY(QString currentProvider READ currentProvider WRITE setCurrentProvider NOTIFY currentProviderChanged)
+    Q_PROPERTY(bool streamingEnabled READ streamingEnabled WRITE setStreamingEnabled NOTIFY streamingEnabledChanged)
+    Q_PROPERTY(int pendingRequests READ pendingRequests NOTIFY isProcessingChanged)
+    Q_PROPERTY(int cacheHits READ cacheHits NOTIFY cacheStatsChanged)
+    Q_PROPERTY(int cacheMisses READ cacheMisses NOTIFY cacheStatsChanged)
+    Q_PROPERTY(bool failoverEnabled READ failoverEnabled WRITE setFailoverEnabled NOTIFY routingChanged)
+    Q_PROPERTY(QStringList fallbackChain READ fallbackChain WRITE setFallbackChain NOTIFY routingChanged)
+    Q_PROPERTY(int hedgeDelayMs READ hedgeDelayMs WRITE setHedgeDelayMs NOTIFY routingChanged)
 
 public:
     enum AIProvider {
@@ -20,18 +42,90 @@ public:
     };
     Q_ENUM(AIProvider)
 
+    // Interactive requests are dispatched ahead of any queued background work
+    enum RequestPriority {
+        Interactive,
+        Background
+    };
+    Q_ENUM(RequestPriority)
+
+    // Called once per request with either the full response or an error message
+    using ResponseCallback = std::function<void(const QString &response, const QString &error)>;
+
     explicit AIProviderService(QObject *parent = nullptr);
 
     bool isProcessing() const { return m_isProcessing; }
+    int pendingRequests() const { return m_requests.size(); }
 
     QString currentProvider() const { return m_currentProvider; }
     void setCurrentProvider(const QString &provider);
 
-    Q_INVOKABLE void sendRequest(const QString &prompt, const QString &model = "", double temperature = 0.7);
-    Q_INVOKABLE void sendChatRequest(const QList<QJsonObject> &messages, const QString &model = "");
+    bool streamingEnabled() const { return m_streamingEnabled; }
+    void setStreamingEnabled(bool enabled);
+
+    // Deterministic requests (temperature 0) are served from cache. Chat's
+    // rolling summaries are that traffic: the same turns folded into the same
+    // summary again (a conversation reopened before its summary was saved, or
+    // an interrupted catch-up resuming) hit.
+    // Game batches stay at high temperature so each refill brings new items.
+    int cacheHits() const { return m_cacheHits; }
+    int cacheMisses() const { return m_cacheMisses; }
+    Q_INVOKABLE void clearResponseCache();
+
+    // When the preferred provider fails before producing output the request is
+    // retried on the next healthy provider in the chain that has credentials
+    bool failoverEnabled() const { return m_failoverEnabled; }
+    void setFailoverEnabled(bool enabled);
+    QStringList fallbackChain() const { return m_router.fallbackChain(); }
+    void setFallbackChain(const QStringList &chain);
+
+    // Interactive requests with no output after this long are raced against
+    // the next provider in the chain; 0 disables hedging
+    int hedgeDelayMs() const { return m_hedgeDelayMs; }
+    void setHedgeDelayMs(int ms);
+
+    Q_INVOKABLE QVariantMap providerHealth(const QString &provider) const;
+
+    // False when no provider the current one could be routed to has the
+    // credentials it needs; changes with the provider, routing or API keys
+    bool hasUsableProvider() const { return !routeFor(m_currentProvider, QStringList()).isEmpty(); }
+
+    // Opens (or refreshes) the connection to the current provider so the next
+    // request skips DNS, TCP and TLS setup. Called on provider change and by
+    // the idle keep-alive timer.
+    Q_INVOKABLE void warmUp();
+    int keepAliveIntervalMs() const;
+    void setKeepAliveIntervalMs(int ms);
+
+    // Ollama keeps a model resident for keep_alive after each request. While
+    // awake models are loaded ahead of the first message and held for
+    // ollamaKeepAlive; sleep mode unloads them and sends keep_alive 0.
+    Q_INVOKABLE void preloadModel(const QString &model = "");
+    Q_INVOKABLE void unloadModel();
+    bool sleepMode() const { return m_sleepMode; }
+    Q_INVOKABLE void setSleepMode(bool sleeping);
+    QString ollamaKeepAlive() const { return m_ollamaKeepAlive; }
+    void setOllamaKeepAlive(const QString &duration);
+
+    // Both return a request handle; results are delivered through the request* signals
+    Q_INVOKABLE int sendRequest(const QString &prompt, const QString &model = "", double temperature = 0.7,
+                                RequestPriority priority = Interactive);
+    Q_INVOKABLE int sendChatRequest(const QList<QJsonObject> &messages, const QString &model = "",
+                                    double temperature = 0.7, RequestPriority priority = Interactive);
+    int sendRequest(const QString &prompt, const QString &model, double temperature,
+                    RequestPriority priority, ResponseCallback callback);
+    int sendChatRequest(const QList<QJsonObject> &messages, const QString &model, double temperature,
+                        RequestPriority priority, ResponseCallback callback);
+    Q_INVOKABLE void cancelRequest(int requestId);
+
+    Q_INVOKABLE int concurrencyLimit(const QString &provider) const;
+    Q_INVOKABLE void setConcurrencyLimit(const QString &provider, int limit);
 
+    // Keys are held per provider; the unqualified pair acts on the current one
     Q_INVOKABLE QString getApiKey() const;
     Q_INVOKABLE void setApiKey(const QString &key);
+    Q_INVOKABLE QString apiKeyForProvider(const QString &provider) const;
+    Q_INVOKABLE void setApiKeyForProvider(const QString &provider, const QString &key);
 
     Q_INVOKABLE QStringList availableModels() const;
     Q_INVOKABLE QStringList availableProviders() const;
@@ -39,33 +133,123 @@ public:
     Q_INVOKABLE QString getProviderInfo(const QString &provider) const;
     double estimateCost(int tokens, const QString &model) const;
 
+    // Pre-flight estimates computed locally, no round-trip required
+    Q_INVOKABLE int estimateTokens(const QString &text, const QString &model = "") const;
+    Q_INVOKABLE double estimateRequestCost(const QList<QJsonObject> &messages, const QString &model = "",
+                                           int expectedOutputTokens = 500) const;
+
 signals:
+    // Broadcast for every request, kept for single-consumer callers
     void responseReceived(const QString &response);
     void errorOccurred(const QString &error);
     void isProcessingChanged();
     void currentProviderChanged();
+    void streamingEnabledChanged();
+    void cacheStatsChanged();
+    void routingChanged();
+    void apiKeyChanged(const QString &provider);
     void tokensUsed(int inputTokens, int outputTokens);
     void streamingData(const QString &chunk);
 
+    // Routed per request handle
+    void requestStarted(int requestId);
+    void requestFinished(int requestId, const QString &response);
+    void requestFailed(int requestId, const QString &error);
+    void requestStreamingData(int requestId, const QString &chunk);
+    void requestTokensUsed(int requestId, int inputTokens, int outputTokens);
+    void requestFailedOver(int requestId, const QString &fromProvider, const QString &toProvider);
+
 private slots:
     void handleNetworkReply(QNetworkReply *reply);
     void handleStreamingReply();
 
 private:
+    struct PendingRequest {
+        int id = 0;
+        int hedgeOf = 0;                // set on a hedge: the handle it reports under
+        QString provider;
+        QString model;
+        RequestPriority priority = Interactive;
+        QNetworkRequest request;
+        QByteArray body;
+        bool streaming = false;
+        ProviderAdapter *adapter = nullptr;
+        QNetworkReply *reply = nullptr;
+        ResponseCallback callback;
+
+        // Original input, kept so the request can be rebuilt for another provider
+        QList<QJsonObject> messages;
+        QString requestedModel;
+        double temperature = 0.7;
+        QString preferredProvider;
+        QStringList attempted;
+        bool announced = false;
+        bool hedgeArmed = false;
+        qint64 dispatchedAt = 0;
+        qint64 firstOutputMs = -1;
+
+        // Accumulated result, filled incrementally when streaming
+        QByteArray streamBuffer;
+        ProviderResult result;
+        int estimatedInputTokens = 0;   // used when the provider reports no usage
+        QByteArray cacheKey;            // empty unless the request is deterministic
+        bool fromCache = false;
+    };
+
     QNetworkAccessManager *m_networkManager;
+    SimpleMoxieSwitcher::StorageService *m_storage;
     bool m_isProcessing = false;
     QString m_currentProvider = "Ollama";  // Default to free local option
-    QString m_apiKey;
-    QNetworkReply *m_currentReply = nullptr;
-
-    QJsonObject createOpenAIRequest(const QString &prompt, const QString &model, double temperature);
-    QJsonObject createAnthropicRequest(const QString &prompt, const QString &model, double temperature);
-    QJsonObject createGeminiRequest(const QString &prompt, const QString &model, double temperature);
-    QJsonObject createOllamaRequest(const QString &prompt, const QString &model, double temperature);
-    void parseOpenAIResponse(const QByteArray &data);
-    void parseAnthropicResponse(const QByteArray &data);
-    void parseGeminiResponse(const QByteArray &data);
-    void parseOllamaResponse(const QByteArray &data);
+    bool m_streamingEnabled = true;
+
+    // Indexed by AIProvider; each holds that backend's request template and key
+    std::array<std::unique_ptr<ProviderAdapter>, GroqCloud + 1> m_adapters;
+
+    int m_nextRequestId = 1;
+    QHash<int, PendingRequest> m_requests;      // queued and in-flight requests
+    QHash<QNetworkReply *, int> m_replyIds;
+    QList<int> m_queue;                         // waiting to start, in dispatch order
+    QHash<QString, int> m_activeCount;          // in-flight requests per provider
+    QHash<QString, int> m_concurrencyLimits;
+
+    ResponseCache m_responseCache;
+    int m_cacheHits = 0;
+    int m_cacheMisses = 0;
+
+    QTimer *m_keepAliveTimer;
+    bool m_sleepMode = false;
+    QString m_ollamaKeepAlive = "30m";
+    QString m_ollamaModel;          // last model asked for, reloaded on wake
+    QString m_loadedOllamaModel;
+    ProviderRouter m_router;
+    bool m_failoverEnabled = true;
+    int m_hedgeDelayMs = 0;
+
+    int enqueueRequest(PendingRequest pending, const QString &buildError);
+    void startQueuedRequests();
+    void finishRequest(PendingRequest &pending);
+    void updateProcessingState();
+    void assignCacheKey(PendingRequest &pending, const QJsonObject &json, double temperature);
+    bool serveFromCache(int requestId);
+    void deliverCached(int requestId, const ResponseCache::Entry &entry);
+    void queueRequest(int requestId);
+
+    int publicId(const PendingRequest &pending) const { return pending.hedgeOf ? pending.hedgeOf : pending.id; }
+    int partnerOf(const PendingRequest &pending) const;
+    void discardRequest(int requestId);
+    void markFirstOutput(PendingRequest &pending);
+    void resolveHedge(int winnerId);
+    void launchHedge(int requestId);
+    bool failOver(PendingRequest &pending);
+    QStringList routeFor(const QString &preferred, const QStringList &exclude) const;
+    int dispatchNew(PendingRequest pending);
+
+    ProviderAdapter *adapterFor(const QString &provider) const;
+    QString buildRequest(PendingRequest &pending, const QString &provider);
+    void processStreamLine(const QByteArray &line, PendingRequest &pending);
 
     QString getDefaultModel() const;
-};
\ No newline at end of file
+    QJsonValue ollamaKeepAliveValue() const;
+    void syncOllamaKeepAlive();
+    void postOllamaLoad(const QString &model, const QJsonValue &keepAlive);
+};
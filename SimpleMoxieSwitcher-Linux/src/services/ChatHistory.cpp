@@ -0,0 +1,371 @@
+#include "ChatHistory.h"
+#include "../utils/JsonFieldExtractor.h"
+#include <QCborMap>
+#include <QCborStreamReader>
+#include <QCborValue>
+#include <QJsonDocument>
+#include <QDebug>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr int DefaultCacheRows = 256;
+
+QString readCborString(QCborStreamReader &reader) {
+    if (!reader.isString()) {
+        reader.next();
+        return QString();
+    }
+    QString result;
+    auto chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        result += chunk.data;
+        chunk = reader.readString();
+    }
+    return result;
+}
+
+// Copies everything but the messages, which are indexed separately
+void applyHeader(Conversation *conversation, const Conversation &parsed) {
+    conversation->id = parsed.id.isEmpty() ? conversation->id : parsed.id;
+    conversation->title = parsed.title;
+    conversation->childProfileId = parsed.childProfileId;
+    conversation->personalityId = parsed.personalityId;
+    conversation->createdAt = parsed.createdAt;
+    conversation->updatedAt = parsed.updatedAt;
+    conversation->isArchived = parsed.isArchived;
+    conversation->summary = parsed.summary;
+    conversation->summarizedCount = parsed.summarizedCount;
+}
+
+const JsonFieldExtractor &recordFields() {
+    static const JsonFieldExtractor fields({"seq", "op", "id", "message.timestamp"});
+    return fields;
+}
+
+const JsonFieldExtractor &messageFields() {
+    static const JsonFieldExtractor fields({"message.id", "message.role", "message.content", "message.timestamp"});
+    return fields;
+}
+
+} // namespace
+
+ChatHistory::ChatHistory()
+    : m_cache(DefaultCacheRows) {
+}
+
+ChatHistory::~ChatHistory() = default;
+
+void ChatHistory::clear() {
+    m_cache.clear();
+    m_entries.clear();
+    m_memory.clear();
+    m_freeSlots.clear();
+    m_snapshot = nullptr;
+    m_snapshotSize = 0;
+    m_journal = nullptr;
+    m_journalSize = 0;
+    m_snapshotFile.reset();   // unmaps
+    m_journalFile.reset();
+}
+
+void ChatHistory::swap(ChatHistory &other) {
+    m_cache.clear();
+    other.m_cache.clear();
+    std::swap(m_snapshotFile, other.m_snapshotFile);
+    std::swap(m_journalFile, other.m_journalFile);
+    std::swap(m_snapshot, other.m_snapshot);
+    std::swap(m_snapshotSize, other.m_snapshotSize);
+    std::swap(m_journal, other.m_journal);
+    std::swap(m_journalSize, other.m_journalSize);
+    m_entries.swap(other.m_entries);
+    m_memory.swap(other.m_memory);
+    m_freeSlots.swap(other.m_freeSlots);
+}
+
+bool ChatHistory::open(const QString &snapshotPath, const QString &journalPath,
+                       Conversation *header, ReplayState *state) {
+    clear();
+    *state = ReplayState();
+
+    bool found = snapshotPath.endsWith(".json") ? indexLegacySnapshot(snapshotPath, header, state)
+                                                : indexSnapshot(snapshotPath, header, state);
+    found |= indexJournal(journalPath, header, state);
+
+    header->messages.clear();
+    header->messageCount = m_entries.size();
+    return found;
+}
+
+bool ChatHistory::indexSnapshot(const QString &path, Conversation *header, ReplayState *state) {
+    auto file = std::make_unique<QFile>(path);
+    if (!file->open(QIODevice::ReadOnly) || file->size() == 0) {
+        return false;
+    }
+    const uchar *data = file->map(0, file->size());
+    if (!data) {
+        qWarning() << "Could not map" << path << file->errorString();
+        return false;
+    }
+    m_snapshotFile = std::move(file);
+    m_snapshot = reinterpret_cast<const char *>(data);
+    m_snapshotSize = m_snapshotFile->size();
+
+    // Walk the envelope without decoding message bodies; each element of
+    // conversation.messages is remembered by its byte range
+    QCborStreamReader reader(QByteArray::fromRawData(m_snapshot, m_snapshotSize));
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return true;
+    }
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        const QString key = readCborString(reader);
+        if (key == QLatin1String("lastSeq")) {
+            state->lastSeq = QCborValue::fromCbor(reader).toInteger();
+        } else if (key == QLatin1String("conversation") && reader.isMap()) {
+            QCborMap fields;
+            reader.enterContainer();
+            while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+                const QString field = readCborString(reader);
+                if (field == QLatin1String("messages") && reader.isArray()) {
+                    reader.enterContainer();
+                    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+                        qint64 start = reader.currentOffset();
+                        reader.next();
+                        m_entries.append({start, qint32(reader.currentOffset() - start), Source::Snapshot});
+                    }
+                    reader.leaveContainer();
+                } else {
+                    fields.insert(field, QCborValue::fromCbor(reader));
+                }
+            }
+            reader.leaveContainer();
+            applyHeader(header, Conversation::fromCbor(fields));
+        } else {
+            reader.next();
+        }
+    }
+
+    if (reader.lastError() != QCborError::NoError) {
+        qWarning() << "Conversation snapshot" << path << "is damaged:" << reader.lastError().toString();
+    }
+    return true;
+}
+
+bool ChatHistory::indexLegacySnapshot(const QString &path, Conversation *header, ReplayState *state) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    Conversation conversation = Conversation::fromJson(root["conversation"].toObject());
+    applyHeader(header, conversation);
+    state->lastSeq = root["lastSeq"].toInteger();
+    for (const auto &message : std::as_const(conversation.messages)) {
+        append(message);
+    }
+    return true;
+}
+
+bool ChatHistory::indexJournal(const QString &path, Conversation *header, ReplayState *state) {
+    auto file = std::make_unique<QFile>(path);
+    if (!file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (file->size() == 0) {
+        return true;
+    }
+    const uchar *data = file->map(0, file->size());
+    if (!data) {
+        qWarning() << "Could not map" << path << file->errorString();
+        return false;
+    }
+    m_journalFile = std::move(file);
+    m_journal = reinterpret_cast<const char *>(data);
+    m_journalSize = m_journalFile->size();
+
+    JsonFieldExtractor::Fields fields;
+    QString lastAddedAt;
+    qint64 pos = 0;
+    while (pos < m_journalSize) {
+        const void *newline = memchr(m_journal + pos, '\n', m_journalSize - pos);
+        if (!newline) {
+            break;  // torn write from a crash
+        }
+        qint64 end = static_cast<const char *>(newline) - m_journal;
+        QByteArrayView line(m_journal + pos, end - pos);
+        const qint64 lineStart = pos;
+        pos = end + 1;
+        state->validJournalBytes = pos;
+
+        // A complete line that doesn't parse is skipped, not treated as the
+        // end: only an unterminated tail can be a torn write
+        if (!recordFields().extract(line, &fields)) {
+            qWarning() << "Conversation journal" << path << "has a damaged record at offset"
+                       << lineStart << "- skipping it";
+            continue;
+        }
+        ++state->journalRecords;
+
+        qint64 seq = static_cast<qint64>(fields[0].number);
+        if (seq <= state->lastSeq) {
+            continue;  // already in the snapshot
+        }
+        state->lastSeq = seq;
+
+        const QString &op = fields[1].text;
+        if (op == QLatin1String("add")) {
+            m_entries.append({lineStart, qint32(end - lineStart), Source::Journal});
+            lastAddedAt = fields[3].text;
+        } else if (op == QLatin1String("remove")) {
+            removeById(fields[2].text);
+        } else if (op == QLatin1String("clear")) {
+            m_entries.clear();
+            m_memory.clear();
+            m_freeSlots.clear();
+            m_cache.clear();
+        } else if (op == QLatin1String("header")) {
+            QJsonObject record = QJsonDocument::fromJson(line.toByteArray()).object();
+            applyHeader(header, Conversation::fromJson(record["conversation"].toObject()));
+        }
+    }
+
+    if (!lastAddedAt.isEmpty()) {
+        header->updatedAt = QDateTime::fromString(lastAddedAt, Qt::ISODate);
+    }
+    return true;
+}
+
+void ChatHistory::removeById(const QString &id) {
+    // Removals are regenerated replies, so the match is almost always at the end
+    for (int row = m_entries.size() - 1; row >= 0; --row) {
+        if (idAt(m_entries[row]) == id) {
+            removeAt(row);
+            return;
+        }
+    }
+}
+
+quint64 ChatHistory::cacheKey(const Entry &entry) {
+    return (quint64(entry.source) << 56) | quint64(entry.offset);
+}
+
+QString ChatHistory::idAt(const Entry &entry) const {
+    switch (entry.source) {
+    case Source::Memory:
+        return m_memory[entry.offset].id;
+    case Source::Snapshot: {
+        QCborValue value = QCborValue::fromCbor(QByteArray::fromRawData(m_snapshot + entry.offset, entry.length));
+        return value.toMap().value(QStringLiteral("id")).toString();
+    }
+    case Source::Journal: {
+        static const JsonFieldExtractor idField({"message.id"});
+        JsonFieldExtractor::Fields fields;
+        idField.extract(QByteArrayView(m_journal + entry.offset, entry.length), &fields);
+        return fields[0].text;
+    }
+    }
+    return QString();
+}
+
+ChatMessage ChatHistory::decode(const Entry &entry) const {
+    if (entry.source == Source::Memory) {
+        return m_memory[entry.offset];
+    }
+
+    const quint64 key = cacheKey(entry);
+    if (const ChatMessage *cached = m_cache.object(key)) {
+        return *cached;
+    }
+
+    ChatMessage message;
+    if (entry.source == Source::Snapshot) {
+        QCborValue value = QCborValue::fromCbor(QByteArray::fromRawData(m_snapshot + entry.offset, entry.length));
+        message = ChatMessage::fromCbor(value.toMap());
+    } else {
+        JsonFieldExtractor::Fields fields;
+        messageFields().extract(QByteArrayView(m_journal + entry.offset, entry.length), &fields);
+        message.id = fields[0].text;
+        message.role = fields[1].text;
+        message.content = fields[2].text;
+        message.timestamp = QDateTime::fromString(fields[3].text, Qt::ISODate);
+    }
+
+    m_cache.insert(key, new ChatMessage(message));
+    return message;
+}
+
+ChatMessage ChatHistory::at(int row) const {
+    if (row < 0 || row >= m_entries.size()) {
+        return ChatMessage();
+    }
+    return decode(m_entries[row]);
+}
+
+QList<ChatMessage> ChatHistory::mid(int pos, int length) const {
+    int end = length < 0 ? m_entries.size() : qMin<int>(m_entries.size(), pos + length);
+    QList<ChatMessage> result;
+    result.reserve(qMax(0, end - pos));
+    for (int row = qMax(0, pos); row < end; ++row) {
+        result.append(decode(m_entries[row]));
+    }
+    return result;
+}
+
+qint64 ChatHistory::store(const ChatMessage &message) {
+    if (!m_freeSlots.isEmpty()) {
+        const qint64 slot = m_freeSlots.takeLast();
+        m_memory[slot] = message;
+        return slot;
+    }
+    m_memory.append(message);
+    return m_memory.size() - 1;
+}
+
+void ChatHistory::append(const ChatMessage &message) {
+    m_entries.append({store(message), 0, Source::Memory});
+}
+
+void ChatHistory::removeAt(int row) {
+    if (row < 0 || row >= m_entries.size()) {
+        return;
+    }
+    const Entry entry = m_entries.takeAt(row);
+    if (entry.source == Source::Memory) {
+        // Regenerated replies are removed and re-added, so reuse the slot
+        m_memory[entry.offset] = ChatMessage();
+        m_freeSlots.append(entry.offset);
+    } else {
+        m_cache.remove(cacheKey(entry));
+    }
+}
+
+ChatMessage &ChatHistory::pin(int row) {
+    Entry &entry = m_entries[row];
+    if (entry.source != Source::Memory) {
+        ChatMessage message = decode(entry);
+        m_cache.remove(cacheKey(entry));
+        entry = {store(message), 0, Source::Memory};
+    }
+    return m_memory[entry.offset];
+}
+
+void ChatHistory::replace(int row, const ChatMessage &message) {
+    if (row < 0 || row >= m_entries.size()) {
+        return;
+    }
+    Entry &entry = m_entries[row];
+    if (entry.source != Source::Memory) {
+        m_cache.remove(cacheKey(entry));
+        entry = {store(message), 0, Source::Memory};
+    } else {
+        m_memory[entry.offset] = message;
+    }
+}
+
+void ChatHistory::appendContent(int row, const QString &chunk) {
+    if (row < 0 || row >= m_entries.size()) {
+        return;
+    }
+    pin(row).content += chunk;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <QCache>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <memory>
+#include "../models/Conversation.h"
+
+// Message list for one conversation that decodes rows on demand. open()
+// memory-maps the conversation's snapshot and journal and records only where
+// each message lives; at() decodes a row the first time it is asked for and
+// keeps recently used rows in a small cache. Opening a long conversation
+// therefore costs one scan over the files and a few bytes per message, and
+// memory grows with the rows actually shown, not the conversation length.
+//
+// Rows added or edited after open() are held decoded; slots of removed rows
+// are reused, so regenerating replies doesn't grow memory. The mapped files
+// are never written through this class; ConversationJournal replaces (rather
+// than truncates) files it rewrites, so existing mappings stay valid.
+class ChatHistory {
+public:
+    struct ReplayState {
+        qint64 lastSeq = 0;
+        qint64 validJournalBytes = 0;   // up to the last newline
+        int journalRecords = 0;
+    };
+
+    ChatHistory();
+    ~ChatHistory();
+    ChatHistory(const ChatHistory &) = delete;
+    ChatHistory &operator=(const ChatHistory &) = delete;
+
+    // Indexes snapshot (CBOR, or the older JSON) and journal, applying
+    // journal records in order. False if neither file exists.
+    bool open(const QString &snapshotPath, const QString &journalPath,
+              Conversation *header, ReplayState *state);
+    void clear();
+
+    // Exchanges contents, so a history indexed on another thread can be
+    // handed over in one step. Both row caches start over.
+    void swap(ChatHistory &other);
+
+    int size() const { return m_entries.size(); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+
+    ChatMessage at(int row) const;
+    ChatMessage operator[](int row) const { return at(row); }
+    ChatMessage last() const { return at(size() - 1); }
+    QList<ChatMessage> mid(int pos, int length = -1) const;
+    QList<ChatMessage> toList() const { return mid(0); }
+
+    void append(const ChatMessage &message);
+    void removeAt(int row);
+    void removeLast() { removeAt(size() - 1); }
+
+    // Edits a row in place; a mapped row is decoded and held in memory
+    // from then on. Out of range rows are ignored.
+    void replace(int row, const ChatMessage &message);
+    void appendContent(int row, const QString &chunk);
+
+    void setCacheCapacity(int rows) { m_cache.setMaxCost(rows); }
+
+private:
+    enum class Source : quint8 { Snapshot, Journal, Memory };
+
+    struct Entry {
+        qint64 offset;      // byte offset in the mapped file, or index into m_memory
+        qint32 length;
+        Source source;
+    };
+
+    ChatMessage decode(const Entry &entry) const;
+    QString idAt(const Entry &entry) const;
+    static quint64 cacheKey(const Entry &entry);
+
+    bool indexSnapshot(const QString &path, Conversation *header, ReplayState *state);
+    bool indexLegacySnapshot(const QString &path, Conversation *header, ReplayState *state);
+    bool indexJournal(const QString &path, Conversation *header, ReplayState *state);
+    void removeById(const QString &id);
+    qint64 store(const ChatMessage &message);
+    ChatMessage &pin(int row);
+
+    std::unique_ptr<QFile> m_snapshotFile;
+    std::unique_ptr<QFile> m_journalFile;
+    const char *m_snapshot = nullptr;
+    qint64 m_snapshotSize = 0;
+    const char *m_journal = nullptr;
+    qint64 m_journalSize = 0;
+
+    QList<Entry> m_entries;
+    QList<ChatMessage> m_memory;
+    QList<qint64> m_freeSlots;      // m_memory slots no entry refers to
+    mutable QCache<quint64, ChatMessage> m_cache;
+};
@@ -0,0 +1,139 @@
+#include "ContextWindowManager.h"
+#include "../utils/TokenEstimator.h"
+#include <QHash>
+#include <QtGlobal>
+
+void ContextWindowManager::setSummary(const QString &summary, int summarizedCount) {
+    m_summary = summary;
+    m_summarizedCount = summarizedCount;
+}
+
+void ContextWindowManager::reset() {
+    m_summary.clear();
+    m_summarizedCount = 0;
+}
+
+int ContextWindowManager::contextLimitForModel(const QString &model) {
+    // Ollama serves its models with a 2048 token num_ctx unless configured otherwise
+    static const QHash<QString, int> limits = {
+        {"gpt-4o", 128000},
+        {"gpt-4-turbo", 128000},
+        {"gpt-4", 8192},
+        {"gpt-3.5-turbo", 16385},
+        {"deepseek-chat", 64000},
+        {"deepseek-coder", 64000},
+        {"deepseek-reasoner", 64000},
+        {"llama-3.3-70b-versatile", 128000},
+        {"llama-3.1-8b-instant", 128000},
+        {"mixtral-8x7b-32768", 32768},
+        {"gemma2-9b-it", 8192},
+        {"llama3.2", 2048},
+        {"llama3.1", 2048},
+        {"mistral", 2048},
+        {"phi3", 2048},
+        {"gemma2", 2048},
+        {"qwen2.5", 2048}
+    };
+
+    auto it = limits.constFind(model);
+    if (it != limits.constEnd()) {
+        return it.value();
+    }
+    if (model.startsWith("claude")) {
+        return 200000;
+    }
+    if (model.startsWith("gemini")) {
+        return 1000000;
+    }
+    return 4096;
+}
+
+int ContextWindowManager::promptBudget() const {
+    int limit = contextLimitForModel(m_model);
+    int reply = qMin(m_replyTokens, limit / 2);
+    return qMin(limit - reply, m_maxPromptTokens);
+}
+
+int ContextWindowManager::fixedTokens() const {
+    // Reply priming is charged once per request
+    const int overhead = TokenEstimator::messageOverhead(m_model);
+    int tokens = overhead;
+    if (!m_systemPrompt.isEmpty()) {
+        tokens += TokenEstimator::countText(m_systemPrompt, m_model) + overhead;
+    }
+    if (!m_summary.isEmpty()) {
+        tokens += TokenEstimator::countText(m_summary, m_model) + overhead;
+    }
+    return tokens;
+}
+
+int ContextWindowManager::windowStart(const ChatHistory &history) const {
+    const TokenEstimator::Encoding encoding = TokenEstimator::encodingForModel(m_model);
+    const int overhead = TokenEstimator::messageOverhead(m_model);
+    int remaining = promptBudget() - fixedTokens();
+    int start = history.size();
+
+    // Walk back from the newest turn; the latest message is always sent
+    while (start > 0) {
+        int cost = TokenEstimator::countText(QStringView(history[start - 1].content), encoding) + overhead;
+        if (cost > remaining && start < history.size()) {
+            break;
+        }
+        remaining -= cost;
+        --start;
+    }
+    return start;
+}
+
+QList<QJsonObject> ContextWindowManager::buildMessages(const ChatHistory &history) const {
+    QList<QJsonObject> messages;
+
+    if (!m_systemPrompt.isEmpty()) {
+        messages.append(QJsonObject{{"role", "system"}, {"content", m_systemPrompt}});
+    }
+
+    int start = windowStart(history);
+    if (start > 0 && !m_summary.isEmpty()) {
+        messages.append(QJsonObject{
+            {"role", "system"},
+            {"content", "Summary of the earlier conversation: " + m_summary}
+        });
+    }
+
+    for (int i = start; i < history.size(); ++i) {
+        const ChatMessage &msg = history[i];
+        if (msg.content.isEmpty()) {
+            continue;
+        }
+        messages.append(QJsonObject{{"role", msg.role}, {"content", msg.content}});
+    }
+    return messages;
+}
+
+QList<ChatMessage> ContextWindowManager::unsummarizedOverflow(const ChatHistory &history, int maxTurns) const {
+    int start = windowStart(history);
+    if (start <= m_summarizedCount) {
+        return {};
+    }
+    int count = start - m_summarizedCount;
+    if (maxTurns >= 0) {
+        count = qMin(count, maxTurns);
+    }
+    return history.mid(m_summarizedCount, count);
+}
+
+QString ContextWindowManager::summaryPrompt(const QList<ChatMessage> &overflow) const {
+    QString prompt = "Update the running summary of a conversation between a child and Moxie, "
+                     "a friendly robot. Keep names, facts, preferences and open questions. "
+                     "Answer with the summary only, in at most 150 words.\n\n";
+
+    if (!m_summary.isEmpty()) {
+        prompt += "Current summary:\n" + m_summary + "\n\n";
+    }
+
+    prompt += "New turns:\n";
+    for (const auto &msg : overflow) {
+        prompt += (msg.role == "user" ? "Child: " : "Moxie: ") + msg.content + "\n";
+    }
+    return prompt;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <QString>
+#include <QList>
+#include <QJsonObject>
+#include "../models/Conversation.h"
+#include "ChatHistory.h"
+
+// Packs a conversation into a bounded chat request: the personality's system
+// prompt, a rolling summary of turns that no longer fit, and as many of the
+// most recent turns as the model's context budget allows.
+class ContextWindowManager {
+public:
+    ContextWindowManager() = default;
+
+    QString systemPrompt() const { return m_systemPrompt; }
+    void setSystemPrompt(const QString &prompt) { m_systemPrompt = prompt; }
+
+    QString model() const { return m_model; }
+    void setModel(const QString &model) { m_model = model; }
+
+    // Tokens kept free for the reply, normally Personality::maxTokens
+    int replyTokens() const { return m_replyTokens; }
+    void setReplyTokens(int tokens) { m_replyTokens = tokens; }
+
+    // Upper bound on prompt size regardless of how large the model window is
+    int maxPromptTokens() const { return m_maxPromptTokens; }
+    void setMaxPromptTokens(int tokens) { m_maxPromptTokens = tokens; }
+
+    QString summary() const { return m_summary; }
+    int summarizedCount() const { return m_summarizedCount; }
+    void setSummary(const QString &summary, int summarizedCount);
+    void reset();
+
+    int promptBudget() const;
+    QList<QJsonObject> buildMessages(const ChatHistory &history) const;
+
+    // Turns that fell out of the window and are not yet covered by the
+    // summary, oldest first and at most maxTurns of them when maxTurns >= 0
+    QList<ChatMessage> unsummarizedOverflow(const ChatHistory &history, int maxTurns = -1) const;
+    QString summaryPrompt(const QList<ChatMessage> &overflow) const;
+
+    static int contextLimitForModel(const QString &model);
+
+private:
+    int windowStart(const ChatHistory &history) const;
+    int fixedTokens() const;
+
+    QString m_systemPrompt;
+    QString m_model;
+    QString m_summary;
+    int m_summarizedCount = 0;
+    int m_replyTokens = 2000;
+    int m_maxPromptTokens = 4096;
+};
@@ -0,0 +1,467 @@
+#include "ConversationJournal.h"
+#include "StorageService.h"
+#include "../utils/DIContainer.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QCborMap>
+#include <QCborValue>
+#include <QDataStream>
+#include <QDebug>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+const QString JournalSuffix = QStringLiteral(".journal");
+const QString SnapshotSuffix = QStringLiteral(".snapshot.cbor");
+const QString LegacySnapshotSuffix = QStringLiteral(".snapshot.json");
+const QString SegmentSuffix = QStringLiteral(".segment");
+const QString CompactingSuffix = QStringLiteral(".snapshot.compacting");
+constexpr int SnapshotVersion = 1;
+
+// Header fields only; messages are journaled one by one
+QJsonObject headerJson(const Conversation &conversation) {
+    QJsonObject obj = conversation.toJson();
+    obj.remove("messages");
+    obj.remove("messageCount");
+    return obj;
+}
+
+// The conversation as snapshot plus journal describe it, messages included
+Conversation replay(const QString &snapshotPath, const QString &journalPath, const QString &conversationId,
+                    ChatHistory::ReplayState *state) {
+    Conversation conversation;
+    conversation.id = conversationId;
+    ChatHistory history;
+    history.open(snapshotPath, journalPath, &conversation, state);
+    conversation.messages = history.toList();
+    conversation.messageCount = conversation.messages.size();
+    return conversation;
+}
+
+// Thread-agnostic; the journal reports the error on its own thread
+bool saveSnapshot(const QString &path, const Conversation &conversation, qint64 lastSeq, QString *error) {
+    QCborMap root;
+    root.insert(QStringLiteral("v"), SnapshotVersion);
+    root.insert(QStringLiteral("lastSeq"), lastSeq);
+    root.insert(QStringLiteral("conversation"), conversation.toCbor());
+
+    QSaveFile snapshot(path);
+    if (!snapshot.open(QIODevice::WriteOnly)) {
+        *error = snapshot.errorString();
+        return false;
+    }
+    snapshot.write(root.toCborValue().toCbor());
+    if (!snapshot.commit()) {
+        *error = snapshot.errorString();
+        return false;
+    }
+    return true;
+}
+
+struct Compaction {
+    bool ok = false;
+    QString error;
+    ChatHistory::ReplayState state;
+};
+
+} // namespace
+
+ConversationJournal::ConversationJournal(const QString &directory, QObject *parent)
+    : QObject(parent)
+    , m_directory(directory)
+    , m_syncTimer(new QTimer(this)) {
+    QDir().mkpath(m_directory);
+
+    m_syncTimer->setSingleShot(true);
+    m_syncTimer->setInterval(250);
+    connect(m_syncTimer, &QTimer::timeout, this, &ConversationJournal::sync);
+}
+
+ConversationJournal::~ConversationJournal() {
+    closeActive();
+}
+
+QString ConversationJournal::journalPath(const QString &conversationId) const {
+    return m_directory + "/" + conversationId + JournalSuffix;
+}
+
+QString ConversationJournal::snapshotPath(const QString &conversationId) const {
+    return m_directory + "/" + conversationId + SnapshotSuffix;
+}
+
+bool ConversationJournal::exists(const QString &conversationId) const {
+    return QFile::exists(journalPath(conversationId)) || QFile::exists(snapshotPath(conversationId))
+        || QFile::exists(m_directory + "/" + conversationId + LegacySnapshotSuffix);
+}
+
+QStringList ConversationJournal::conversationIds() const {
+    QStringList ids;
+    const QStringList files = QDir(m_directory).entryList(
+        {"*" + JournalSuffix, "*" + SnapshotSuffix, "*" + LegacySnapshotSuffix}, QDir::Files);
+    for (const QString &file : files) {
+        QString id = file.endsWith(JournalSuffix) ? file.chopped(JournalSuffix.size())
+                                                  : file.chopped(SnapshotSuffix.size());
+        if (!ids.contains(id)) {
+            ids.append(id);
+        }
+    }
+    return ids;
+}
+
+QString ConversationJournal::existingSnapshotPath(const QString &conversationId) const {
+    // JSON snapshots predate the CBOR format and are replaced at the next compaction
+    QString legacy = m_directory + "/" + conversationId + LegacySnapshotSuffix;
+    if (!QFile::exists(snapshotPath(conversationId)) && QFile::exists(legacy)) {
+        return legacy;
+    }
+    return snapshotPath(conversationId);
+}
+
+QString ConversationJournal::archiveDirectory() const {
+    return m_directory + "/archive";
+}
+
+bool ConversationJournal::load(const QString &conversationId, Conversation *header, ChatHistory *history) {
+    closeActive();
+
+    ChatHistory::ReplayState state;
+    if (!read(conversationId, header, history, &state)) {
+        return false;
+    }
+    attach(conversationId, state);
+    return true;
+}
+
+bool ConversationJournal::read(const QString &conversationId, Conversation *header, ChatHistory *history,
+                               ChatHistory::ReplayState *state) {
+    if (!exists(conversationId)) {
+        restoreFromArchive(conversationId);
+    }
+
+    *header = Conversation();
+    header->id = conversationId;
+    return history->open(existingSnapshotPath(conversationId), journalPath(conversationId), header, state);
+}
+
+void ConversationJournal::attach(const QString &conversationId, const ChatHistory::ReplayState &state) {
+    closeActive();
+    m_seq = state.lastSeq;
+    m_recordsSinceSnapshot = state.journalRecords;
+    openActive(conversationId, state.validJournalBytes);
+}
+
+void ConversationJournal::begin(const Conversation &conversation) {
+    closeActive();
+
+    // A reused id starts over rather than mixing with old records
+    QFile::remove(snapshotPath(conversation.id));
+    QFile::remove(m_directory + "/" + conversation.id + LegacySnapshotSuffix);
+    QFile::remove(journalPath(conversation.id));
+
+    m_seq = 0;
+    m_recordsSinceSnapshot = 0;
+    openActive(conversation.id, 0);
+    updateHeader(conversation);
+    for (const auto &message : conversation.messages) {
+        appendMessage(message);
+    }
+}
+
+void ConversationJournal::openActive(const QString &conversationId, qint64 validBytes) {
+    m_conversationId = conversationId;
+    m_file.setFileName(journalPath(conversationId));
+
+    // Drop a torn tail so new records don't get glued onto it. Only an
+    // unterminated last line qualifies; anything past a newline is kept.
+    if (m_file.exists() && m_file.size() > validBytes) {
+        QFile tail(m_file.fileName());
+        if (tail.open(QIODevice::ReadOnly) && tail.seek(validBytes) && !tail.readAll().contains('\n')) {
+            tail.close();
+            qWarning() << "Dropping" << m_file.size() - validBytes << "bytes of torn journal tail for"
+                       << conversationId;
+            m_file.resize(validBytes);
+        } else {
+            qWarning() << "Journal for" << conversationId << "has records past the replayed end; keeping them";
+        }
+    }
+
+    // Unbuffered: a record is in the page cache as soon as append() returns,
+    // so only power loss inside the sync window can lose it
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        emit writeError(conversationId, m_file.errorString());
+    }
+}
+
+void ConversationJournal::closeActive() {
+    ++m_generation;
+    if (!m_file.isOpen()) {
+        return;
+    }
+    sync();
+    m_file.close();
+    m_conversationId.clear();
+}
+
+void ConversationJournal::appendMessage(const ChatMessage &message) {
+    QJsonObject record;
+    record["op"] = "add";
+    record["message"] = message.toJson();
+    append(record);
+}
+
+void ConversationJournal::removeMessage(const QString &messageId) {
+    QJsonObject record;
+    record["op"] = "remove";
+    record["id"] = messageId;
+    append(record);
+}
+
+void ConversationJournal::clearMessages() {
+    QJsonObject record;
+    record["op"] = "clear";
+    append(record);
+}
+
+void ConversationJournal::updateHeader(const Conversation &conversation) {
+    QJsonObject record;
+    record["op"] = "header";
+    record["conversation"] = headerJson(conversation);
+    append(record);
+}
+
+void ConversationJournal::append(QJsonObject record) {
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    record["seq"] = ++m_seq;
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    if (m_file.write(line) != line.size()) {
+        emit writeError(m_conversationId, m_file.errorString());
+        return;
+    }
+
+    ++m_recordsSinceSnapshot;
+    if (++m_unsynced >= m_maxUnsynced) {
+        sync();
+    } else if (!m_syncTimer->isActive()) {
+        m_syncTimer->start();
+    }
+}
+
+void ConversationJournal::flush() {
+    sync();
+}
+
+void ConversationJournal::sync() {
+    m_syncTimer->stop();
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    if (m_unsynced > 0) {
+        if (::fdatasync(m_file.handle()) != 0) {
+            emit writeError(m_conversationId, QString::fromLocal8Bit(strerror(errno)));
+        }
+        m_unsynced = 0;
+    }
+
+    if (m_recordsSinceSnapshot >= m_compactionThreshold) {
+        compactInBackground();
+    }
+}
+
+Conversation ConversationJournal::readConversation(const QString &conversationId, qint64 *lastSeq) const {
+    ChatHistory::ReplayState state;
+    Conversation conversation = replay(existingSnapshotPath(conversationId), journalPath(conversationId),
+                                       conversationId, &state);
+    if (lastSeq) {
+        *lastSeq = state.lastSeq;
+    }
+    return conversation;
+}
+
+bool ConversationJournal::writeSnapshot(const Conversation &conversation, qint64 lastSeq) {
+    QString error;
+    if (!saveSnapshot(snapshotPath(conversation.id), conversation, lastSeq, &error)) {
+        emit writeError(conversation.id, error);
+        return false;
+    }
+    return true;
+}
+
+bool ConversationJournal::compact() {
+    if (m_conversationId.isEmpty()) {
+        return false;
+    }
+    // A background compaction still running would be adopted over this one
+    ++m_generation;
+
+    // Rebuilding from disk keeps this class stateless, at the price of a full
+    // replay and CBOR encode; the active journal does this on the I/O thread
+    qint64 lastSeq = 0;
+    if (!writeSnapshot(readConversation(m_conversationId, &lastSeq), lastSeq)) {
+        return false;
+    }
+
+    // Safe to drop now: anything left over would be skipped by lastSeq anyway.
+    // The journal is replaced rather than truncated so a ChatHistory that has
+    // the old one mapped keeps reading valid pages.
+    QFile::remove(m_directory + "/" + m_conversationId + LegacySnapshotSuffix);
+    m_file.close();
+    QFile::remove(journalPath(m_conversationId));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        emit writeError(m_conversationId, m_file.errorString());
+    }
+    m_recordsSinceSnapshot = 0;
+    return true;
+}
+
+void ConversationJournal::compactInBackground() {
+    if (m_compacting || m_conversationId.isEmpty()) {
+        return;
+    }
+    if (!m_storage) {
+        m_storage = DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this);
+    }
+    m_compacting = true;
+
+    // The worker replays what is on disk now into a side file; records
+    // appended meanwhile lie past the bytes it replayed
+    const QString id = m_conversationId;
+    const QString snapshot = existingSnapshotPath(id);
+    const QString journal = journalPath(id);
+    const QString pending = m_directory + "/" + id + CompactingSuffix;
+    const quint64 generation = m_generation;
+    m_storage->runAsync([id, snapshot, journal, pending]() {
+        Compaction result;
+        Conversation conversation = replay(snapshot, journal, id, &result.state);
+        result.ok = saveSnapshot(pending, conversation, result.state.lastSeq, &result.error);
+        return result;
+    }).then(this, [this, id, pending, generation](const Compaction &result) {
+        m_compacting = false;
+        if (!result.ok) {
+            QFile::remove(pending);
+            emit writeError(id, result.error);
+        } else if (generation != m_generation) {
+            QFile::remove(pending);
+        } else {
+            adoptSnapshot(pending, result.state.validJournalBytes);
+        }
+    });
+}
+
+// Installs a snapshot written by compactInBackground() and starts a new
+// journal holding only the records appended after the bytes it replayed,
+// usually a handful. The snapshot goes first: until the journal is replaced,
+// its lastSeq makes replay skip the records it already holds.
+bool ConversationJournal::adoptSnapshot(const QString &pendingPath, qint64 compactedBytes) {
+    const QString id = m_conversationId;
+    QFile journal(journalPath(id));
+    if (!journal.open(QIODevice::ReadOnly) || !journal.seek(compactedBytes)) {
+        emit writeError(id, journal.errorString());
+        QFile::remove(pendingPath);
+        return false;
+    }
+    const QByteArray tail = journal.readAll();
+    journal.close();
+
+    if (::rename(QFile::encodeName(pendingPath).constData(), QFile::encodeName(snapshotPath(id)).constData()) != 0) {
+        emit writeError(id, QString::fromLocal8Bit(strerror(errno)));
+        QFile::remove(pendingPath);
+        return false;
+    }
+    QFile::remove(m_directory + "/" + id + LegacySnapshotSuffix);
+
+    // Replaced rather than truncated, as in compact()
+    QSaveFile replacement(journalPath(id));
+    if (!replacement.open(QIODevice::WriteOnly) || replacement.write(tail) != tail.size()
+        || !replacement.commit()) {
+        emit writeError(id, replacement.errorString());
+        return false;
+    }
+    m_file.close();
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        emit writeError(id, m_file.errorString());
+    }
+    m_unsynced = 0;
+    m_recordsSinceSnapshot = tail.count('\n');
+    return true;
+}
+
+bool ConversationJournal::archive(const QString &conversationId) {
+    if (conversationId == m_conversationId || !exists(conversationId)) {
+        return false;
+    }
+
+    Conversation conversation = readConversation(conversationId);
+    QDateTime when = conversation.updatedAt.isValid() ? conversation.updatedAt : QDateTime::currentDateTime();
+    QDir().mkpath(archiveDirectory());
+
+    // One segment per month; each record is the id followed by the
+    // compressed CBOR conversation, so lookups can skip bodies unread
+    QFile segment(archiveDirectory() + "/" + when.toString("yyyy-MM") + SegmentSuffix);
+    if (!segment.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        emit writeError(conversationId, segment.errorString());
+        return false;
+    }
+    QDataStream out(&segment);
+    out << conversationId << qCompress(conversation.toCbor().toCborValue().toCbor(), 9);
+    if (out.status() != QDataStream::Ok || !segment.flush() || ::fdatasync(segment.handle()) != 0) {
+        emit writeError(conversationId, segment.errorString());
+        return false;
+    }
+    segment.close();
+
+    // The record is durable, so the loose files can go
+    QFile::remove(journalPath(conversationId));
+    QFile::remove(snapshotPath(conversationId));
+    QFile::remove(m_directory + "/" + conversationId + LegacySnapshotSuffix);
+    return true;
+}
+
+bool ConversationJournal::restoreFromArchive(const QString &conversationId) {
+    // Newest segment first, and within a segment the last record wins, since
+    // a conversation archived twice appears twice
+    QDir dir(archiveDirectory());
+    const QStringList segments = dir.entryList({"*" + SegmentSuffix}, QDir::Files, QDir::Name | QDir::Reversed);
+    for (const QString &name : segments) {
+        QFile segment(dir.filePath(name));
+        if (!segment.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        QDataStream in(&segment);
+        QByteArray found;
+        while (!in.atEnd()) {
+            QString id;
+            in >> id;
+            if (in.status() != QDataStream::Ok) {
+                break;
+            }
+            if (id == conversationId) {
+                in >> found;
+            } else {
+                quint32 length = 0;
+                in >> length;
+                if (length != 0xFFFFFFFF) {
+                    in.skipRawData(length);
+                }
+            }
+        }
+        if (found.isEmpty()) {
+            continue;
+        }
+
+        QCborValue value = QCborValue::fromCbor(qUncompress(found));
+        Conversation conversation = Conversation::fromCbor(value.toMap());
+        conversation.id = conversationId;
+        return writeSnapshot(conversation, 0);
+    }
+    return false;
+}
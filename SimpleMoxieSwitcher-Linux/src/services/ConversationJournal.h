@@ -0,0 +1,116 @@
+#pragma once
+#include <QObject>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <QTimer>
+#include "../models/Conversation.h"
+#include "ChatHistory.h"
+
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
+
+// Append-only storage for the active conversation. Every change is one
+// compact JSON line in <id>.journal, so saving a message costs the same no
+// matter how long the chat is. Lines hit the kernel immediately and are
+// fsync'd in batches. Once enough records pile up, the journal is folded into
+// an atomically written CBOR <id>.snapshot.cbor on the storage I/O thread, and
+// the records it covers are dropped from the journal. Records carry a
+// sequence number and the snapshot remembers the last one it includes, so a
+// crash between the two steps never replays a record twice. On load an
+// unterminated final line (a torn write) is dropped; a damaged line anywhere
+// else is skipped and everything after it is kept.
+//
+// Conversations that are no longer in use can be archived: they are appended,
+// compressed, to a monthly segment under archive/ and their loose files are
+// removed. load() brings an archived conversation back transparently.
+class ConversationJournal : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ConversationJournal(const QString &directory, QObject *parent = nullptr);
+    ~ConversationJournal() override;
+
+    // Indexes snapshot and journal into history (messages decode lazily),
+    // fills in the header and makes it the active journal; false if nothing
+    // was ever written for that id
+    bool load(const QString &conversationId, Conversation *header, ChatHistory *history);
+
+    // load() in two halves. read() restores an archived conversation and
+    // indexes its files without touching the active journal, so a separate
+    // ConversationJournal can run it on the I/O thread; attach() then makes
+    // the conversation active here. Nothing may append to that conversation
+    // in between.
+    bool read(const QString &conversationId, Conversation *header, ChatHistory *history,
+              ChatHistory::ReplayState *state);
+    void attach(const QString &conversationId, const ChatHistory::ReplayState &state);
+
+    // Syncs and closes the active journal; appends are dropped until the
+    // next load() or begin()
+    void close() { closeActive(); }
+
+    // Starts a journal for a brand new conversation
+    void begin(const Conversation &conversation);
+
+    QString activeConversationId() const { return m_conversationId; }
+    bool exists(const QString &conversationId) const;
+    QStringList conversationIds() const;
+
+    // Changes to the active conversation
+    void appendMessage(const ChatMessage &message);
+    void removeMessage(const QString &messageId);
+    void clearMessages();
+    void updateHeader(const Conversation &conversation);
+
+    // Writes and fsyncs anything pending
+    void flush();
+
+    // Folds the journal into the snapshot now, on the calling thread
+    bool compact();
+
+    // Moves an inactive conversation into the archive segments
+    bool archive(const QString &conversationId);
+
+    void setSyncIntervalMs(int ms) { m_syncTimer->setInterval(ms); }
+    void setCompactionThreshold(int records) { m_compactionThreshold = qMax(1, records); }
+
+signals:
+    void writeError(const QString &conversationId, const QString &error);
+
+private:
+    QString journalPath(const QString &conversationId) const;
+    QString snapshotPath(const QString &conversationId) const;
+
+    QString existingSnapshotPath(const QString &conversationId) const;
+    QString archiveDirectory() const;
+
+    Conversation readConversation(const QString &conversationId, qint64 *lastSeq = nullptr) const;
+    bool writeSnapshot(const Conversation &conversation, qint64 lastSeq);
+    bool restoreFromArchive(const QString &conversationId);
+
+    void openActive(const QString &conversationId, qint64 validBytes);
+    void closeActive();
+    void append(QJsonObject record);
+    void sync();
+    void compactInBackground();
+    bool adoptSnapshot(const QString &pendingPath, qint64 compactedBytes);
+
+    QString m_directory;
+    QString m_conversationId;
+    QFile m_file;
+    qint64 m_seq = 0;
+    int m_recordsSinceSnapshot = 0;
+    int m_unsynced = 0;
+    QTimer *m_syncTimer;
+
+    // Resolved on the first background compaction; one runs at a time, and
+    // its result is dropped if the active journal changed meanwhile
+    SimpleMoxieSwitcher::StorageService *m_storage = nullptr;
+    bool m_compacting = false;
+    quint64 m_generation = 0;
+
+    int m_compactionThreshold = 200;
+    int m_maxUnsynced = 32;
+};
@@ -0,0 +1,839 @@
+#include "DatabaseService.h"
+#include "StorageService.h"
+#include "../utils/DIContainer.h"
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <limits>
+#include <utility>
+
+namespace {
+
+constexpr int SchemaVersion = 3;
+
+QVariant toMs(const QDateTime &dateTime) {
+    return dateTime.isValid() ? QVariant(dateTime.toMSecsSinceEpoch()) : QVariant(QMetaType(QMetaType::LongLong));
+}
+
+QDateTime fromMs(const QVariant &value) {
+    return value.isNull() ? QDateTime() : QDateTime::fromMSecsSinceEpoch(value.toLongLong());
+}
+
+const QStringList SchemaV1 = {
+    "CREATE TABLE IF NOT EXISTS child_profiles ("
+    "  id TEXT PRIMARY KEY, name TEXT NOT NULL, age INTEGER, avatar TEXT,"
+    "  created_at INTEGER, last_played_at INTEGER, total_points INTEGER NOT NULL DEFAULT 0,"
+    "  games_played INTEGER NOT NULL DEFAULT 0, favorite_game TEXT, personality_id TEXT,"
+    "  is_active INTEGER NOT NULL DEFAULT 0)",
+
+    "CREATE TABLE IF NOT EXISTS conversations ("
+    "  id TEXT PRIMARY KEY, title TEXT, child_profile_id TEXT, personality_id TEXT,"
+    "  created_at INTEGER, updated_at INTEGER, message_count INTEGER NOT NULL DEFAULT 0,"
+    "  is_archived INTEGER NOT NULL DEFAULT 0)",
+    "CREATE INDEX IF NOT EXISTS idx_conversations_updated ON conversations(updated_at)",
+    "CREATE INDEX IF NOT EXISTS idx_conversations_child_updated ON conversations(child_profile_id, updated_at)",
+
+    "CREATE TABLE IF NOT EXISTS messages ("
+    "  id TEXT PRIMARY KEY,"
+    "  conversation_id TEXT NOT NULL REFERENCES conversations(id) ON DELETE CASCADE,"
+    "  role TEXT NOT NULL, content TEXT NOT NULL, timestamp INTEGER)",
+    "CREATE INDEX IF NOT EXISTS idx_messages_conversation ON messages(conversation_id, timestamp)",
+
+    "CREATE TABLE IF NOT EXISTS memories ("
+    "  id TEXT PRIMARY KEY, content TEXT NOT NULL, category TEXT, source TEXT,"
+    "  created_at INTEGER, importance REAL, access_count INTEGER, last_accessed_at INTEGER)",
+    "CREATE INDEX IF NOT EXISTS idx_memories_category ON memories(category, importance)",
+    "CREATE INDEX IF NOT EXISTS idx_memories_source ON memories(source)",
+
+    "CREATE TABLE IF NOT EXISTS usage_records ("
+    "  row_id INTEGER PRIMARY KEY, id TEXT, child_profile_id TEXT, feature TEXT, ai_model TEXT,"
+    "  tokens_used INTEGER, estimated_cost REAL, timestamp INTEGER NOT NULL,"
+    "  duration_seconds INTEGER, session_id TEXT, was_successful INTEGER, error_message TEXT)",
+    "CREATE INDEX IF NOT EXISTS idx_usage_timestamp ON usage_records(timestamp)",
+    "CREATE INDEX IF NOT EXISTS idx_usage_child_timestamp ON usage_records(child_profile_id, timestamp)",
+};
+
+// Full-text search. messages is rebuilt with an INTEGER PRIMARY KEY so the
+// FTS rowids stay stable across VACUUM; the FTS table stores no text of its
+// own and triggers keep it in step with every insert, update and delete.
+const QStringList SchemaV2 = {
+    "CREATE TABLE messages_v2 ("
+    "  seq INTEGER PRIMARY KEY, id TEXT NOT NULL UNIQUE,"
+    "  conversation_id TEXT NOT NULL REFERENCES conversations(id) ON DELETE CASCADE,"
+    "  role TEXT NOT NULL, content TEXT NOT NULL, timestamp INTEGER)",
+    "INSERT INTO messages_v2 (id, conversation_id, role, content, timestamp)"
+    "  SELECT id, conversation_id, role, content, timestamp FROM messages ORDER BY timestamp",
+    "DROP TABLE messages",
+    "ALTER TABLE messages_v2 RENAME TO messages",
+    "CREATE INDEX IF NOT EXISTS idx_messages_conversation ON messages(conversation_id, timestamp)",
+
+    "CREATE VIRTUAL TABLE messages_fts USING fts5("
+    "  content, content='messages', content_rowid='seq',"
+    "  tokenize='unicode61 remove_diacritics 2', prefix='2 3')",
+    "CREATE TRIGGER messages_fts_insert AFTER INSERT ON messages BEGIN"
+    "  INSERT INTO messages_fts(rowid, content) VALUES (new.seq, new.content); END",
+    "CREATE TRIGGER messages_fts_delete AFTER DELETE ON messages BEGIN"
+    "  INSERT INTO messages_fts(messages_fts, rowid, content) VALUES ('delete', old.seq, old.content); END",
+    "CREATE TRIGGER messages_fts_update AFTER UPDATE OF content ON messages BEGIN"
+    "  INSERT INTO messages_fts(messages_fts, rowid, content) VALUES ('delete', old.seq, old.content);"
+    "  INSERT INTO messages_fts(rowid, content) VALUES (new.seq, new.content); END",
+    "INSERT INTO messages_fts(messages_fts) VALUES ('rebuild')",
+};
+
+// Daily totals that raw usage rows are rolled into once they age out. Key
+// columns are never NULL so the upsert can find an existing day.
+const QStringList SchemaV3 = {
+    "CREATE TABLE IF NOT EXISTS usage_daily ("
+    "  day TEXT NOT NULL, child_profile_id TEXT NOT NULL, feature TEXT NOT NULL,"
+    "  ai_model TEXT NOT NULL, requests INTEGER NOT NULL, tokens_used INTEGER NOT NULL,"
+    "  estimated_cost REAL NOT NULL, duration_seconds INTEGER NOT NULL,"
+    "  PRIMARY KEY (day, child_profile_id, feature, ai_model))",
+};
+
+// Turns free text into an FTS5 query: every word must match, and each is
+// matched as a prefix so results show up while the parent is still typing.
+// Words are quoted, so FTS operators in the input are taken literally.
+QString ftsQuery(const QString &text) {
+    QStringList terms;
+    QString word;
+    auto flush = [&]() {
+        if (!word.isEmpty()) {
+            terms.append('"' + word + "\"*");
+            word.clear();
+        }
+    };
+    for (const QChar ch : text) {
+        if (ch.isLetterOrNumber() || ch.isMark()) {
+            word += ch;
+        } else {
+            flush();
+        }
+    }
+    flush();
+    return terms.join(' ');
+}
+
+} // namespace
+
+DatabaseService::DatabaseService(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_connectionName(QString("moxie-db-%1").arg(quintptr(this), 0, 16))
+    , m_flushTimer(new QTimer(this)) {
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(m_flushDelayMs);
+    connect(m_flushTimer, &QTimer::timeout, this, &DatabaseService::flush);
+
+    m_path = path;
+    if (m_path.isEmpty()) {
+        auto *storage = DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this);
+        m_path = storage->dataPath() + "/moxie.db";
+    }
+    m_open = openDatabase(m_path) && migrate();
+
+    // The shared instance lives in a static and is destroyed after the
+    // application object, when the SQL driver is no longer usable; close
+    // while it still is. Instances on other threads close in the destructor.
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app && app->thread() == thread()) {
+        connect(app, &QCoreApplication::aboutToQuit, this, &DatabaseService::close);
+    }
+}
+
+DatabaseService::~DatabaseService() {
+    close();
+}
+
+void DatabaseService::close() {
+    if (!QSqlDatabase::contains(m_connectionName)) {
+        return;
+    }
+    flush();
+    m_open = false;
+    m_statements.clear();
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+bool DatabaseService::openDatabase(const QString &path) {
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+    db.setDatabaseName(path);
+    if (!db.open()) {
+        qWarning() << "Failed to open database" << path << db.lastError().text();
+        emit databaseError(db.lastError().text());
+        return false;
+    }
+
+    // WAL lets readers run alongside the batched writer; NORMAL sync is
+    // durable across app crashes and only risks the last commit on power loss
+    return exec("PRAGMA journal_mode=WAL")
+        && exec("PRAGMA synchronous=NORMAL")
+        && exec("PRAGMA foreign_keys=ON")
+        && exec("PRAGMA temp_store=MEMORY");
+}
+
+bool DatabaseService::migrate() {
+    QSqlQuery query(QSqlDatabase::database(m_connectionName));
+    int version = query.exec("PRAGMA user_version") && query.next() ? query.value(0).toInt() : 0;
+    query.finish();
+    if (version >= SchemaVersion) {
+        return true;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    db.transaction();
+    const QList<QStringList> steps = {SchemaV1, SchemaV2, SchemaV3};
+    for (int step = version; step < SchemaVersion; ++step) {
+        for (const QString &sql : steps[step]) {
+            if (!exec(sql)) {
+                db.rollback();
+                return false;
+            }
+        }
+    }
+    exec(QString("PRAGMA user_version=%1").arg(SchemaVersion));
+    return db.commit();
+}
+
+bool DatabaseService::exec(const QString &sql) {
+    QSqlQuery query(QSqlDatabase::database(m_connectionName));
+    if (!query.exec(sql)) {
+        qWarning() << "SQL failed:" << sql << query.lastError().text();
+        emit databaseError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+QSqlQuery &DatabaseService::statement(const QString &sql) {
+    auto it = m_statements.find(sql);
+    if (it == m_statements.end()) {
+        auto query = std::make_shared<QSqlQuery>(QSqlDatabase::database(m_connectionName));
+        if (!query->prepare(sql)) {
+            qWarning() << "SQL prepare failed:" << sql << query->lastError().text();
+        }
+        it = m_statements.insert(sql, query);
+    }
+    return **it;
+}
+
+bool DatabaseService::run(QSqlQuery &query) {
+    if (!query.exec()) {
+        qWarning() << "SQL failed:" << query.lastQuery() << query.lastError().text();
+        emit databaseError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+void DatabaseService::enqueue(Write write) {
+    if (!m_open) {
+        return;
+    }
+    m_pending.append(std::move(write));
+    if (m_pending.size() >= m_maxPendingWrites) {
+        flush();
+    } else if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+bool DatabaseService::flush() {
+    m_flushTimer->stop();
+    if (m_pending.isEmpty()) {
+        return true;
+    }
+
+    const QList<Write> writes = std::exchange(m_pending, {});
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.transaction()) {
+        emit databaseError(db.lastError().text());
+        return false;
+    }
+
+    // Each write runs in its own savepoint: one that fails partway is
+    // rolled back whole and reported, and the rest of the batch still commits
+    bool ok = true;
+    for (const Write &write : writes) {
+        if (!run(statement("SAVEPOINT write"))) {
+            ok = false;
+            continue;
+        }
+        if (write()) {
+            run(statement("RELEASE write"));
+        } else {
+            run(statement("ROLLBACK TO write"));
+            run(statement("RELEASE write"));
+            ok = false;
+        }
+    }
+
+    if (!db.commit()) {
+        emit databaseError(db.lastError().text());
+        db.rollback();
+        return false;
+    }
+    return ok;
+}
+
+void DatabaseService::readSnapshot(const std::function<void()> &reads) {
+    if (!m_open) {
+        return;
+    }
+    flush();
+
+    // SQLite takes the snapshot at the first read after BEGIN and holds it
+    // until the transaction ends
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    const bool began = db.transaction();
+    reads();
+    if (began) {
+        db.commit();
+    }
+}
+
+// Conversations
+
+void DatabaseService::saveConversation(const Conversation &conversation) {
+    enqueue([this, conversation]() {
+        QSqlQuery &query = statement(
+            "INSERT INTO conversations (id, title, child_profile_id, personality_id, created_at,"
+            " updated_at, message_count, is_archived) VALUES (?, ?, ?, ?, ?, ?, ?, ?)"
+            " ON CONFLICT(id) DO UPDATE SET title = excluded.title,"
+            " child_profile_id = excluded.child_profile_id, personality_id = excluded.personality_id,"
+            " updated_at = excluded.updated_at, message_count = excluded.message_count,"
+            " is_archived = excluded.is_archived");
+        query.addBindValue(conversation.id);
+        query.addBindValue(conversation.title);
+        query.addBindValue(conversation.childProfileId);
+        query.addBindValue(conversation.personalityId);
+        query.addBindValue(toMs(conversation.createdAt));
+        query.addBindValue(toMs(conversation.updatedAt));
+        query.addBindValue(conversation.messageCount);
+        query.addBindValue(conversation.isArchived);
+        if (!run(query)) {
+            return false;
+        }
+
+        bool ok = true;
+        for (const auto &message : conversation.messages) {
+            QSqlQuery &insert = statement(
+                "INSERT INTO messages (id, conversation_id, role, content, timestamp) VALUES (?, ?, ?, ?, ?)"
+                " ON CONFLICT(id) DO UPDATE SET role = excluded.role, content = excluded.content,"
+                " timestamp = excluded.timestamp");
+            insert.addBindValue(message.id);
+            insert.addBindValue(conversation.id);
+            insert.addBindValue(message.role);
+            insert.addBindValue(message.content);
+            insert.addBindValue(toMs(message.timestamp));
+            ok = run(insert) && ok;
+        }
+        return ok;
+    });
+}
+
+void DatabaseService::appendMessage(const QString &conversationId, const ChatMessage &message) {
+    enqueue([this, conversationId, message]() {
+        QSqlQuery &insert = statement(
+            "INSERT INTO messages (id, conversation_id, role, content, timestamp) VALUES (?, ?, ?, ?, ?)"
+            " ON CONFLICT(id) DO UPDATE SET role = excluded.role, content = excluded.content,"
+            " timestamp = excluded.timestamp");
+        insert.addBindValue(message.id);
+        insert.addBindValue(conversationId);
+        insert.addBindValue(message.role);
+        insert.addBindValue(message.content);
+        insert.addBindValue(toMs(message.timestamp));
+        if (!run(insert)) {
+            return false;
+        }
+
+        QSqlQuery &touch = statement(
+            "UPDATE conversations SET message_count = message_count + 1,"
+            " updated_at = MAX(COALESCE(updated_at, 0), ?) WHERE id = ?");
+        touch.addBindValue(toMs(message.timestamp));
+        touch.addBindValue(conversationId);
+        return run(touch);
+    });
+}
+
+void DatabaseService::removeMessage(const QString &messageId) {
+    enqueue([this, messageId]() {
+        QSqlQuery &count = statement(
+            "UPDATE conversations SET message_count = MAX(message_count - 1, 0)"
+            " WHERE id = (SELECT conversation_id FROM messages WHERE id = ?)");
+        count.addBindValue(messageId);
+        QSqlQuery &remove = statement("DELETE FROM messages WHERE id = ?");
+        remove.addBindValue(messageId);
+        return run(count) && run(remove);
+    });
+}
+
+void DatabaseService::clearMessages(const QString &conversationId) {
+    enqueue([this, conversationId]() {
+        QSqlQuery &remove = statement("DELETE FROM messages WHERE conversation_id = ?");
+        remove.addBindValue(conversationId);
+        QSqlQuery &count = statement("UPDATE conversations SET message_count = 0 WHERE id = ?");
+        count.addBindValue(conversationId);
+        return run(remove) && run(count);
+    });
+}
+
+void DatabaseService::deleteConversation(const QString &conversationId) {
+    enqueue([this, conversationId]() {
+        // Messages go with it through ON DELETE CASCADE
+        QSqlQuery &remove = statement("DELETE FROM conversations WHERE id = ?");
+        remove.addBindValue(conversationId);
+        return run(remove);
+    });
+}
+
+QList<Conversation> DatabaseService::conversationsUpdatedSince(const QDateTime &since,
+                                                               const QString &childProfileId) {
+    QList<Conversation> result;
+    if (!m_open) {
+        return result;
+    }
+    flush();
+
+    static const QString columns =
+        "SELECT id, title, child_profile_id, personality_id, created_at, updated_at,"
+        " message_count, is_archived FROM conversations WHERE updated_at >= ?";
+    QSqlQuery &query = childProfileId.isEmpty()
+        ? statement(columns + " ORDER BY updated_at DESC")
+        : statement(columns + " AND child_profile_id = ? ORDER BY updated_at DESC");
+    query.addBindValue(since.toMSecsSinceEpoch());
+    if (!childProfileId.isEmpty()) {
+        query.addBindValue(childProfileId);
+    }
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        Conversation c;
+        c.id = query.value(0).toString();
+        c.title = query.value(1).toString();
+        c.childProfileId = query.value(2).toString();
+        c.personalityId = query.value(3).toString();
+        c.createdAt = fromMs(query.value(4));
+        c.updatedAt = fromMs(query.value(5));
+        c.messageCount = query.value(6).toInt();
+        c.isArchived = query.value(7).toBool();
+        result.append(c);
+    }
+    query.finish();
+    return result;
+}
+
+QList<ChatMessage> DatabaseService::messages(const QString &conversationId, int limit, int offset) {
+    QList<ChatMessage> result;
+    if (!m_open) {
+        return result;
+    }
+    flush();
+
+    QSqlQuery &query = statement(
+        "SELECT id, role, content, timestamp FROM messages WHERE conversation_id = ?"
+        " ORDER BY timestamp LIMIT ? OFFSET ?");
+    query.addBindValue(conversationId);
+    query.addBindValue(limit);
+    query.addBindValue(offset);
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        ChatMessage m;
+        m.id = query.value(0).toString();
+        m.role = query.value(1).toString();
+        m.content = query.value(2).toString();
+        m.timestamp = fromMs(query.value(3));
+        result.append(m);
+    }
+    query.finish();
+    return result;
+}
+
+int DatabaseService::messageCount(const QString &conversationId) {
+    if (!m_open) {
+        return 0;
+    }
+    flush();
+
+    QSqlQuery &query = statement("SELECT COUNT(*) FROM messages WHERE conversation_id = ?");
+    query.addBindValue(conversationId);
+    int count = run(query) && query.next() ? query.value(0).toInt() : 0;
+    query.finish();
+    return count;
+}
+
+QList<DatabaseService::MessageMatch> DatabaseService::searchMessages(const QString &text, int limit,
+                                                                     const QString &childProfileId) {
+    QList<MessageMatch> result;
+    const QString match = ftsQuery(text);
+    if (!m_open || match.isEmpty()) {
+        return result;
+    }
+    flush();
+
+    static const QString columns =
+        "SELECT m.id, m.conversation_id, c.title, m.role, m.timestamp,"
+        " snippet(messages_fts, 0, '[', ']', '...', 12), bm25(messages_fts) AS score"
+        " FROM messages_fts JOIN messages m ON m.seq = messages_fts.rowid"
+        " JOIN conversations c ON c.id = m.conversation_id"
+        " WHERE messages_fts MATCH ?";
+    QSqlQuery &query = childProfileId.isEmpty()
+        ? statement(columns + " ORDER BY score, m.timestamp DESC LIMIT ?")
+        : statement(columns + " AND c.child_profile_id = ? ORDER BY score, m.timestamp DESC LIMIT ?");
+    query.addBindValue(match);
+    if (!childProfileId.isEmpty()) {
+        query.addBindValue(childProfileId);
+    }
+    query.addBindValue(limit);
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        MessageMatch hit;
+        hit.messageId = query.value(0).toString();
+        hit.conversationId = query.value(1).toString();
+        hit.conversationTitle = query.value(2).toString();
+        hit.role = query.value(3).toString();
+        hit.timestamp = fromMs(query.value(4));
+        hit.snippet = query.value(5).toString();
+        hit.score = query.value(6).toDouble();
+        result.append(hit);
+    }
+    query.finish();
+    return result;
+}
+
+// Memories
+
+void DatabaseService::saveMemory(const Memory &memory) {
+    enqueue([this, memory]() {
+        QSqlQuery &query = statement(
+            "INSERT OR REPLACE INTO memories (id, content, category, source, created_at,"
+            " importance, access_count, last_accessed_at) VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+        query.addBindValue(memory.id);
+        query.addBindValue(memory.content);
+        query.addBindValue(memory.category);
+        query.addBindValue(memory.source);
+        query.addBindValue(toMs(memory.createdAt));
+        query.addBindValue(memory.importance);
+        query.addBindValue(memory.accessCount);
+        query.addBindValue(toMs(memory.lastAccessedAt));
+        return run(query);
+    });
+}
+
+QList<Memory> DatabaseService::memories(const QString &category, int limit) {
+    QList<Memory> result;
+    if (!m_open) {
+        return result;
+    }
+    flush();
+
+    static const QString columns =
+        "SELECT id, content, category, source, created_at, importance, access_count,"
+        " last_accessed_at FROM memories";
+    QSqlQuery &query = category.isEmpty()
+        ? statement(columns + " ORDER BY importance DESC LIMIT ?")
+        : statement(columns + " WHERE category = ? ORDER BY importance DESC LIMIT ?");
+    if (!category.isEmpty()) {
+        query.addBindValue(category);
+    }
+    query.addBindValue(limit);
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        Memory m;
+        m.id = query.value(0).toString();
+        m.content = query.value(1).toString();
+        m.category = query.value(2).toString();
+        m.source = query.value(3).toString();
+        m.createdAt = fromMs(query.value(4));
+        m.importance = query.value(5).toDouble();
+        m.accessCount = query.value(6).toInt();
+        m.lastAccessedAt = fromMs(query.value(7));
+        result.append(m);
+    }
+    query.finish();
+    return result;
+}
+
+// Usage
+
+void DatabaseService::recordUsage(const UsageRecord &record) {
+    enqueue([this, record]() {
+        QSqlQuery &query = statement(
+            "INSERT INTO usage_records (id, child_profile_id, feature, ai_model, tokens_used,"
+            " estimated_cost, timestamp, duration_seconds, session_id, was_successful, error_message)"
+            " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+        query.addBindValue(record.id);
+        query.addBindValue(record.childProfileId);
+        query.addBindValue(record.feature);
+        query.addBindValue(record.aiModel);
+        query.addBindValue(record.tokensUsed);
+        query.addBindValue(record.estimatedCost);
+        query.addBindValue(record.timestamp.toMSecsSinceEpoch());
+        query.addBindValue(record.durationSeconds);
+        query.addBindValue(record.sessionId);
+        query.addBindValue(record.wasSuccessful);
+        query.addBindValue(record.errorMessage);
+        return run(query);
+    });
+}
+
+QList<UsageRecord> DatabaseService::usageRecords(const QDateTime &from, const QDateTime &to,
+                                                 const QString &childProfileId) {
+    QList<UsageRecord> result;
+    if (!m_open) {
+        return result;
+    }
+    flush();
+
+    static const QString columns =
+        "SELECT id, child_profile_id, feature, ai_model, tokens_used, estimated_cost, timestamp,"
+        " duration_seconds, session_id, was_successful, error_message FROM usage_records";
+    QSqlQuery &query = childProfileId.isEmpty()
+        ? statement(columns + " WHERE timestamp BETWEEN ? AND ? ORDER BY timestamp")
+        : statement(columns + " WHERE child_profile_id = ? AND timestamp BETWEEN ? AND ? ORDER BY timestamp");
+    if (!childProfileId.isEmpty()) {
+        query.addBindValue(childProfileId);
+    }
+    query.addBindValue(from.isValid() ? from.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min());
+    query.addBindValue(to.isValid() ? to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max());
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        UsageRecord r;
+        r.id = query.value(0).toString();
+        r.childProfileId = query.value(1).toString();
+        r.feature = query.value(2).toString();
+        r.aiModel = query.value(3).toString();
+        r.tokensUsed = query.value(4).toInt();
+        r.estimatedCost = query.value(5).toDouble();
+        r.timestamp = fromMs(query.value(6));
+        r.durationSeconds = query.value(7).toInt();
+        r.sessionId = query.value(8).toString();
+        r.wasSuccessful = query.value(9).toBool();
+        r.errorMessage = query.value(10).toString();
+        result.append(r);
+    }
+    query.finish();
+    return result;
+}
+
+int DatabaseService::deleteUsageBefore(const QDateTime &cutoff) {
+    if (!m_open) {
+        return 0;
+    }
+    flush();
+
+    QSqlQuery &query = statement("DELETE FROM usage_records WHERE timestamp < ?");
+    query.addBindValue(cutoff.toMSecsSinceEpoch());
+    if (!run(query)) {
+        return 0;
+    }
+    return query.numRowsAffected();
+}
+
+bool DatabaseService::rollUpUsage(const QDateTime &from, const QDateTime &to) {
+    if (!m_open) {
+        return false;
+    }
+    enqueue([this, from, to]() {
+        QSqlQuery &rollUp = statement(
+            "INSERT INTO usage_daily (day, child_profile_id, feature, ai_model, requests,"
+            " tokens_used, estimated_cost, duration_seconds)"
+            " SELECT date(timestamp / 1000, 'unixepoch', 'localtime'), IFNULL(child_profile_id, ''),"
+            " IFNULL(feature, ''), IFNULL(ai_model, ''), COUNT(*), TOTAL(tokens_used),"
+            " TOTAL(estimated_cost), TOTAL(duration_seconds)"
+            " FROM usage_records WHERE timestamp >= ? AND timestamp < ? GROUP BY 1, 2, 3, 4"
+            " ON CONFLICT(day, child_profile_id, feature, ai_model) DO UPDATE SET"
+            " requests = requests + excluded.requests, tokens_used = tokens_used + excluded.tokens_used,"
+            " estimated_cost = estimated_cost + excluded.estimated_cost,"
+            " duration_seconds = duration_seconds + excluded.duration_seconds");
+        rollUp.addBindValue(from.toMSecsSinceEpoch());
+        rollUp.addBindValue(to.toMSecsSinceEpoch());
+        QSqlQuery &remove = statement("DELETE FROM usage_records WHERE timestamp >= ? AND timestamp < ?");
+        remove.addBindValue(from.toMSecsSinceEpoch());
+        remove.addBindValue(to.toMSecsSinceEpoch());
+        return run(rollUp) && run(remove);
+    });
+    // Both statements commit together, so a row is never counted twice or lost
+    return flush();
+}
+
+QDateTime DatabaseService::oldestUsage() {
+    if (!m_open) {
+        return QDateTime();
+    }
+    flush();
+
+    QSqlQuery &query = statement("SELECT MIN(timestamp) FROM usage_records");
+    QDateTime oldest = run(query) && query.next() ? fromMs(query.value(0)) : QDateTime();
+    query.finish();
+    return oldest;
+}
+
+QList<DatabaseService::DailyUsage> DatabaseService::dailyUsage(const QDate &from, const QDate &to,
+                                                               const QString &childProfileId) {
+    QList<DailyUsage> result;
+    if (!m_open) {
+        return result;
+    }
+    flush();
+
+    static const QString columns =
+        "SELECT day, child_profile_id, feature, ai_model, requests, tokens_used, estimated_cost,"
+        " duration_seconds FROM usage_daily WHERE day BETWEEN ? AND ?";
+    QSqlQuery &query = childProfileId.isEmpty()
+        ? statement(columns + " ORDER BY day")
+        : statement(columns + " AND child_profile_id = ? ORDER BY day");
+    query.addBindValue(from.toString(Qt::ISODate));
+    query.addBindValue(to.toString(Qt::ISODate));
+    if (!childProfileId.isEmpty()) {
+        query.addBindValue(childProfileId);
+    }
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        DailyUsage d;
+        d.day = QDate::fromString(query.value(0).toString(), Qt::ISODate);
+        d.childProfileId = query.value(1).toString();
+        d.feature = query.value(2).toString();
+        d.aiModel = query.value(3).toString();
+        d.requests = query.value(4).toInt();
+        d.tokensUsed = query.value(5).toLongLong();
+        d.estimatedCost = query.value(6).toDouble();
+        d.durationSeconds = query.value(7).toLongLong();
+        result.append(d);
+    }
+    query.finish();
+    return result;
+}
+
+int DatabaseService::deleteDailyUsageBefore(const QDate &day) {
+    if (!m_open) {
+        return 0;
+    }
+    flush();
+
+    QSqlQuery &query = statement("DELETE FROM usage_daily WHERE day < ?");
+    query.addBindValue(day.toString(Qt::ISODate));
+    return run(query) ? query.numRowsAffected() : 0;
+}
+
+int DatabaseService::pruneMemories(const QDateTime &idleSince, double keepImportance) {
+    if (!m_open) {
+        return 0;
+    }
+    flush();
+
+    QSqlQuery &query = statement(
+        "DELETE FROM memories WHERE importance < ?"
+        " AND COALESCE(last_accessed_at, created_at, 0) < ?");
+    query.addBindValue(keepImportance);
+    query.addBindValue(idleSince.toMSecsSinceEpoch());
+    return run(query) ? query.numRowsAffected() : 0;
+}
+
+QStringList DatabaseService::archivedConversationIds(const QDateTime &updatedBefore) {
+    QStringList ids;
+    if (!m_open) {
+        return ids;
+    }
+    flush();
+
+    QSqlQuery &query = statement(
+        "SELECT id FROM conversations WHERE is_archived = 1 AND updated_at < ? ORDER BY updated_at");
+    query.addBindValue(updatedBefore.toMSecsSinceEpoch());
+    if (run(query)) {
+        while (query.next()) {
+            ids.append(query.value(0).toString());
+        }
+    }
+    query.finish();
+    return ids;
+}
+
+void DatabaseService::checkpoint() {
+    if (!m_open) {
+        return;
+    }
+    flush();
+
+    // Folds the WAL back into the main file and resets it to zero length,
+    // then lets SQLite refresh planner statistics it thinks are stale
+    exec("PRAGMA wal_checkpoint(TRUNCATE)");
+    exec("PRAGMA optimize");
+}
+
+// Child profiles
+
+void DatabaseService::saveChildProfile(const ChildProfile &profile) {
+    enqueue([this, profile]() {
+        QSqlQuery &query = statement(
+            "INSERT OR REPLACE INTO child_profiles (id, name, age, avatar, created_at, last_played_at,"
+            " total_points, games_played, favorite_game, personality_id, is_active)"
+            " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+        query.addBindValue(profile.id);
+        query.addBindValue(profile.name);
+        query.addBindValue(profile.age);
+        query.addBindValue(profile.avatar);
+        query.addBindValue(toMs(profile.createdAt));
+        query.addBindValue(toMs(profile.lastPlayedAt));
+        query.addBindValue(profile.totalPoints);
+        query.addBindValue(profile.gamesPlayed);
+        query.addBindValue(profile.favoriteGame);
+        query.addBindValue(profile.personalityId);
+        query.addBindValue(profile.isActive);
+        return run(query);
+    });
+}
+
+QList<ChildProfile> DatabaseService::childProfiles() {
+    QList<ChildProfile> result;
+    if (!m_open) {
+        return result;
+    }
+    flush();
+
+    QSqlQuery &query = statement(
+        "SELECT id, name, age, avatar, created_at, last_played_at, total_points, games_played,"
+        " favorite_game, personality_id, is_active FROM child_profiles ORDER BY name");
+    if (!run(query)) {
+        return result;
+    }
+
+    while (query.next()) {
+        ChildProfile p;
+        p.id = query.value(0).toString();
+        p.name = query.value(1).toString();
+        p.age = query.value(2).toInt();
+        p.avatar = query.value(3).toString();
+        p.createdAt = fromMs(query.value(4));
+        p.lastPlayedAt = fromMs(query.value(5));
+        p.totalPoints = query.value(6).toInt();
+        p.gamesPlayed = query.value(7).toInt();
+        p.favoriteGame = query.value(8).toString();
+        p.personalityId = query.value(9).toString();
+        p.isActive = query.value(10).toBool();
+        result.append(p);
+    }
+    query.finish();
+    return result;
+}
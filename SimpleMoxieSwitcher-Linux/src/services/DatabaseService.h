@@ -0,0 +1,142 @@
+#pragma once
+#include <QObject>
+#include <QDate>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QSqlQuery>
+#include <QTimer>
+#include <functional>
+#include <memory>
+#include "../models/Conversation.h"
+#include "../models/Memory.h"
+#include "../models/UsageRecord.h"
+#include "../models/ChildProfile.h"
+
+// Indexed SQLite store for everything the app keeps long term: conversation
+// headers and messages, memories, usage records and child profiles. Runs in
+// WAL mode so reads never wait on the writer. Timestamps are epoch ms
+// integers, and every lookup the UI makes ("usage for a child in a date
+// range", "conversations updated this week") is served by an index.
+//
+// Writes are queued and committed together in one transaction every
+// few milliseconds (or sooner when many pile up), each inside its own
+// savepoint so a failed write leaves nothing half done. Reads commit the
+// queue first, so callers always see their own writes. Statements are prepared once
+// per SQL string and reused.
+//
+// Message text is also indexed for full-text search (SQLite FTS5, Unicode
+// case and accent folding, prefix matching), kept current by triggers in the
+// same transaction that stores the message.
+class DatabaseService : public QObject {
+    Q_OBJECT
+
+public:
+    struct MessageMatch {
+        QString messageId;
+        QString conversationId;
+        QString conversationTitle;
+        QString role;
+        QString snippet;        // matched words wrapped in [ ]
+        QDateTime timestamp;
+        double score = 0.0;     // bm25; lower is better
+    };
+
+    // Usage totals for one local calendar day
+    struct DailyUsage {
+        QDate day;
+        QString childProfileId;
+        QString feature;
+        QString aiModel;
+        int requests = 0;
+        qint64 tokensUsed = 0;
+        double estimatedCost = 0.0;
+        qint64 durationSeconds = 0;
+    };
+
+    // Defaults to moxie.db in the app data directory
+    explicit DatabaseService(const QString &path = QString(), QObject *parent = nullptr);
+    ~DatabaseService() override;
+
+    bool isOpen() const { return m_open; }
+    QString path() const { return m_path; }
+
+    // Conversations
+    void saveConversation(const Conversation &conversation);   // header, plus messages if any
+    void appendMessage(const QString &conversationId, const ChatMessage &message);
+    void removeMessage(const QString &messageId);
+    void clearMessages(const QString &conversationId);
+    void deleteConversation(const QString &conversationId);
+    QList<Conversation> conversationsUpdatedSince(const QDateTime &since,
+                                                  const QString &childProfileId = QString());
+    QList<ChatMessage> messages(const QString &conversationId, int limit = -1, int offset = 0);
+    QStringList archivedConversationIds(const QDateTime &updatedBefore);
+    int messageCount(const QString &conversationId);
+
+    // Every word in text must match (as a prefix); best matches first,
+    // newer messages winning ties
+    QList<MessageMatch> searchMessages(const QString &text, int limit = 50,
+                                       const QString &childProfileId = QString());
+
+    // Memories
+    void saveMemory(const Memory &memory);
+    QList<Memory> memories(const QString &category = QString(), int limit = -1);
+    // Drops memories below keepImportance that nobody has used since idleSince
+    int pruneMemories(const QDateTime &idleSince, double keepImportance);
+
+    // Usage
+    void recordUsage(const UsageRecord &record);
+    QList<UsageRecord> usageRecords(const QDateTime &from, const QDateTime &to,
+                                    const QString &childProfileId = QString());
+    int deleteUsageBefore(const QDateTime &cutoff);
+
+    // Folds raw usage rows in [from, to) into daily totals and deletes them,
+    // in one transaction
+    bool rollUpUsage(const QDateTime &from, const QDateTime &to);
+    QDateTime oldestUsage();
+    QList<DailyUsage> dailyUsage(const QDate &from, const QDate &to,
+                                 const QString &childProfileId = QString());
+    int deleteDailyUsageBefore(const QDate &day);
+
+    // Child profiles
+    void saveChildProfile(const ChildProfile &profile);
+    QList<ChildProfile> childProfiles();
+
+    // Commits queued writes now
+    bool flush();
+
+    // Commits queued writes and closes the connection; later calls do
+    // nothing. Runs on QCoreApplication::aboutToQuit and in the destructor.
+    void close();
+
+    // Runs reads inside one read transaction, so they all see the same
+    // committed state even while another connection writes
+    void readSnapshot(const std::function<void()> &reads);
+
+    // Truncates the write-ahead log and refreshes query planner statistics
+    void checkpoint();
+
+signals:
+    void databaseError(const QString &error);
+
+private:
+    using Write = std::function<bool()>;
+
+    bool openDatabase(const QString &path);
+    bool migrate();
+    bool exec(const QString &sql);
+    QSqlQuery &statement(const QString &sql);
+    bool run(QSqlQuery &query);
+    void enqueue(Write write);
+
+    QString m_connectionName;
+    QString m_path;
+    bool m_open = false;
+    QHash<QString, std::shared_ptr<QSqlQuery>> m_statements;
+    QList<Write> m_pending;
+    QTimer *m_flushTimer;
+
+    int m_flushDelayMs = 50;
+    int m_maxPendingWrites = 500;
+};
@@ -0,0 +1,396 @@
+#include "GameContentService.h"
+#include "AIProviderService.h"
+#include "StorageService.h"
+#include "../utils/DIContainer.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+const QString ContentFile = QStringLiteral("game_content.json");
+constexpr int SaveDelayMs = 2000;
+constexpr int RetryDelayMs = 60000;
+constexpr int MaxRetryDelayMs = 30 * 60000;
+constexpr int PrimeDelayMs = 10000;
+constexpr int MaxSeenKeys = 500;
+constexpr int AvoidExamples = 15;
+
+QString audienceFor(Difficulty difficulty) {
+    switch (difficulty) {
+        case Difficulty::Easy: return "children aged 5 to 7";
+        case Difficulty::Medium: return "children aged 8 to 10";
+        case Difficulty::Hard: return "children aged 11 to 13";
+    }
+    return "children";
+}
+
+QString formatFor(GameType type) {
+    switch (type) {
+        case GameType::SpellingBee:
+            return "{\"word\": \"...\", \"definition\": \"...\", "
+                   "\"audioHint\": \"a short sentence using the word\"}";
+        case GameType::MovieLines:
+            return "{\"movieLine\": \"a famous line from a family movie\", \"correctMovie\": \"...\", "
+                   "\"options\": [\"four movie titles including the correct one\"]}";
+        case GameType::VideoGames:
+            return "{\"clue\": \"...\", \"correctGame\": \"...\", \"franchise\": \"...\", "
+                   "\"options\": [\"four game titles including the correct one\"]}";
+        case GameType::Trivia:
+        case GameType::KnowledgeQuest:
+            break;
+    }
+    return "{\"question\": \"...\", \"options\": [\"four answers\"], "
+           "\"correctAnswer\": 0, \"category\": \"...\"}";
+}
+
+QString topicFor(GameType type) {
+    switch (type) {
+        case GameType::Trivia: return "fun general-knowledge trivia questions";
+        case GameType::SpellingBee: return "spelling bee words";
+        case GameType::MovieLines: return "guess-the-movie challenges from kid-friendly films";
+        case GameType::VideoGames: return "guess-the-video-game challenges from family-friendly games";
+        case GameType::KnowledgeQuest: return "school-subject questions on science, maths, history and geography";
+    }
+    return "quiz questions";
+}
+
+} // namespace
+
+GameContentService::GameContentService(AIProviderService *aiService, QObject *parent)
+    : QObject(parent)
+    , m_aiService(aiService)
+    , m_storage(DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this))
+    , m_saveTimer(new QTimer(this))
+    , m_retryTimer(new QTimer(this))
+    , m_retryDelayMs(RetryDelayMs) {
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(SaveDelayMs);
+    connect(m_saveTimer, &QTimer::timeout, this, &GameContentService::save);
+
+    // Failed batches are retried together rather than hammering a provider
+    // that is down, waiting twice as long after each failed round
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, &QTimer::timeout, this, &GameContentService::retryRefills);
+
+    // Without a usable provider refills wait for the configuration to change
+    if (m_aiService) {
+        connect(m_aiService, &AIProviderService::currentProviderChanged, this, &GameContentService::resumeRefills);
+        connect(m_aiService, &AIProviderService::routingChanged, this, &GameContentService::resumeRefills);
+        connect(m_aiService, &AIProviderService::apiKeyChanged, this, &GameContentService::resumeRefills);
+    }
+
+    load();
+
+    // Leave the first seconds after launch to the interactive warm-up
+    QTimer::singleShot(PrimeDelayMs, this, &GameContentService::prime);
+}
+
+GameContentService::~GameContentService() {
+    if (m_saveTimer->isActive()) {
+        save();
+    }
+}
+
+int GameContentService::bufferKey(GameType type, Difficulty difficulty) {
+    return static_cast<int>(type) * 16 + static_cast<int>(difficulty);
+}
+
+GameContentService::Buffer &GameContentService::buffer(GameType type, Difficulty difficulty) {
+    Buffer &b = m_buffers[bufferKey(type, difficulty)];
+    b.type = type;
+    b.difficulty = difficulty;
+    return b;
+}
+
+int GameContentService::available(GameType type, Difficulty difficulty) const {
+    auto it = m_buffers.constFind(bufferKey(type, difficulty));
+    return it == m_buffers.cend() ? 0 : it->items.size();
+}
+
+QList<QJsonObject> GameContentService::take(GameType type, Difficulty difficulty, int count) {
+    Buffer &b = buffer(type, difficulty);
+    QList<QJsonObject> taken = b.items.mid(0, count);
+    b.items.remove(0, taken.size());
+
+    if (!taken.isEmpty()) {
+        emit bufferChanged(static_cast<int>(type), static_cast<int>(difficulty), b.items.size());
+        scheduleSave();
+    }
+
+    if (b.items.size() < m_lowWatermark) {
+        b.target = m_highWatermark;
+        requestRefill(bufferKey(type, difficulty));
+    }
+    return taken;
+}
+
+void GameContentService::prime() {
+    for (int t = static_cast<int>(GameType::Trivia); t <= static_cast<int>(GameType::KnowledgeQuest); ++t) {
+        for (int d = static_cast<int>(Difficulty::Easy); d <= static_cast<int>(Difficulty::Hard); ++d) {
+            Buffer &b = buffer(static_cast<GameType>(t), static_cast<Difficulty>(d));
+            if (b.items.isEmpty()) {
+                b.target = qMax(b.target, m_batchSize);
+                requestRefill(bufferKey(b.type, b.difficulty));
+            }
+        }
+    }
+}
+
+void GameContentService::setWatermarks(int low, int high) {
+    m_lowWatermark = qMax(1, low);
+    m_highWatermark = qMax(m_lowWatermark, high);
+}
+
+void GameContentService::setBatchSize(int size) {
+    m_batchSize = qBound(1, size, 25);
+}
+
+void GameContentService::requestRefill(int key) {
+    if (!m_refillQueue.contains(key)) {
+        m_refillQueue.append(key);
+    }
+    pumpRefills();
+}
+
+void GameContentService::scheduleRetry() {
+    if (m_retryTimer->isActive()) {
+        return;
+    }
+    m_retryTimer->start(m_retryDelayMs);
+    m_retryDelayMs = qMin(m_retryDelayMs * 2, MaxRetryDelayMs);
+}
+
+void GameContentService::retryRefills() {
+    for (auto it = m_buffers.cbegin(); it != m_buffers.cend(); ++it) {
+        if (it->items.size() < it->target) {
+            requestRefill(it.key());
+        }
+    }
+}
+
+void GameContentService::resumeRefills() {
+    m_retryTimer->stop();
+    m_retryDelayMs = RetryDelayMs;
+    retryRefills();
+}
+
+void GameContentService::pumpRefills() {
+    // Queued keys wait out a backoff, or a provider being configured
+    if (!m_aiService || m_retryTimer->isActive() || !m_aiService->hasUsableProvider()) {
+        return;
+    }
+
+    // Keep only a couple of batches in flight so games never crowd the
+    // background lane that memory extraction also uses
+    while (m_activeBatches < m_maxConcurrentBatches && !m_refillQueue.isEmpty()) {
+        int key = m_refillQueue.takeFirst();
+        Buffer &b = m_buffers[key];
+        int projected = b.items.size() + b.inFlight * m_batchSize;
+        if (projected >= b.target) {
+            continue;
+        }
+
+        b.inFlight++;
+        m_activeBatches++;
+        // Sampled hot and so never cached: a replayed batch would be all duplicates
+        QPointer<GameContentService> self(this);
+        m_aiService->sendRequest(batchPrompt(b, m_batchSize), QString(), 0.9,
+                                 AIProviderService::Background,
+                                 [self, key](const QString &response, const QString &error) {
+            if (self) {
+                self->handleBatch(key, response, error);
+            }
+        });
+
+        // Larger gaps need more than one batch; queue the rest behind others
+        if (projected + m_batchSize < b.target) {
+            m_refillQueue.append(key);
+        }
+    }
+}
+
+void GameContentService::handleBatch(int key, const QString &response, const QString &error) {
+    Buffer &b = m_buffers[key];
+    b.inFlight = qMax(0, b.inFlight - 1);
+    m_activeBatches = qMax(0, m_activeBatches - 1);
+
+    if (!error.isEmpty()) {
+        qWarning() << "Game content batch failed for" << gameTypeToString(b.type)
+                   << difficultyToString(b.difficulty) << ":" << error;
+        scheduleRetry();
+        return;
+    }
+
+    // Models like to wrap the array in prose or code fences
+    int start = response.indexOf('[');
+    int end = response.lastIndexOf(']');
+    QJsonArray array;
+    if (start >= 0 && end > start) {
+        array = QJsonDocument::fromJson(response.mid(start, end - start + 1).toUtf8()).array();
+    }
+
+    int added = 0;
+    for (const auto &value : array) {
+        QJsonObject item = normalizeItem(b.type, b.difficulty, value.toObject());
+        if (item.isEmpty()) {
+            continue;
+        }
+        QString dedup = itemKey(b.type, item);
+        if (b.seen.contains(dedup)) {
+            continue;
+        }
+        b.seen.insert(dedup);
+        b.items.append(item);
+        added++;
+    }
+
+    if (b.seen.size() > MaxSeenKeys) {
+        b.seen.clear();
+        for (const auto &item : std::as_const(b.items)) {
+            b.seen.insert(itemKey(b.type, item));
+        }
+    }
+
+    if (added > 0) {
+        m_retryDelayMs = RetryDelayMs;
+        emit bufferChanged(static_cast<int>(b.type), static_cast<int>(b.difficulty), b.items.size());
+        scheduleSave();
+        if (b.items.size() < b.target) {
+            requestRefill(key);
+        }
+    } else {
+        qWarning() << "Game content batch for" << gameTypeToString(b.type)
+                   << "produced no usable items";
+        scheduleRetry();
+    }
+    pumpRefills();
+}
+
+QString GameContentService::batchPrompt(const Buffer &buffer, int count) const {
+    QString prompt = QString("Create %1 %2 for %3. "
+                             "Keep everything kind, safe and age-appropriate. "
+                             "Reply with only a JSON array, no other text, where each element looks like:\n%4\n")
+                         .arg(count)
+                         .arg(topicFor(buffer.type), audienceFor(buffer.difficulty), formatFor(buffer.type));
+
+    if (!buffer.items.isEmpty()) {
+        QStringList avoid;
+        for (int i = qMax(0, buffer.items.size() - AvoidExamples); i < buffer.items.size(); ++i) {
+            avoid.append("- " + itemKey(buffer.type, buffer.items[i]));
+        }
+        prompt += "Do not repeat any of these:\n" + avoid.join('\n') + "\n";
+    }
+    return prompt;
+}
+
+QString GameContentService::itemKey(GameType type, const QJsonObject &item) {
+    QString text;
+    switch (type) {
+        case GameType::SpellingBee: text = item["word"].toString(); break;
+        case GameType::MovieLines: text = item["movieLine"].toString(); break;
+        case GameType::VideoGames: text = item["clue"].toString(); break;
+        case GameType::Trivia:
+        case GameType::KnowledgeQuest: text = item["question"].toString(); break;
+    }
+    return text.simplified().toLower();
+}
+
+QJsonObject GameContentService::normalizeItem(GameType type, Difficulty difficulty, const QJsonObject &item) {
+    QJsonObject json = item;
+    json["difficulty"] = difficultyToString(difficulty);
+    json["points"] = pointsForDifficulty(difficulty);
+
+    switch (type) {
+        case GameType::SpellingBee: {
+            SpellingWord word = SpellingWord::fromJson(json);
+            return word.isValid() ? word.toJson() : QJsonObject();
+        }
+        case GameType::MovieLines: {
+            MovieLineChallenge challenge = MovieLineChallenge::fromJson(json);
+            if (!challenge.isValid()) {
+                return QJsonObject();
+            }
+            std::shuffle(challenge.options.begin(), challenge.options.end(), *QRandomGenerator::global());
+            return challenge.toJson();
+        }
+        case GameType::VideoGames: {
+            VideoGameChallenge challenge = VideoGameChallenge::fromJson(json);
+            if (!challenge.isValid()) {
+                return QJsonObject();
+            }
+            std::shuffle(challenge.options.begin(), challenge.options.end(), *QRandomGenerator::global());
+            return challenge.toJson();
+        }
+        case GameType::Trivia:
+        case GameType::KnowledgeQuest:
+            break;
+    }
+
+    TriviaQuestion question = TriviaQuestion::fromJson(json);
+    if (!question.isValid()) {
+        return QJsonObject();
+    }
+    // Models tend to put the right answer first
+    QString correct = question.options[question.correctAnswer];
+    std::shuffle(question.options.begin(), question.options.end(), *QRandomGenerator::global());
+    question.correctAnswer = question.options.indexOf(correct);
+    return question.toJson();
+}
+
+void GameContentService::scheduleSave() {
+    if (!m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+}
+
+void GameContentService::save() {
+    m_saveTimer->stop();
+
+    QJsonArray buffers;
+    for (const auto &b : std::as_const(m_buffers)) {
+        if (b.items.isEmpty()) {
+            continue;
+        }
+        QJsonArray items;
+        for (const auto &item : b.items) {
+            items.append(item);
+        }
+        QJsonObject entry;
+        entry["gameType"] = gameTypeToString(b.type);
+        entry["difficulty"] = difficultyToString(b.difficulty);
+        entry["items"] = items;
+        buffers.append(entry);
+    }
+
+    QJsonObject root;
+    root["version"] = 1;
+    root["buffers"] = buffers;
+    m_storage->saveJsonAsync(ContentFile, root);
+}
+
+void GameContentService::load() {
+    // Read off the GUI thread; batches that land first are merged, not replaced
+    m_storage->loadJsonAsync(ContentFile).then(this, [this](const QJsonObject &root) {
+        for (const auto &value : root["buffers"].toArray()) {
+            QJsonObject entry = value.toObject();
+            Buffer &b = buffer(gameTypeFromString(entry["gameType"].toString()),
+                               difficultyFromString(entry["difficulty"].toString()));
+            int before = b.items.size();
+            for (const auto &item : entry["items"].toArray()) {
+                QJsonObject obj = item.toObject();
+                QString dedup = itemKey(b.type, obj);
+                if (!obj.isEmpty() && !b.seen.contains(dedup)) {
+                    b.seen.insert(dedup);
+                    b.items.append(obj);
+                }
+            }
+            if (b.items.size() != before) {
+                emit bufferChanged(static_cast<int>(b.type), static_cast<int>(b.difficulty), b.items.size());
+            }
+        }
+    });
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QJsonObject>
+#include <QTimer>
+#include "../models/Games.h"
+
+class AIProviderService;
+
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
+
+// Keeps a buffer of ready-to-play questions per game type and difficulty so a
+// game can start without waiting on the model. Buffers are refilled in the
+// background, several items per prompt, through the Background priority lane
+// of AIProviderService, and persisted so content survives restarts.
+class GameContentService : public QObject {
+    Q_OBJECT
+
+public:
+    explicit GameContentService(AIProviderService *aiService, QObject *parent = nullptr);
+    ~GameContentService() override;
+
+    int available(GameType type, Difficulty difficulty) const;
+
+    // Removes up to count items (in the Games.h toJson format) and tops the
+    // buffer back up if it drops below the low watermark
+    QList<QJsonObject> take(GameType type, Difficulty difficulty, int count);
+
+    // Starts one batch for every empty buffer
+    void prime();
+
+    // Refill starts below the low watermark and stops at the high watermark
+    int lowWatermark() const { return m_lowWatermark; }
+    int highWatermark() const { return m_highWatermark; }
+    void setWatermarks(int low, int high);
+
+    // Items requested per prompt
+    int batchSize() const { return m_batchSize; }
+    void setBatchSize(int size);
+
+signals:
+    void bufferChanged(int gameType, int difficulty, int available);
+
+private:
+    struct Buffer {
+        GameType type = GameType::Trivia;
+        Difficulty difficulty = Difficulty::Easy;
+        QList<QJsonObject> items;
+        QSet<QString> seen;     // dedup keys of everything generated recently
+        int target = 0;         // fill level the current refill is working towards
+        int inFlight = 0;       // batches sent but not yet answered
+    };
+
+    static int bufferKey(GameType type, Difficulty difficulty);
+    static QString itemKey(GameType type, const QJsonObject &item);
+    static QJsonObject normalizeItem(GameType type, Difficulty difficulty, const QJsonObject &item);
+
+    Buffer &buffer(GameType type, Difficulty difficulty);
+    void requestRefill(int key);
+    void pumpRefills();
+    void scheduleRetry();
+    void retryRefills();
+    void resumeRefills();
+    void handleBatch(int key, const QString &response, const QString &error);
+    QString batchPrompt(const Buffer &buffer, int count) const;
+
+    void scheduleSave();
+    void save();
+    void load();
+
+    AIProviderService *m_aiService;
+    SimpleMoxieSwitcher::StorageService *m_storage;
+    QHash<int, Buffer> m_buffers;
+    QList<int> m_refillQueue;
+    int m_activeBatches = 0;
+    QTimer *m_saveTimer;
+    QTimer *m_retryTimer;
+    int m_retryDelayMs;     // doubles per failed round, reset on success
+
+    int m_lowWatermark = 10;
+    int m_highWatermark = 30;
+    int m_batchSize = 10;
+    int m_maxConcurrentBatches = 2;
+};
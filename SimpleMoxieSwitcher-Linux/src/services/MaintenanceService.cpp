@@ -0,0 +1,177 @@
+#include "MaintenanceService.h"
+#include "AIProviderService.h"
+#include "ChatHistory.h"
+#include "ConversationJournal.h"
+#include "DatabaseService.h"
+#include "StorageService.h"
+#include "../utils/DIContainer.h"
+#include <QDir>
+#include <QFileInfo>
+
+MaintenanceService::MaintenanceService(DatabaseService *database, AIProviderService *aiService, QObject *parent)
+    : QObject(parent)
+    , m_database(database)
+    , m_aiService(aiService)
+    , m_storage(DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this))
+    , m_stepTimer(new QTimer(this))
+    , m_passTimer(new QTimer(this)) {
+    m_conversationsDirectory = m_storage->dataPath() + "/conversations";
+
+    m_stepTimer->setSingleShot(true);
+    connect(m_stepTimer, &QTimer::timeout, this, &MaintenanceService::step);
+
+    m_passTimer->setInterval(m_passIntervalMs);
+    connect(m_passTimer, &QTimer::timeout, this, &MaintenanceService::runNow);
+    m_passTimer->start();
+
+    // Leave startup to the UI
+    QTimer::singleShot(m_startDelayMs, this, &MaintenanceService::runNow);
+}
+
+void MaintenanceService::runNow() {
+    if (isRunning() || !m_database) {
+        return;
+    }
+    m_usageCutoff = QDate::currentDate().addDays(-m_policy.usageRawDays).startOfDay();
+    m_stepIntervalMs = m_minStepIntervalMs;
+    advance(Task::RollUpUsage);
+    scheduleStep();
+}
+
+void MaintenanceService::setPaused(bool paused) {
+    m_paused = paused;
+    if (!m_paused && isRunning()) {
+        scheduleStep();
+    }
+}
+
+void MaintenanceService::scheduleStep() {
+    if (!m_paused) {
+        m_stepTimer->start(m_stepIntervalMs);
+    }
+}
+
+void MaintenanceService::advance(Task next) {
+    m_task = next;
+    m_workList.clear();
+
+    if (next == Task::ArchiveConversations) {
+        m_workList = m_database->archivedConversationIds(
+            QDateTime::currentDateTime().addDays(-m_policy.archiveIdleDays));
+    } else if (next == Task::CompactJournals) {
+        const QFileInfoList journals = QDir(m_conversationsDirectory).entryInfoList({"*.journal"}, QDir::Files);
+        for (const QFileInfo &info : journals) {
+            if (info.size() >= m_policy.journalCompactBytes) {
+                m_workList.append(info.completeBaseName());
+            }
+        }
+    }
+}
+
+void MaintenanceService::step() {
+    if (m_paused || m_task == Task::Idle) {
+        return;
+    }
+
+    // Someone is waiting on a reply; stay out of the way
+    if (m_aiService && m_aiService->isProcessing()) {
+        m_stepTimer->start(m_maxStepIntervalMs);
+        return;
+    }
+
+    m_stepClock.start();
+    switch (m_task) {
+    case Task::RollUpUsage:
+        if (!rollUpNextUsageDay()) {
+            advance(Task::PruneDailyUsage);
+        }
+        break;
+    case Task::PruneDailyUsage:
+        m_database->deleteDailyUsageBefore(QDate::currentDate().addDays(-m_policy.usageDailyDays));
+        advance(Task::PruneMemories);
+        break;
+    case Task::PruneMemories:
+        m_database->pruneMemories(QDateTime::currentDateTime().addDays(-m_policy.memoryIdleDays),
+                                  m_policy.memoryKeepImportance);
+        advance(Task::ArchiveConversations);
+        break;
+    case Task::ArchiveConversations:
+        if (!archiveNextConversation()) {
+            advance(Task::CompactJournals);
+        }
+        break;
+    case Task::CompactJournals:
+        if (!compactNextJournal()) {
+            advance(Task::Checkpoint);
+        }
+        break;
+    case Task::Checkpoint:
+        m_database->checkpoint();
+        m_task = Task::Idle;
+        emit passFinished();
+        return;
+    case Task::Idle:
+        return;
+    }
+
+    // Back off after a slow unit so maintenance never turns into a stall
+    if (m_stepClock.elapsed() > m_stepBudgetMs) {
+        m_stepIntervalMs = qMin(m_maxStepIntervalMs, m_stepIntervalMs * 2);
+    } else {
+        m_stepIntervalMs = qMax(m_minStepIntervalMs, m_stepIntervalMs / 2);
+    }
+    scheduleStep();
+}
+
+bool MaintenanceService::rollUpNextUsageDay() {
+    // Oldest first, one calendar day per tick
+    QDateTime oldest = m_database->oldestUsage();
+    if (!oldest.isValid() || oldest >= m_usageCutoff) {
+        return false;
+    }
+    QDateTime from = oldest.date().startOfDay();
+    QDateTime to = qMin(oldest.date().addDays(1).startOfDay(), m_usageCutoff);
+    if (!m_database->rollUpUsage(from, to)) {
+        return false;
+    }
+    emit usageRolledUp(to);
+    return true;
+}
+
+bool MaintenanceService::archiveNextConversation() {
+    const QString active = activeConversationId();
+    while (!m_workList.isEmpty()) {
+        const QString id = m_workList.takeFirst();
+        if (id == active) {
+            continue;
+        }
+        // Already archived ones have no loose files and are skipped cheaply
+        ConversationJournal journal(m_conversationsDirectory);
+        if (journal.archive(id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MaintenanceService::compactNextJournal() {
+    const QString active = activeConversationId();
+    while (!m_workList.isEmpty()) {
+        const QString id = m_workList.takeFirst();
+        if (id == active) {
+            continue;   // the chat view compacts its own journal
+        }
+        ConversationJournal journal(m_conversationsDirectory);
+        Conversation header;
+        ChatHistory history;
+        if (journal.load(id, &header, &history)) {
+            journal.compact();
+            return true;
+        }
+    }
+    return false;
+}
+
+QString MaintenanceService::activeConversationId() const {
+    return m_storage->loadSetting("chat/lastConversationId").toString();
+}
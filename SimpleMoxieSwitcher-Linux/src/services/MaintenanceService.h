@@ -0,0 +1,96 @@
+#pragma once
+#include <QObject>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTimer>
+
+class AIProviderService;
+class DatabaseService;
+
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
+
+// Enforces retention for stored data in the background. A pass rolls usage
+// rows older than the raw window into daily totals, drops expired daily
+// totals and stale low-importance memories, moves archived conversations into
+// compressed segments, compacts oversized journals and finally checkpoints
+// the database. It runs a little after startup and then every few hours.
+//
+// Work is done one small unit per tick (a day of usage, one conversation) so
+// the GUI thread is never held for long. Ticks back off when a unit ran long
+// and wait while the AI service is busy with a request.
+class MaintenanceService : public QObject {
+    Q_OBJECT
+
+public:
+    struct RetentionPolicy {
+        int usageRawDays = 90;              // older rows survive only as daily totals
+        int usageDailyDays = 730;
+        int memoryIdleDays = 365;           // unused this long and below keepImportance: dropped
+        double memoryKeepImportance = 0.7;
+        int archiveIdleDays = 30;           // archived conversations untouched this long
+        qint64 journalCompactBytes = 256 * 1024;
+    };
+
+    explicit MaintenanceService(DatabaseService *database, AIProviderService *aiService = nullptr,
+                                QObject *parent = nullptr);
+
+    RetentionPolicy policy() const { return m_policy; }
+    void setPolicy(const RetentionPolicy &policy) { m_policy = policy; }
+
+    // Starts a pass now unless one is already running
+    void runNow();
+    bool isRunning() const { return m_task != Task::Idle; }
+
+    void setPaused(bool paused);
+
+signals:
+    // Raw usage rows before this point now exist only as daily totals
+    void usageRolledUp(const QDateTime &before);
+    void passFinished();
+
+private:
+    enum class Task {
+        Idle,
+        RollUpUsage,
+        PruneDailyUsage,
+        PruneMemories,
+        ArchiveConversations,
+        CompactJournals,
+        Checkpoint
+    };
+
+    void step();
+    void scheduleStep();
+    void advance(Task next);
+
+    bool rollUpNextUsageDay();
+    bool archiveNextConversation();
+    bool compactNextJournal();
+
+    QString activeConversationId() const;
+
+    DatabaseService *m_database;
+    AIProviderService *m_aiService;
+    SimpleMoxieSwitcher::StorageService *m_storage;
+    QString m_conversationsDirectory;
+    RetentionPolicy m_policy;
+
+    Task m_task = Task::Idle;
+    QStringList m_workList;         // conversation ids left for the current task
+    QDateTime m_usageCutoff;
+    bool m_paused = false;
+
+    QTimer *m_stepTimer;
+    QTimer *m_passTimer;
+    QElapsedTimer m_stepClock;
+
+    int m_stepIntervalMs = 250;
+    int m_minStepIntervalMs = 250;
+    int m_maxStepIntervalMs = 5000;
+    int m_stepBudgetMs = 30;
+    int m_startDelayMs = 2 * 60 * 1000;
+    int m_passIntervalMs = 6 * 60 * 60 * 1000;
+};
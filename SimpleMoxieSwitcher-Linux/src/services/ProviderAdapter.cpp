@@ -0,0 +1,451 @@
+#include "ProviderAdapter.h"
+#include "../utils/JsonFieldExtractor.h"
+#include <QJsonArray>
+#include <QUrlQuery>
+
+namespace {
+
+// Only the fields the service reads are decoded from provider replies; the
+// rest of each payload is skipped without building a QJsonDocument
+enum OpenAIField {
+    OpenAIError, OpenAIErrorMessage, OpenAIContent, OpenAIDelta,
+    OpenAIPromptTokens, OpenAICompletionTokens, GroqPromptTokens, GroqCompletionTokens
+};
+
+const JsonFieldExtractor &openAIFields() {
+    static const JsonFieldExtractor extractor({
+        "error", "error.message", "choices.0.message.content", "choices.0.delta.content",
+        "usage.prompt_tokens", "usage.completion_tokens",
+        "x_groq.usage.prompt_tokens", "x_groq.usage.completion_tokens"
+    });
+    return extractor;
+}
+
+enum AnthropicField {
+    AnthropicType, AnthropicError, AnthropicErrorMessage, AnthropicContent, AnthropicDelta,
+    AnthropicInputTokens, AnthropicOutputTokens, AnthropicStartInputTokens
+};
+
+const JsonFieldExtractor &anthropicFields() {
+    static const JsonFieldExtractor extractor({
+        "type", "error", "error.message", "content.0.text", "delta.text",
+        "usage.input_tokens", "usage.output_tokens", "message.usage.input_tokens"
+    });
+    return extractor;
+}
+
+enum GeminiField {
+    GeminiError, GeminiErrorMessage, GeminiFirstPart, GeminiAllParts,
+    GeminiPromptTokens, GeminiCandidateTokens
+};
+
+const JsonFieldExtractor &geminiFields() {
+    static const JsonFieldExtractor extractor({
+        "error", "error.message",
+        "candidates.0.content.parts.0.text", "candidates.0.content.parts.*.text",
+        "usageMetadata.promptTokenCount", "usageMetadata.candidatesTokenCount"
+    });
+    return extractor;
+}
+
+enum OllamaField {
+    OllamaError, OllamaContent, OllamaDone, OllamaPromptTokens, OllamaEvalTokens
+};
+
+const JsonFieldExtractor &ollamaFields() {
+    static const JsonFieldExtractor extractor({
+        "error", "message.content", "done", "prompt_eval_count", "eval_count"
+    });
+    return extractor;
+}
+
+QJsonArray toArray(const QList<QJsonObject> &messages) {
+    QJsonArray array;
+    for (const auto &msg : messages) {
+        array.append(msg);
+    }
+    return array;
+}
+
+} // namespace
+
+std::unique_ptr<ProviderAdapter> ProviderAdapter::create(const QString &name) {
+    if (name == "OpenAI") {
+        return std::make_unique<OpenAICompatibleAdapter>(
+            name, QUrl("https://api.openai.com"), "/v1/chat/completions", "gpt-4o",
+            QStringList{"gpt-4o", "gpt-4-turbo", "gpt-4", "gpt-3.5-turbo"},
+            "Industry standard. Pay-as-you-go. Get key at https://platform.openai.com/api-keys");
+    } else if (name == "DeepSeek") {
+        return std::make_unique<OpenAICompatibleAdapter>(
+            name, QUrl("https://api.deepseek.com"), "/v1/chat/completions", "deepseek-chat",
+            QStringList{"deepseek-chat", "deepseek-coder", "deepseek-reasoner"},
+            "Very affordable pricing. Get key at https://platform.deepseek.com");
+    } else if (name == "GroqCloud") {
+        return std::make_unique<OpenAICompatibleAdapter>(
+            name, QUrl("https://api.groq.com"), "/openai/v1/chat/completions", "llama-3.3-70b-versatile",
+            QStringList{"llama-3.3-70b-versatile", "llama-3.1-8b-instant", "mixtral-8x7b-32768", "gemma2-9b-it"},
+            "FREE tier: 14,400 requests/day. Ultra-fast inference. Get key at https://console.groq.com");
+    } else if (name == "Anthropic") {
+        return std::make_unique<AnthropicAdapter>();
+    } else if (name == "Gemini") {
+        return std::make_unique<GeminiAdapter>();
+    } else if (name == "Ollama") {
+        return std::make_unique<OllamaAdapter>();
+    }
+    return nullptr;
+}
+
+ProviderAdapter::ProviderAdapter(const QString &name, const QUrl &origin, const QString &defaultModel,
+                                 const QStringList &models, const QString &info)
+    : m_name(name)
+    , m_origin(origin)
+    , m_defaultModel(defaultModel)
+    , m_models(models)
+    , m_info(info) {
+}
+
+void ProviderAdapter::setApiKey(const QString &key) {
+    if (m_apiKey != key) {
+        m_apiKey = key;
+        rebuildTemplate();
+    }
+}
+
+QNetworkRequest ProviderAdapter::request(const QString &model, bool stream) const {
+    Q_UNUSED(model);
+    Q_UNUSED(stream);
+    return m_template;
+}
+
+void ProviderAdapter::rebuildTemplate() {
+    m_template = QNetworkRequest(m_origin);
+    m_template.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    // Multiplex onto the warmed connection where the endpoint speaks HTTP/2
+    if (m_origin.scheme() == "https") {
+        m_template.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    }
+}
+
+// OpenAI-compatible
+
+OpenAICompatibleAdapter::OpenAICompatibleAdapter(const QString &name, const QUrl &origin, const QString &path,
+                                                 const QString &defaultModel, const QStringList &models,
+                                                 const QString &info)
+    : ProviderAdapter(name, origin, defaultModel, models, info)
+    , m_path(path) {
+    rebuildTemplate();
+}
+
+void OpenAICompatibleAdapter::rebuildTemplate() {
+    ProviderAdapter::rebuildTemplate();
+    QUrl url = m_origin;
+    url.setPath(m_path);
+    m_template.setUrl(url);
+    m_template.setRawHeader("Authorization", QString("Bearer %1").arg(m_apiKey).toUtf8());
+}
+
+QJsonObject OpenAICompatibleAdapter::body(const QList<QJsonObject> &messages, const QString &model,
+                                          double temperature, bool stream) const {
+    QJsonObject json;
+    json["model"] = model;
+    json["messages"] = toArray(messages);
+    json["temperature"] = temperature;
+    if (stream) {
+        json["stream"] = true;
+        json["stream_options"] = QJsonObject{{"include_usage", true}};
+    }
+    return json;
+}
+
+void OpenAICompatibleAdapter::parseResponse(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!openAIFields().extract(data, &f)) {
+        result.error = "Invalid response format";
+        return;
+    }
+
+    if (f[OpenAIError].found) {
+        result.error = "API Error: " + f[OpenAIErrorMessage].text;
+        return;
+    }
+
+    result.text = f[OpenAIContent].text;
+    result.inputTokens = f[OpenAIPromptTokens].toInt();
+    result.outputTokens = f[OpenAICompletionTokens].toInt();
+}
+
+QString OpenAICompatibleAdapter::parseStreamFrame(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!openAIFields().extract(data, &f)) {
+        return QString();
+    }
+    if (f[OpenAIError].found) {
+        result.error = "API Error: " + f[OpenAIErrorMessage].text;
+        return QString();
+    }
+
+    // Groq reports usage under x_groq on the final chunk
+    if (f[OpenAIPromptTokens].found || f[OpenAICompletionTokens].found) {
+        result.inputTokens = f[OpenAIPromptTokens].toInt();
+        result.outputTokens = f[OpenAICompletionTokens].toInt();
+    } else if (f[GroqPromptTokens].found || f[GroqCompletionTokens].found) {
+        result.inputTokens = f[GroqPromptTokens].toInt();
+        result.outputTokens = f[GroqCompletionTokens].toInt();
+    }
+    return f[OpenAIDelta].text;
+}
+
+// Anthropic
+
+AnthropicAdapter::AnthropicAdapter()
+    : ProviderAdapter("Anthropic", QUrl("https://api.anthropic.com"), "claude-3-5-sonnet-20241022",
+                      {"claude-3-5-sonnet-20241022", "claude-3-opus-20240229", "claude-3-sonnet-20240229",
+                       "claude-3-haiku-20240307"},
+                      "Claude models. Pay-as-you-go. Get key at https://console.anthropic.com") {
+    rebuildTemplate();
+}
+
+void AnthropicAdapter::rebuildTemplate() {
+    ProviderAdapter::rebuildTemplate();
+    QUrl url = m_origin;
+    url.setPath("/v1/messages");
+    m_template.setUrl(url);
+    m_template.setRawHeader("x-api-key", m_apiKey.toUtf8());
+    m_template.setRawHeader("anthropic-version", "2023-06-01");
+}
+
+QJsonObject AnthropicAdapter::body(const QList<QJsonObject> &messages, const QString &model,
+                                   double temperature, bool stream) const {
+    // Anthropic takes system prompts as a top-level field, not as messages
+    QStringList systemParts;
+    QJsonArray conversation;
+    for (const auto &msg : messages) {
+        if (msg["role"].toString() == "system") {
+            systemParts.append(msg["content"].toString());
+        } else {
+            conversation.append(msg);
+        }
+    }
+
+    QJsonObject json;
+    json["model"] = model;
+    json["messages"] = conversation;
+    if (!systemParts.isEmpty()) {
+        json["system"] = systemParts.join("\n\n");
+    }
+    json["max_tokens"] = 4096;
+    json["temperature"] = temperature;
+    if (stream) {
+        json["stream"] = true;
+    }
+    return json;
+}
+
+void AnthropicAdapter::parseResponse(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!anthropicFields().extract(data, &f)) {
+        result.error = "Invalid response format";
+        return;
+    }
+
+    if (f[AnthropicError].found) {
+        result.error = "API Error: " + f[AnthropicErrorMessage].text;
+        return;
+    }
+
+    result.text = f[AnthropicContent].text;
+    result.inputTokens = f[AnthropicInputTokens].toInt();
+    result.outputTokens = f[AnthropicOutputTokens].toInt();
+}
+
+QString AnthropicAdapter::parseStreamFrame(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!anthropicFields().extract(data, &f)) {
+        return QString();
+    }
+
+    const QString &type = f[AnthropicType].text;
+    if (type == "content_block_delta") {
+        return f[AnthropicDelta].text;
+    } else if (type == "message_start") {
+        result.inputTokens = f[AnthropicStartInputTokens].toInt();
+    } else if (type == "message_delta") {
+        result.outputTokens = f[AnthropicOutputTokens].toInt();
+    } else if (type == "error") {
+        result.error = "API Error: " + f[AnthropicErrorMessage].text;
+    }
+    return QString();
+}
+
+// Gemini
+
+GeminiAdapter::GeminiAdapter()
+    : ProviderAdapter("Gemini", QUrl("https://generativelanguage.googleapis.com"), "gemini-1.5-flash",
+                      {"gemini-2.0-flash-exp", "gemini-1.5-pro", "gemini-1.5-flash"},
+                      "FREE tier: 15 requests/minute. Get key at https://aistudio.google.com/apikey") {
+    rebuildTemplate();
+}
+
+void GeminiAdapter::rebuildTemplate() {
+    ProviderAdapter::rebuildTemplate();
+    m_urls.clear();
+}
+
+QNetworkRequest GeminiAdapter::request(const QString &model, bool stream) const {
+    const QString cacheKey = stream ? model + QStringLiteral("|stream") : model;
+    auto it = m_urls.constFind(cacheKey);
+    if (it == m_urls.constEnd()) {
+        // streamGenerateContent only emits SSE frames when alt=sse is requested
+        QUrl url = m_origin;
+        url.setPath(QString("/v1beta/models/%1:%2")
+            .arg(model, stream ? QStringLiteral("streamGenerateContent") : QStringLiteral("generateContent")));
+        QUrlQuery query;
+        if (stream) {
+            query.addQueryItem("alt", "sse");
+        }
+        query.addQueryItem("key", m_apiKey);
+        url.setQuery(query);
+        it = m_urls.insert(cacheKey, url);
+    }
+
+    QNetworkRequest request = m_template;
+    request.setUrl(it.value());
+    return request;
+}
+
+QJsonObject GeminiAdapter::body(const QList<QJsonObject> &messages, const QString &model,
+                                double temperature, bool stream) const {
+    Q_UNUSED(model);
+    Q_UNUSED(stream);
+
+    // Gemini has its own roles and takes system prompts as systemInstruction
+    QStringList systemParts;
+    QJsonArray contents;
+    for (const auto &msg : messages) {
+        QString role = msg["role"].toString();
+        if (role == "system") {
+            systemParts.append(msg["content"].toString());
+            continue;
+        }
+        QJsonObject textPart;
+        textPart["text"] = msg["content"].toString();
+
+        QJsonObject content;
+        content["role"] = (role == "assistant") ? "model" : "user";
+        content["parts"] = QJsonArray{textPart};
+        contents.append(content);
+    }
+
+    QJsonObject json;
+    json["contents"] = contents;
+    if (!systemParts.isEmpty()) {
+        QJsonObject systemText;
+        systemText["text"] = systemParts.join("\n\n");
+        json["systemInstruction"] = QJsonObject{{"parts", QJsonArray{systemText}}};
+    }
+
+    QJsonObject generationConfig;
+    generationConfig["temperature"] = temperature;
+    generationConfig["maxOutputTokens"] = 4096;
+    json["generationConfig"] = generationConfig;
+    return json;
+}
+
+void GeminiAdapter::parseResponse(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!geminiFields().extract(data, &f)) {
+        result.error = "Invalid response format";
+        return;
+    }
+
+    if (f[GeminiError].found) {
+        result.error = "API Error: " + f[GeminiErrorMessage].text;
+        return;
+    }
+
+    result.text = f[GeminiFirstPart].text;
+    result.inputTokens = f[GeminiPromptTokens].toInt();
+    result.outputTokens = f[GeminiCandidateTokens].toInt();
+}
+
+QString GeminiAdapter::parseStreamFrame(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!geminiFields().extract(data, &f)) {
+        return QString();
+    }
+    if (f[GeminiError].found) {
+        result.error = "API Error: " + f[GeminiErrorMessage].text;
+        return QString();
+    }
+
+    if (f[GeminiPromptTokens].found || f[GeminiCandidateTokens].found) {
+        result.inputTokens = f[GeminiPromptTokens].toInt();
+        result.outputTokens = f[GeminiCandidateTokens].toInt();
+    }
+    return f[GeminiAllParts].text;
+}
+
+// Ollama
+
+OllamaAdapter::OllamaAdapter()
+    : ProviderAdapter("Ollama", QUrl("http://localhost:11434"), "llama3.2",
+                      {"llama3.2", "llama3.1", "mistral", "phi3", "gemma2", "qwen2.5"},
+                      "100% FREE - Runs locally on your computer. Install from https://ollama.ai") {
+    rebuildTemplate();
+}
+
+void OllamaAdapter::rebuildTemplate() {
+    ProviderAdapter::rebuildTemplate();
+    QUrl url = m_origin;
+    url.setPath("/api/chat");
+    m_template.setUrl(url);
+}
+
+QJsonObject OllamaAdapter::body(const QList<QJsonObject> &messages, const QString &model,
+                                double temperature, bool stream) const {
+    QJsonObject json;
+    json["model"] = model;
+    json["messages"] = toArray(messages);
+    json["stream"] = stream;
+    json["keep_alive"] = m_keepAlive;
+
+    QJsonObject options;
+    options["temperature"] = temperature;
+    json["options"] = options;
+    return json;
+}
+
+void OllamaAdapter::parseResponse(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!ollamaFields().extract(data, &f)) {
+        result.error = "Invalid response format from Ollama";
+        return;
+    }
+
+    if (f[OllamaError].found) {
+        result.error = "Ollama Error: " + f[OllamaError].text;
+        return;
+    }
+
+    result.text = f[OllamaContent].text;
+    result.inputTokens = f[OllamaPromptTokens].toInt();
+    result.outputTokens = f[OllamaEvalTokens].toInt();
+}
+
+QString OllamaAdapter::parseStreamFrame(QByteArrayView data, ProviderResult &result) const {
+    JsonFieldExtractor::Fields f;
+    if (!ollamaFields().extract(data, &f)) {
+        return QString();
+    }
+    if (f[OllamaError].found) {
+        result.error = "Ollama Error: " + f[OllamaError].text;
+        return QString();
+    }
+
+    if (f[OllamaDone].boolean) {
+        result.inputTokens = f[OllamaPromptTokens].toInt();
+        result.outputTokens = f[OllamaEvalTokens].toInt();
+    }
+    return f[OllamaContent].text;
+}
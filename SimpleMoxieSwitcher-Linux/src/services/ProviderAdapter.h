@@ -0,0 +1,133 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QNetworkRequest>
+#include <QUrl>
+#include <memory>
+
+// Text, usage and error accumulated from one provider reply
+struct ProviderResult {
+    QString text;
+    QString error;
+    int inputTokens = 0;
+    int outputTokens = 0;
+};
+
+// Everything that differs between provider backends: endpoint, credentials,
+// request body and reply parsing. The request template (URL, headers, auth)
+// is rebuilt only when the API key changes, so each call just copies it.
+// Adding a backend means adding a subclass and a case in create().
+class ProviderAdapter {
+public:
+    virtual ~ProviderAdapter() = default;
+
+    // Names match the AIProviderService::AIProvider keys; nullptr if unknown
+    static std::unique_ptr<ProviderAdapter> create(const QString &name);
+
+    QString name() const { return m_name; }
+    QUrl origin() const { return m_origin; }
+    QString defaultModel() const { return m_defaultModel; }
+    QStringList models() const { return m_models; }
+    QString info() const { return m_info; }
+    virtual bool requiresApiKey() const { return true; }
+
+    QString apiKey() const { return m_apiKey; }
+    void setApiKey(const QString &key);
+
+    virtual QNetworkRequest request(const QString &model, bool stream) const;
+    virtual QJsonObject body(const QList<QJsonObject> &messages, const QString &model,
+                             double temperature, bool stream) const = 0;
+    virtual void parseResponse(QByteArrayView data, ProviderResult &result) const = 0;
+
+    // Applies one stream frame (SSE data payload or NDJSON line) and returns
+    // the text delta it carried, if any
+    virtual QString parseStreamFrame(QByteArrayView data, ProviderResult &result) const = 0;
+
+protected:
+    ProviderAdapter(const QString &name, const QUrl &origin, const QString &defaultModel,
+                    const QStringList &models, const QString &info);
+    virtual void rebuildTemplate();
+
+    QString m_name;
+    QUrl m_origin;
+    QString m_defaultModel;
+    QStringList m_models;
+    QString m_info;
+    QString m_apiKey;
+    QNetworkRequest m_template;
+};
+
+// OpenAI chat completions, also spoken by DeepSeek and GroqCloud
+class OpenAICompatibleAdapter : public ProviderAdapter {
+public:
+    OpenAICompatibleAdapter(const QString &name, const QUrl &origin, const QString &path,
+                            const QString &defaultModel, const QStringList &models, const QString &info);
+
+    QJsonObject body(const QList<QJsonObject> &messages, const QString &model,
+                     double temperature, bool stream) const override;
+    void parseResponse(QByteArrayView data, ProviderResult &result) const override;
+    QString parseStreamFrame(QByteArrayView data, ProviderResult &result) const override;
+
+protected:
+    void rebuildTemplate() override;
+
+private:
+    QString m_path;
+};
+
+class AnthropicAdapter : public ProviderAdapter {
+public:
+    AnthropicAdapter();
+
+    QJsonObject body(const QList<QJsonObject> &messages, const QString &model,
+                     double temperature, bool stream) const override;
+    void parseResponse(QByteArrayView data, ProviderResult &result) const override;
+    QString parseStreamFrame(QByteArrayView data, ProviderResult &result) const override;
+
+protected:
+    void rebuildTemplate() override;
+};
+
+class GeminiAdapter : public ProviderAdapter {
+public:
+    GeminiAdapter();
+
+    // The model and key are part of the URL, so URLs are cached per model
+    QNetworkRequest request(const QString &model, bool stream) const override;
+    QJsonObject body(const QList<QJsonObject> &messages, const QString &model,
+                     double temperature, bool stream) const override;
+    void parseResponse(QByteArrayView data, ProviderResult &result) const override;
+    QString parseStreamFrame(QByteArrayView data, ProviderResult &result) const override;
+
+protected:
+    void rebuildTemplate() override;
+
+private:
+    mutable QHash<QString, QUrl> m_urls;
+};
+
+class OllamaAdapter : public ProviderAdapter {
+public:
+    OllamaAdapter();
+
+    bool requiresApiKey() const override { return false; }
+
+    // Sent with every request; the service lowers it to 0 in sleep mode
+    void setKeepAlive(const QJsonValue &keepAlive) { m_keepAlive = keepAlive; }
+    QJsonValue keepAlive() const { return m_keepAlive; }
+
+    QJsonObject body(const QList<QJsonObject> &messages, const QString &model,
+                     double temperature, bool stream) const override;
+    void parseResponse(QByteArrayView data, ProviderResult &result) const override;
+    QString parseStreamFrame(QByteArrayView data, ProviderResult &result) const override;
+
+protected:
+    void rebuildTemplate() override;
+
+private:
+    QJsonValue m_keepAlive = QStringLiteral("30m");
+};
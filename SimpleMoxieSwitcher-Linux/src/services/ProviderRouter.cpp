@@ -0,0 +1,97 @@
+#include "ProviderRouter.h"
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+
+ProviderRouter::ProviderRouter()
+    // Free options first: local, then the hosted free tiers
+    : m_chain({"Ollama", "GroqCloud", "Gemini"}) {
+}
+
+bool ProviderRouter::isAvailable(const QString &provider) const {
+    auto it = m_health.constFind(provider);
+    if (it == m_health.constEnd()) {
+        return true;
+    }
+    return it->openUntil <= QDateTime::currentMSecsSinceEpoch() && !it->trialInFlight;
+}
+
+double ProviderRouter::score(const QString &provider) const {
+    const Health h = m_health.value(provider);
+    if (h.samples == 0) {
+        // Unmeasured providers rank after measured ones, keeping chain order
+        return std::numeric_limits<double>::max();
+    }
+    // A provider failing half the time costs roughly a second attempt
+    return h.latencyMs * (1.0 + 2.0 * h.errorRate);
+}
+
+QStringList ProviderRouter::route(const QString &preferred, const QStringList &exclude) const {
+    QStringList order;
+    if (!exclude.contains(preferred) && isAvailable(preferred)) {
+        order.append(preferred);
+    }
+
+    QStringList fallbacks;
+    for (const auto &provider : m_chain) {
+        if (provider != preferred && !exclude.contains(provider) && isAvailable(provider)) {
+            fallbacks.append(provider);
+        }
+    }
+    std::stable_sort(fallbacks.begin(), fallbacks.end(), [this](const QString &a, const QString &b) {
+        return score(a) < score(b);
+    });
+    order += fallbacks;
+
+    // Everything is cooling down: the preferred provider is still the best bet
+    if (order.isEmpty() && !exclude.contains(preferred)) {
+        order.append(preferred);
+    }
+    return order;
+}
+
+void ProviderRouter::beginAttempt(const QString &provider) {
+    Health &h = m_health[provider];
+    if (h.trips > 0 && h.openUntil <= QDateTime::currentMSecsSinceEpoch()) {
+        h.trialInFlight = true;
+    }
+}
+
+void ProviderRouter::recordSuccess(const QString &provider, qint64 latencyMs) {
+    Health &h = m_health[provider];
+    h.latencyMs = h.samples == 0
+        ? latencyMs
+        : m_smoothing * latencyMs + (1.0 - m_smoothing) * h.latencyMs;
+    h.errorRate = (1.0 - m_smoothing) * h.errorRate;
+    h.samples++;
+    h.consecutiveFailures = 0;
+    h.trips = 0;
+    h.openUntil = 0;
+    h.trialInFlight = false;
+}
+
+void ProviderRouter::recordFailure(const QString &provider) {
+    Health &h = m_health[provider];
+    h.errorRate = m_smoothing + (1.0 - m_smoothing) * h.errorRate;
+    h.consecutiveFailures++;
+
+    // A failed half-open probe reopens immediately with a longer cooldown.
+    // Failures while already open (requests sent before it tripped, or with
+    // nowhere else to go) leave the cooldown alone.
+    const bool closed = h.openUntil <= QDateTime::currentMSecsSinceEpoch();
+    if (h.trialInFlight || (closed && h.consecutiveFailures >= m_failureThreshold)) {
+        h.trips++;
+        qint64 cooldown = qMin(m_cooldownMs << qMin(h.trips - 1, 10), m_maxCooldownMs);
+        h.openUntil = QDateTime::currentMSecsSinceEpoch() + cooldown;
+        qWarning() << "Circuit open for" << provider << "for" << cooldown / 1000 << "s";
+    }
+    h.trialInFlight = false;
+}
+
+void ProviderRouter::recordCancelled(const QString &provider) {
+    auto it = m_health.find(provider);
+    if (it != m_health.end()) {
+        it->trialInFlight = false;
+    }
+}
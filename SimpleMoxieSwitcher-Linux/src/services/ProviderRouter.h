@@ -0,0 +1,56 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+// Decides which provider serves a request. The preferred provider is tried
+// first, then an ordered fallback chain. Per-provider health is tracked as an
+// EWMA of time-to-first-output and error rate; a provider that keeps failing
+// trips a circuit breaker and is skipped until its cooldown expires, after
+// which a single trial request decides whether it is healthy again.
+class ProviderRouter {
+public:
+    struct Health {
+        double latencyMs = 0.0;         // EWMA time to first output
+        double errorRate = 0.0;         // EWMA of failures, 0..1
+        int samples = 0;
+        int consecutiveFailures = 0;
+        int trips = 0;                  // consecutive breaker openings, drives backoff
+        qint64 openUntil = 0;           // msecs since epoch
+        bool trialInFlight = false;     // half-open probe outstanding
+    };
+
+    ProviderRouter();
+
+    QStringList fallbackChain() const { return m_chain; }
+    void setFallbackChain(const QStringList &chain) { m_chain = chain; }
+
+    // Providers to try in order: the preferred one while its breaker is closed,
+    // then healthy fallbacks ranked by expected latency. Never empty unless the
+    // preferred provider itself is excluded.
+    QStringList route(const QString &preferred, const QStringList &exclude = QStringList()) const;
+    bool isAvailable(const QString &provider) const;
+
+    void beginAttempt(const QString &provider);
+    void recordSuccess(const QString &provider, qint64 latencyMs);
+    void recordFailure(const QString &provider);
+    void recordCancelled(const QString &provider);
+
+    Health health(const QString &provider) const { return m_health.value(provider); }
+
+    int failureThreshold() const { return m_failureThreshold; }
+    void setFailureThreshold(int failures) { m_failureThreshold = qMax(1, failures); }
+
+    qint64 cooldownMs() const { return m_cooldownMs; }
+    void setCooldownMs(qint64 ms) { m_cooldownMs = qMax<qint64>(1000, ms); }
+
+private:
+    double score(const QString &provider) const;
+
+    QStringList m_chain;
+    QHash<QString, Health> m_health;
+    int m_failureThreshold = 3;
+    qint64 m_cooldownMs = 30 * 1000;
+    qint64 m_maxCooldownMs = 5 * 60 * 1000;
+    double m_smoothing = 0.2;
+};
@@ -0,0 +1,224 @@
+#include "ResponseCache.h"
+#include "StorageService.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <algorithm>
+
+ResponseCache::ResponseCache(const QString &directory, SimpleMoxieSwitcher::StorageService *storage,
+                             QObject *context, int maxMemoryBytes)
+    : m_directory(directory)
+    , m_storage(storage)
+    , m_context(context)
+    , m_memory(maxMemoryBytes) {
+    sweep();
+}
+
+QByteArray ResponseCache::makeKey(const QString &provider, const QString &model, double temperature,
+                                  const QJsonObject &request) {
+    QJsonObject normalized = request;
+    normalized.remove("stream");
+    normalized.remove("stream_options");
+    normalized.remove("keep_alive");
+
+    // QJsonObject keeps keys sorted, so compact output is already canonical
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(provider.toUtf8());
+    hash.addData("\n");
+    hash.addData(model.toUtf8());
+    hash.addData("\n");
+    hash.addData(QByteArray::number(temperature, 'g', 6));
+    hash.addData("\n");
+    hash.addData(QJsonDocument(normalized).toJson(QJsonDocument::Compact));
+    return hash.result().toHex();
+}
+
+QString ResponseCache::filePath(const QByteArray &key) const {
+    return m_directory + "/" + QString::fromLatin1(key) + ".json";
+}
+
+bool ResponseCache::isExpired(const Entry &entry) const {
+    return QDateTime::currentMSecsSinceEpoch() - entry.createdAt > m_ttlSeconds * 1000;
+}
+
+void ResponseCache::setMaxDiskBytes(qint64 bytes) {
+    m_maxDiskBytes = qMax<qint64>(0, bytes);
+    trimDisk();
+}
+
+bool ResponseCache::lookup(const QByteArray &key, Entry *entry) {
+    Entry *cached = m_memory.object(key);
+    if (!cached) {
+        return false;
+    }
+    if (isExpired(*cached)) {
+        m_memory.remove(key);
+        if (m_disk.contains(key)) {
+            forget(key);
+            removeFiles({filePath(key)});
+        }
+        return false;
+    }
+    *entry = *cached;
+    return true;
+}
+
+bool ResponseCache::mayBeOnDisk(const QByteArray &key) const {
+    return !m_swept || m_disk.contains(key);
+}
+
+QFuture<ResponseCache::Entry> ResponseCache::load(const QByteArray &key) {
+    const QString path = filePath(key);
+    const qint64 ttlMs = m_ttlSeconds * 1000;
+    return m_storage->runAsync([path, ttlMs]() {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return Entry();
+        }
+        QJsonObject obj = QJsonDocument::fromJson(file.readAll()).object();
+        file.close();
+
+        Entry loaded;
+        loaded.response = obj["response"].toString();
+        loaded.inputTokens = obj["inputTokens"].toInt();
+        loaded.outputTokens = obj["outputTokens"].toInt();
+        loaded.createdAt = obj["createdAt"].toInteger();
+        if (loaded.response.isEmpty() || QDateTime::currentMSecsSinceEpoch() - loaded.createdAt > ttlMs) {
+            QFile::remove(path);
+            return Entry();
+        }
+        return loaded;
+    }).then(m_context, [this, key](const Entry &entry) {
+        if (!entry.response.isEmpty()) {
+            remember(key, entry);
+        } else if (!m_memory.contains(key)) {
+            // Unless an insert landed while the read was queued
+            forget(key);
+        }
+        return entry;
+    });
+}
+
+void ResponseCache::insert(const QByteArray &key, const Entry &entry) {
+    remember(key, entry);
+
+    QJsonObject obj;
+    obj["response"] = entry.response;
+    obj["inputTokens"] = entry.inputTokens;
+    obj["outputTokens"] = entry.outputTokens;
+    obj["createdAt"] = entry.createdAt;
+    const QByteArray data = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+
+    const QString path = filePath(key);
+    m_storage->runAsync([path, data]() {
+        QSaveFile file(path);
+        return file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+    });
+
+    forget(key);
+    m_disk.insert(key, {entry.createdAt, data.size()});
+    m_diskBytes += data.size();
+    trimDisk();
+}
+
+void ResponseCache::clear() {
+    m_memory.clear();
+    m_disk.clear();
+    m_diskBytes = 0;
+
+    const QString directory = m_directory;
+    m_storage->runAsync([directory]() {
+        QDir dir(directory);
+        const QStringList files = dir.entryList({"*.json"}, QDir::Files);
+        for (const auto &name : files) {
+            dir.remove(name);
+        }
+        return true;
+    });
+}
+
+void ResponseCache::remember(const QByteArray &key, const Entry &entry) {
+    m_memory.insert(key, new Entry(entry), qMax<qsizetype>(1, entry.response.size() * 2));
+}
+
+void ResponseCache::forget(const QByteArray &key) {
+    auto it = m_disk.find(key);
+    if (it != m_disk.end()) {
+        m_diskBytes -= it->bytes;
+        m_disk.erase(it);
+    }
+}
+
+void ResponseCache::sweep() {
+    // Expiry goes by modification time, which is when the entry was written,
+    // so no file has to be opened
+    const QString directory = m_directory;
+    const qint64 ttlMs = m_ttlSeconds * 1000;
+    m_storage->runAsync([directory, ttlMs]() {
+        QDir().mkpath(directory);
+        QHash<QByteArray, DiskEntry> index;
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        const QFileInfoList files = QDir(directory).entryInfoList({"*.json"}, QDir::Files);
+        for (const QFileInfo &info : files) {
+            const qint64 written = info.lastModified().toMSecsSinceEpoch();
+            if (now - written > ttlMs) {
+                QFile::remove(info.filePath());
+                continue;
+            }
+            index.insert(info.completeBaseName().toLatin1(), {written, info.size()});
+        }
+        return index;
+    }).then(m_context, [this](const QHash<QByteArray, DiskEntry> &index) {
+        // Entries inserted while the sweep ran are already indexed
+        for (auto it = index.cbegin(); it != index.cend(); ++it) {
+            if (!m_disk.contains(it.key())) {
+                m_disk.insert(it.key(), it.value());
+                m_diskBytes += it->bytes;
+            }
+        }
+        m_swept = true;
+        trimDisk();
+    });
+}
+
+void ResponseCache::trimDisk() {
+    if (!m_swept || m_diskBytes <= m_maxDiskBytes) {
+        return;
+    }
+
+    // Oldest first, down to 90% of the cap so a full tier does not evict on
+    // every insert
+    QList<QPair<qint64, QByteArray>> byAge;
+    byAge.reserve(m_disk.size());
+    for (auto it = m_disk.cbegin(); it != m_disk.cend(); ++it) {
+        byAge.append({it->createdAt, it.key()});
+    }
+    std::sort(byAge.begin(), byAge.end());
+
+    const qint64 target = m_maxDiskBytes / 10 * 9;
+    QStringList evicted;
+    for (const auto &[createdAt, key] : std::as_const(byAge)) {
+        if (m_diskBytes <= target) {
+            break;
+        }
+        forget(key);
+        evicted.append(filePath(key));
+    }
+    removeFiles(evicted);
+}
+
+void ResponseCache::removeFiles(const QStringList &paths) {
+    if (paths.isEmpty()) {
+        return;
+    }
+    m_storage->runAsync([paths]() {
+        for (const QString &path : paths) {
+            QFile::remove(path);
+        }
+        return true;
+    });
+}
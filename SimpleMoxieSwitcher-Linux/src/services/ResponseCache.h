@@ -0,0 +1,80 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QCache>
+#include <QFuture>
+#include <QHash>
+#include <QJsonObject>
+
+class QObject;
+
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
+
+// Content-addressed cache for deterministic provider responses. Entries live
+// in an in-memory LRU tier backed by one small JSON file per key on disk, and
+// expire after a fixed time-to-live in both tiers. Disk reads, writes and
+// removals run on the storage I/O thread. A sweep at startup drops expired
+// files and indexes the rest, so keys that were never written skip the disk
+// and the oldest files go once the tier outgrows its cap.
+class ResponseCache {
+public:
+    struct Entry {
+        QString response;
+        int inputTokens = 0;
+        int outputTokens = 0;
+        qint64 createdAt = 0;   // msecs since epoch
+    };
+
+    // Disk results are applied through continuations on context's thread
+    ResponseCache(const QString &directory, SimpleMoxieSwitcher::StorageService *storage, QObject *context,
+                  int maxMemoryBytes = 8 * 1024 * 1024);
+
+    // Hash of everything that determines the response; stream and keep-alive flags are ignored
+    static QByteArray makeKey(const QString &provider, const QString &model, double temperature,
+                              const QJsonObject &request);
+
+    // Memory tier only
+    bool lookup(const QByteArray &key, Entry *entry);
+
+    // Whether the disk tier may hold key; always true until the sweep is done
+    bool mayBeOnDisk(const QByteArray &key) const;
+
+    // Reads key from disk on the I/O thread; an empty response is a miss. A
+    // hit is promoted to the memory tier before the future resolves.
+    QFuture<Entry> load(const QByteArray &key);
+
+    void insert(const QByteArray &key, const Entry &entry);
+    void clear();
+
+    qint64 ttlSeconds() const { return m_ttlSeconds; }
+    void setTtlSeconds(qint64 seconds) { m_ttlSeconds = seconds; }
+
+    qint64 maxDiskBytes() const { return m_maxDiskBytes; }
+    void setMaxDiskBytes(qint64 bytes);
+
+private:
+    struct DiskEntry {
+        qint64 createdAt = 0;
+        qint64 bytes = 0;
+    };
+
+    QString filePath(const QByteArray &key) const;
+    bool isExpired(const Entry &entry) const;
+    void remember(const QByteArray &key, const Entry &entry);
+    void forget(const QByteArray &key);
+    void sweep();
+    void trimDisk();
+    void removeFiles(const QStringList &paths);
+
+    QString m_directory;
+    SimpleMoxieSwitcher::StorageService *m_storage;
+    QObject *m_context;
+    QCache<QByteArray, Entry> m_memory;
+    QHash<QByteArray, DiskEntry> m_disk;
+    qint64 m_diskBytes = 0;
+    bool m_swept = false;
+    qint64 m_ttlSeconds = 7 * 24 * 60 * 60;
+    qint64 m_maxDiskBytes = 32 * 1024 * 1024;
+};
@@ -1,10 +1,278 @@
 #include "StorageService.h"
 #include <QFile>
+#include <QSaveFile>
 #include <QSettings>
 #include <QDebug>
+#include <QFileInfo>
+#include <QMutex>
+#include <QPromise>
+#include <QThread>
+#include <QWaitCondition>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace SimpleMoxieSwitcher {
 
+namespace {
+
+bool syncDirectory(const QString &directory, QString *error) {
+    int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY);
+    bool ok = fd >= 0 && ::fsync(fd) == 0;
+    if (!ok) {
+        *error = QString::fromLocal8Bit(strerror(errno));
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    return ok;
+}
+
+} // namespace
+
+// Owns the I/O thread behind the *Async methods. Jobs run in FIFO order;
+// a save for a file that already has a save waiting in the queue replaces
+// that job's document instead of adding another write. When the queue is
+// full, new saves and loads fail at once instead of waiting for room.
+class StorageWorker {
+public:
+    StorageWorker(StorageService *owner, int capacity)
+        : m_owner(owner)
+        , m_capacity(capacity) {
+        m_thread.reset(QThread::create([this]() { run(); }));
+        m_thread->setObjectName("StorageWorker");
+        m_thread->start();
+    }
+
+    // Drains the queue before the thread exits, so no save is lost
+    ~StorageWorker() {
+        {
+            QMutexLocker lock(&m_mutex);
+            m_stopping = true;
+            m_notEmpty.wakeAll();
+        }
+        m_thread->wait();
+    }
+
+    QFuture<bool> save(const QString &filename, const QJsonDocument &document) {
+        auto promise = std::make_shared<QPromise<bool>>();
+        promise->start();
+        QFuture<bool> future = promise->future();
+
+        QMutexLocker lock(&m_mutex);
+        Job *queued = nullptr;
+        for (Job &job : m_queue) {
+            if (job.kind == Job::Save && job.filename == filename) {
+                queued = &job;
+                break;
+            }
+        }
+        if (!queued && isFull()) {
+            lock.unlock();
+            emit m_owner->saveError(filename, QStringLiteral("I/O queue is full"));
+            promise->addResult(false);
+            promise->finish();
+            return future;
+        }
+
+        Latest &latest = m_latest[filename];
+        latest.document = document;
+        latest.generation = ++m_generation;
+
+        if (queued) {
+            queued->document = document;
+            queued->generation = latest.generation;
+            queued->saveWaiters.append(promise);
+            return future;
+        }
+
+        Job job;
+        job.kind = Job::Save;
+        job.filename = filename;
+        job.document = document;
+        job.generation = latest.generation;
+        job.saveWaiters.append(promise);
+        enqueue(std::move(job));
+        return future;
+    }
+
+    QFuture<QJsonDocument> load(const QString &filename) {
+        auto promise = std::make_shared<QPromise<QJsonDocument>>();
+        promise->start();
+        QFuture<QJsonDocument> future = promise->future();
+
+        Job job;
+        job.kind = Job::Load;
+        job.filename = filename;
+        job.loadWaiter = promise;
+
+        QMutexLocker lock(&m_mutex);
+        if (isFull()) {
+            lock.unlock();
+            emit m_owner->loadError(filename, QStringLiteral("I/O queue is full"));
+            promise->addResult(QJsonDocument());
+            promise->finish();
+            return future;
+        }
+        enqueue(std::move(job));
+        return future;
+    }
+
+    // Tasks are few and their callers wait on the result, so they are
+    // always queued
+    void post(std::function<void()> task) {
+        Job job;
+        job.kind = Job::Task;
+        job.task = std::move(task);
+
+        QMutexLocker lock(&m_mutex);
+        enqueue(std::move(job));
+    }
+
+    // Drops queued saves of filename and waits out one being written, so a
+    // synchronous write or delete that follows cannot be overwritten by
+    // older data. Returns the dropped saves' waiters for the caller to settle.
+    QList<std::shared_ptr<QPromise<bool>>> supersede(const QString &filename) {
+        QList<std::shared_ptr<QPromise<bool>>> waiters;
+        QMutexLocker lock(&m_mutex);
+        while (m_writing.contains(filename)) {
+            m_written.wait(&m_mutex);
+        }
+        for (auto it = m_queue.begin(); it != m_queue.end();) {
+            if (it->kind == Job::Save && it->filename == filename) {
+                waiters += it->saveWaiters;
+                it = m_queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_latest.remove(filename);
+        return waiters;
+    }
+
+    // A save that is queued or being written, if any
+    bool latest(const QString &filename, QJsonDocument *document) const {
+        QMutexLocker lock(&m_mutex);
+        auto it = m_latest.constFind(filename);
+        if (it == m_latest.cend()) {
+            return false;
+        }
+        *document = it->document;
+        return true;
+    }
+
+private:
+    struct Job {
+        enum Kind { Save, Load, Task } kind = Save;
+        QString filename;
+        QJsonDocument document;
+        quint64 generation = 0;
+        QList<std::shared_ptr<QPromise<bool>>> saveWaiters;
+        std::shared_ptr<QPromise<QJsonDocument>> loadWaiter;
+        std::function<void()> task;
+    };
+
+    struct Latest {
+        QJsonDocument document;
+        quint64 generation = 0;
+    };
+
+    // Called with m_mutex held. Callers never wait for room: a full queue
+    // means the disk is far behind, and blocking would stall the GUI thread.
+    bool isFull() const {
+        return m_queue.size() >= m_capacity;
+    }
+
+    void enqueue(Job job) {
+        m_queue.append(std::move(job));
+        m_notEmpty.wakeOne();
+    }
+
+    void run() {
+        for (;;) {
+            QList<Job> batch;
+            {
+                QMutexLocker lock(&m_mutex);
+                while (m_queue.isEmpty() && !m_stopping) {
+                    m_notEmpty.wait(&m_mutex);
+                }
+                if (m_queue.isEmpty()) {
+                    return;
+                }
+                // Saves at the head of the queue are committed together
+                batch.append(m_queue.takeFirst());
+                while (batch.first().kind == Job::Save && !m_queue.isEmpty() && m_queue.first().kind == Job::Save) {
+                    batch.append(m_queue.takeFirst());
+                }
+                for (const Job &job : std::as_const(batch)) {
+                    if (job.kind == Job::Save) {
+                        m_writing.insert(job.filename);
+                    }
+                }
+            }
+
+            if (batch.first().kind == Job::Save) {
+                commit(batch);
+            } else if (batch.first().kind == Job::Task) {
+                batch.first().task();
+            } else {
+                const Job &job = batch.first();
+                QJsonDocument document;
+                if (!latest(job.filename, &document)) {
+                    QByteArray data;
+                    if (m_owner->readFromDisk(job.filename, &data)) {
+                        m_owner->parseDocument(job.filename, data, &document);
+                    }
+                }
+                job.loadWaiter->addResult(document);
+                job.loadWaiter->finish();
+            }
+        }
+    }
+
+    void commit(const QList<Job> &saves) {
+        QHash<QString, QByteArray> files;
+        for (const Job &job : saves) {
+            files.insert(job.filename, job.document.toJson(QJsonDocument::Indented));
+        }
+        const QSet<QString> written = m_owner->commitGroup(files);
+
+        {
+            // Keep an entry if a newer save arrived meanwhile
+            QMutexLocker lock(&m_mutex);
+            for (const Job &job : saves) {
+                auto it = m_latest.find(job.filename);
+                if (it != m_latest.end() && it->generation == job.generation) {
+                    m_latest.erase(it);
+                }
+                m_writing.remove(job.filename);
+            }
+            m_written.wakeAll();
+        }
+        for (const Job &job : saves) {
+            const bool ok = written.contains(job.filename);
+            for (const auto &waiter : job.saveWaiters) {
+                waiter->addResult(ok);
+                waiter->finish();
+            }
+        }
+    }
+
+    StorageService *m_owner;
+    std::unique_ptr<QThread> m_thread;
+    mutable QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_written;
+    QList<Job> m_queue;
+    QSet<QString> m_writing;            // saves taken off the queue, not yet committed
+    QHash<QString, Latest> m_latest;
+    quint64 m_generation = 0;
+    int m_capacity;
+    bool m_stopping = false;
+};
+
 StorageService::StorageService(QObject *parent)
     : QObject(parent)
 {
@@ -12,6 +280,41 @@ StorageService::StorageService(QObject *parent)
     ensureDirectoryExists();
 }
 
+StorageService::~StorageService() {
+    m_worker.reset();
+}
+
+StorageWorker *StorageService::worker() {
+    if (!m_worker) {
+        m_worker = std::make_unique<StorageWorker>(this, 256);
+    }
+    return m_worker.get();
+}
+
+bool StorageService::queuedDocument(const QString &filename, QJsonDocument *doc) const {
+    return m_worker && m_worker->latest(filename, doc);
+}
+
+QFuture<bool> StorageService::saveJsonAsync(const QString &filename, const QJsonObject &data) {
+    return worker()->save(filename, QJsonDocument(data));
+}
+
+QFuture<bool> StorageService::saveJsonArrayAsync(const QString &filename, const QJsonArray &data) {
+    return worker()->save(filename, QJsonDocument(data));
+}
+
+void StorageService::post(std::function<void()> task) {
+    worker()->post(std::move(task));
+}
+
+QFuture<QJsonObject> StorageService::loadJsonAsync(const QString &filename) {
+    return worker()->load(filename).then([](const QJsonDocument &doc) { return doc.object(); });
+}
+
+QFuture<QJsonArray> StorageService::loadJsonArrayAsync(const QString &filename) {
+    return worker()->load(filename).then([](const QJsonDocument &doc) { return doc.array(); });
+}
+
 void StorageService::ensureDirectoryExists() {
     QDir dir(m_dataPath);
     if (!dir.exists()) {
@@ -23,6 +326,7 @@ void StorageService::ensureDirectoryExists() {
     dir.mkpath("profiles");
     dir.mkpath("memories");
     dir.mkpath("usage");
+    dir.mkpath("cache");
 }
 
 QString StorageService::getFilePath(const QString &filename) const {
@@ -30,91 +334,184 @@ QString StorageService::getFilePath(const QString &filename) const {
 }
 
 bool StorageService::saveJson(const QString &filename, const QJsonObject &data) {
-    QFile file(getFilePath(filename));
+    return replaceQueued(filename, [&]() {
+        return writeAtomically(filename, QJsonDocument(data).toJson(QJsonDocument::Indented));
+    });
+}
+
+bool StorageService::saveJsonArray(const QString &filename, const QJsonArray &data) {
+    return replaceQueued(filename, [&]() {
+        return writeAtomically(filename, QJsonDocument(data).toJson(QJsonDocument::Indented));
+    });
+}
+
+// Saves of the file still waiting on the worker are dropped rather than
+// written after this call; their callers get this call's result, as
+// coalesced saves do
+bool StorageService::replaceQueued(const QString &filename, const std::function<bool()> &write) {
+    QList<std::shared_ptr<QPromise<bool>>> waiters;
+    if (m_worker) {
+        waiters = m_worker->supersede(filename);
+    }
+    const bool ok = write();
+    for (const auto &waiter : waiters) {
+        waiter->addResult(ok);
+        waiter->finish();
+    }
+    return ok;
+}
+
+bool StorageService::writeAtomically(const QString &filename, const QByteArray &data) {
+    // QSaveFile writes a temp file, fsyncs it and renames it over the target,
+    // so a crash leaves either the old file or the new one
+    QSaveFile file(getFilePath(filename));
     if (!file.open(QIODevice::WriteOnly)) {
         emit saveError(filename, file.errorString());
         return false;
     }
 
-    QJsonDocument doc(data);
-    file.write(doc.toJson(QJsonDocument::Indented));
-    file.close();
-    return true;
-}
-
-bool StorageService::saveJsonArray(const QString &filename, const QJsonArray &data) {
-    QFile file(getFilePath(filename));
-    if (!file.open(QIODevice::WriteOnly)) {
+    if (file.write(data) != data.size()) {
+        emit saveError(filename, file.errorString());
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
         emit saveError(filename, file.errorString());
         return false;
     }
 
-    QJsonDocument doc(data);
-    file.write(doc.toJson(QJsonDocument::Indented));
-    file.close();
+    // The rename is only durable once the directory entry is
+    QString error;
+    if (!syncDirectory(QFileInfo(getFilePath(filename)).absolutePath(), &error)) {
+        emit saveError(filename, error);
+        return false;
+    }
     return true;
 }
 
-QJsonObject StorageService::loadJson(const QString &filename) {
+// Runs on the worker thread. Every temp file is written and fsync'd before
+// any rename, and each directory involved is fsync'd once after the renames,
+// so a group pays a single directory sync however many files it holds. A
+// file counts as written only if all of its steps succeeded.
+QSet<QString> StorageService::commitGroup(const QHash<QString, QByteArray> &files) {
+    QStringList synced;
+    for (auto it = files.cbegin(); it != files.cend(); ++it) {
+        QFile file(getFilePath(it.key()) + ".tmp");
+        QString error;
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || file.write(it.value()) != it.value().size() || !file.flush()) {
+            error = file.errorString();
+        } else if (::fsync(file.handle()) != 0) {
+            error = QString::fromLocal8Bit(strerror(errno));
+        }
+        file.close();
+        if (error.isEmpty() && file.error() != QFileDevice::NoError) {
+            error = file.errorString();
+        }
+        if (!error.isEmpty()) {
+            emit saveError(it.key(), error);
+            file.remove();
+            continue;
+        }
+        synced.append(it.key());
+    }
+
+    QHash<QString, QStringList> renamed;   // directory -> files
+    for (const QString &filename : std::as_const(synced)) {
+        const QString path = getFilePath(filename);
+        const QByteArray target = QFile::encodeName(path);
+        if (::rename((target + ".tmp").constData(), target.constData()) != 0) {
+            emit saveError(filename, QString::fromLocal8Bit(strerror(errno)));
+            QFile::remove(path + ".tmp");
+            continue;
+        }
+        renamed[QFileInfo(path).absolutePath()].append(filename);
+    }
+
+    QSet<QString> written;
+    for (auto it = renamed.cbegin(); it != renamed.cend(); ++it) {
+        QString error;
+        if (!syncDirectory(it.key(), &error)) {
+            for (const QString &filename : it.value()) {
+                emit saveError(filename, error);
+            }
+            continue;
+        }
+        for (const QString &filename : it.value()) {
+            written.insert(filename);
+        }
+    }
+    return written;
+}
+
+// Safe to call from the worker thread: touches only the file and signals
+bool StorageService::readFromDisk(const QString &filename, QByteArray *data) {
     QFile file(getFilePath(filename));
     if (!file.exists()) {
-        return QJsonObject();
+        return false;
     }
 
     if (!file.open(QIODevice::ReadOnly)) {
         emit loadError(filename, file.errorString());
-        return QJsonObject();
+        return false;
     }
 
-    QByteArray data = file.readAll();
+    *data = file.readAll();
     file.close();
+    return true;
+}
 
+bool StorageService::parseDocument(const QString &filename, const QByteArray &data, QJsonDocument *doc) {
     QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    *doc = QJsonDocument::fromJson(data, &error);
 
     if (error.error != QJsonParseError::NoError) {
         emit loadError(filename, error.errorString());
-        return QJsonObject();
+        *doc = QJsonDocument();
+        return false;
     }
-
-    return doc.object();
+    return true;
 }
 
-QJsonArray StorageService::loadJsonArray(const QString &filename) {
-    QFile file(getFilePath(filename));
-    if (!file.exists()) {
-        return QJsonArray();
+QJsonObject StorageService::loadJson(const QString &filename) {
+    QJsonDocument doc;
+    if (queuedDocument(filename, &doc)) {
+        return doc.object();
     }
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        emit loadError(filename, file.errorString());
-        return QJsonArray();
+    QByteArray data;
+    if (!readFromDisk(filename, &data) || !parseDocument(filename, data, &doc)) {
+        return QJsonObject();
     }
+    return doc.object();
+}
 
-    QByteArray data = file.readAll();
-    file.close();
-
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+QJsonArray StorageService::loadJsonArray(const QString &filename) {
+    QJsonDocument doc;
+    if (queuedDocument(filename, &doc)) {
+        return doc.array();
+    }
 
-    if (error.error != QJsonParseError::NoError) {
-        emit loadError(filename, error.errorString());
+    QByteArray data;
+    if (!readFromDisk(filename, &data) || !parseDocument(filename, data, &doc)) {
         return QJsonArray();
     }
-
     return doc.array();
 }
 
 bool StorageService::deleteFile(const QString &filename) {
-    QFile file(getFilePath(filename));
-    if (file.exists()) {
-        return file.remove();
-    }
-    return true;
+    return replaceQueued(filename, [&]() {
+        QFile file(getFilePath(filename));
+        if (file.exists()) {
+            return file.remove();
+        }
+        return true;
+    });
 }
 
 bool StorageService::fileExists(const QString &filename) {
-    return QFile::exists(getFilePath(filename));
+    QJsonDocument queued;
+    return queuedDocument(filename, &queued) || QFile::exists(getFilePath(filename));
 }
 
 void StorageService::saveSetting(const QString &key, const QVariant &value) {
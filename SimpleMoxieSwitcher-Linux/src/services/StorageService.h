@@ -6,16 +6,28 @@
 #include <QJsonArray>
 #include <QDir>
 #include <QStandardPaths>
+#include <QHash>
+#include <QSet>
+#include <QFuture>
+#include <QPromise>
+#include <functional>
+#include <memory>
+#include <type_traits>
 
 namespace SimpleMoxieSwitcher {
 
+class StorageWorker;
+
 class StorageService : public QObject {
     Q_OBJECT
 
 public:
     explicit StorageService(QObject *parent = nullptr);
+    ~StorageService() override;
 
-    // Generic JSON storage
+    // Generic JSON storage. Saves are atomic (temp file, fsync, rename), so a
+    // crash leaves either the old file or the new one. Saves and deletes
+    // replace any async save of the same file that has not been written yet.
     Q_INVOKABLE bool saveJson(const QString &filename, const QJsonObject &data);
     Q_INVOKABLE bool saveJsonArray(const QString &filename, const QJsonArray &data);
     Q_INVOKABLE QJsonObject loadJson(const QString &filename);
@@ -23,6 +35,35 @@ public:
     Q_INVOKABLE bool deleteFile(const QString &filename);
     Q_INVOKABLE bool fileExists(const QString &filename);
 
+    // Same as above, but disk access and (de)serialization run on a
+    // dedicated I/O thread. Queued saves of one file collapse into the
+    // latest, and every caller's future reports that write. Saves waiting in
+    // the queue are committed as a group: one fsync per file plus one per
+    // directory, however many calls they absorbed. Loads, sync or async, see
+    // saves that are still queued. The queue is bounded and callers never
+    // wait for room: once that many distinct files are waiting, a new save
+    // reports false (and saveError) and a new load an empty document.
+    QFuture<bool> saveJsonAsync(const QString &filename, const QJsonObject &data);
+    QFuture<bool> saveJsonArrayAsync(const QString &filename, const QJsonArray &data);
+    QFuture<QJsonObject> loadJsonAsync(const QString &filename);
+    QFuture<QJsonArray> loadJsonArrayAsync(const QString &filename);
+
+    // Runs work on the I/O thread, in order with the queued saves and loads,
+    // for reads too slow for the GUI thread (indexing a long conversation,
+    // loading usage history). work must only touch what it captures.
+    template <typename Work>
+    QFuture<std::invoke_result_t<Work>> runAsync(Work work) {
+        using Result = std::invoke_result_t<Work>;
+        auto promise = std::make_shared<QPromise<Result>>();
+        promise->start();
+        QFuture<Result> future = promise->future();
+        post([promise, work = std::move(work)]() mutable {
+            promise->addResult(work());
+            promise->finish();
+        });
+        return future;
+    }
+
     // Settings
     Q_INVOKABLE void saveSetting(const QString &key, const QVariant &value);
     Q_INVOKABLE QVariant loadSetting(const QString &key, const QVariant &defaultValue = QVariant());
@@ -35,10 +76,23 @@ signals:
     void loadError(const QString &filename, const QString &error);
 
 private:
+    friend class StorageWorker;
+
     QString getFilePath(const QString &filename) const;
     void ensureDirectoryExists();
+    bool replaceQueued(const QString &filename, const std::function<bool()> &write);
+    bool writeAtomically(const QString &filename, const QByteArray &data);
+    QSet<QString> commitGroup(const QHash<QString, QByteArray> &files);
+    bool readFromDisk(const QString &filename, QByteArray *data);
+    bool parseDocument(const QString &filename, const QByteArray &data, QJsonDocument *doc);
+    bool queuedDocument(const QString &filename, QJsonDocument *doc) const;
+    StorageWorker *worker();
+    void post(std::function<void()> task);
 
     QString m_dataPath;
+
+    // Started on the first async call
+    std::unique_ptr<StorageWorker> m_worker;
 };
 
 } // namespace SimpleMoxieSwitcher
@@ -0,0 +1,104 @@
+#include "UsageAggregates.h"
+
+void UsageAggregates::Counter::add(const QString &key) {
+    int count = ++m_counts[key];
+    if (m_stale) {
+        return;
+    }
+    if (count > m_leaderCount || (count == m_leaderCount && key < m_leader)) {
+        m_leader = key;
+        m_leaderCount = count;
+    }
+}
+
+void UsageAggregates::Counter::remove(const QString &key) {
+    auto it = m_counts.find(key);
+    if (it == m_counts.end()) {
+        return;
+    }
+    if (--it.value() == 0) {
+        m_counts.erase(it);
+    }
+    // Someone else may now be ahead; recount lazily on the next read
+    if (key == m_leader) {
+        m_stale = true;
+    }
+}
+
+void UsageAggregates::Counter::clear() {
+    m_counts.clear();
+    m_leader.clear();
+    m_leaderCount = 0;
+    m_stale = false;
+}
+
+QString UsageAggregates::Counter::leader() const {
+    if (m_stale) {
+        m_leader.clear();
+        m_leaderCount = 0;
+        for (auto it = m_counts.cbegin(); it != m_counts.cend(); ++it) {
+            if (it.value() > m_leaderCount || (it.value() == m_leaderCount && it.key() < m_leader)) {
+                m_leader = it.key();
+                m_leaderCount = it.value();
+            }
+        }
+        m_stale = false;
+    }
+    return m_leader;
+}
+
+void UsageAggregates::add(const UsageRecord &record) {
+    DayBucket &bucket = m_days[record.timestamp.date()];
+    bucket.cost += record.estimatedCost;
+    bucket.tokens += record.tokensUsed;
+    ++bucket.records;
+
+    ++m_sessions[record.sessionId];
+    m_models.add(record.aiModel);
+    m_children.add(record.childProfileId);
+    m_totalTokens += record.tokensUsed;
+    ++m_recordCount;
+}
+
+void UsageAggregates::remove(const UsageRecord &record) {
+    auto day = m_days.find(record.timestamp.date());
+    if (day != m_days.end()) {
+        day->cost -= record.estimatedCost;
+        day->tokens -= record.tokensUsed;
+        // Dropping empty days also drops any floating point residue
+        if (--day->records == 0) {
+            m_days.erase(day);
+        }
+    }
+
+    auto session = m_sessions.find(record.sessionId);
+    if (session != m_sessions.end() && --session.value() == 0) {
+        m_sessions.erase(session);
+    }
+    m_models.remove(record.aiModel);
+    m_children.remove(record.childProfileId);
+    m_totalTokens -= record.tokensUsed;
+    --m_recordCount;
+}
+
+void UsageAggregates::clear() {
+    m_days.clear();
+    m_sessions.clear();
+    m_models.clear();
+    m_children.clear();
+    m_totalTokens = 0;
+    m_recordCount = 0;
+}
+
+double UsageAggregates::costOn(const QDate &day) const {
+    auto it = m_days.constFind(day);
+    return it == m_days.cend() ? 0.0 : it->cost;
+}
+
+double UsageAggregates::costBetween(const QDate &first, const QDate &last) const {
+    double cost = 0.0;
+    for (QDate day = first; day <= last; day = day.addDays(1)) {
+        cost += costOn(day);
+    }
+    return cost;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <QDate>
+#include <QHash>
+#include <QString>
+#include "../models/UsageRecord.h"
+
+// Running usage statistics kept up to date as records are added and expired,
+// so reading any of them never walks the record list. Costs are bucketed by
+// local calendar day; window sums touch at most one bucket per day in the
+// window. Leaders (most used model, most active child) are tracked on insert
+// and only recounted, over distinct keys, when the leader loses a record.
+class UsageAggregates {
+public:
+    void add(const UsageRecord &record);
+    void remove(const UsageRecord &record);
+    void clear();
+
+    double costOn(const QDate &day) const;
+    // Inclusive on both ends
+    double costBetween(const QDate &first, const QDate &last) const;
+
+    qint64 totalTokens() const { return m_totalTokens; }
+    int recordCount() const { return m_recordCount; }
+    int sessionCount() const { return m_sessions.size(); }
+    QString mostUsedModel() const { return m_models.leader(); }
+    QString mostActiveChild() const { return m_children.leader(); }
+
+private:
+    struct DayBucket {
+        double cost = 0.0;
+        qint64 tokens = 0;
+        int records = 0;
+    };
+
+    // Occurrence counts with a cached arg-max; ties go to the smaller key
+    class Counter {
+    public:
+        void add(const QString &key);
+        void remove(const QString &key);
+        void clear();
+        QString leader() const;
+
+    private:
+        QHash<QString, int> m_counts;
+        mutable QString m_leader;
+        mutable int m_leaderCount = 0;
+        mutable bool m_stale = false;
+    };
+
+    QHash<QDate, DayBucket> m_days;
+    QHash<QString, int> m_sessions;     // records per session id
+    Counter m_models;
+    Counter m_children;
+    qint64 m_totalTokens = 0;
+    int m_recordCount = 0;
+};
@@ -0,0 +1,341 @@
+#include "UsageExporter.h"
+#include <QSaveFile>
+#include <QtEndian>
+#include <charconv>
+#include <iterator>
+
+namespace {
+
+constexpr int ChunkBytes = 64 * 1024;
+constexpr int FormatVersion = 1;
+
+// RFC 8746 typed array tags, little endian
+constexpr quint64 TagUint8 = 64;
+constexpr quint64 TagUint32LE = 70;
+constexpr quint64 TagInt32LE = 78;
+constexpr quint64 TagInt64LE = 79;
+constexpr quint64 TagFloat64LE = 86;
+
+void appendInt(QByteArray &out, qint64 value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+void appendDouble(QByteArray &out, double value) {
+    // Shortest text that reads back as the same double
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+void appendTwoDigits(QByteArray &out, int value) {
+    out.append(char('0' + value / 10));
+    out.append(char('0' + value % 10));
+}
+
+QByteArray csvField(const QString &text) {
+    QByteArray utf8 = text.toUtf8();
+    if (utf8.contains(',') || utf8.contains('"') || utf8.contains('\n')) {
+        utf8.replace("\"", "\"\"");
+        return '"' + utf8 + '"';
+    }
+    return utf8;
+}
+
+// Local date and hour for a one hour window of timestamps, so formatting a
+// row is integer arithmetic; QDateTime is consulted once per hour of data
+struct HourCache {
+    qint64 start = 0;
+    qint64 end = 0;
+    QByteArray date;
+    int hour = 0;
+
+    void cover(qint64 msecs) {
+        if (msecs >= start && msecs < end) {
+            return;
+        }
+        const QDateTime time = QDateTime::fromMSecsSinceEpoch(msecs);
+        const QTime clock = time.time();
+        start = msecs - (clock.minute() * 60000 + clock.second() * 1000 + clock.msec());
+        end = start + 60 * 60 * 1000;
+        date = time.date().toString(Qt::ISODate).toLatin1();
+        hour = clock.hour();
+    }
+};
+
+void cborHead(QByteArray &out, quint8 major, quint64 value) {
+    const char type = char(major << 5);
+    if (value < 24) {
+        out.append(char(type | value));
+    } else if (value <= 0xff) {
+        out.append(char(type | 24));
+        out.append(char(value));
+    } else if (value <= 0xffff) {
+        out.append(char(type | 25));
+        char bytes[2];
+        qToBigEndian(quint16(value), bytes);
+        out.append(bytes, 2);
+    } else if (value <= 0xffffffff) {
+        out.append(char(type | 26));
+        char bytes[4];
+        qToBigEndian(quint32(value), bytes);
+        out.append(bytes, 4);
+    } else {
+        out.append(char(type | 27));
+        char bytes[8];
+        qToBigEndian(value, bytes);
+        out.append(bytes, 8);
+    }
+}
+
+void cborText(QByteArray &out, const QString &text) {
+    const QByteArray utf8 = text.toUtf8();
+    cborHead(out, 3, utf8.size());
+    out.append(utf8);
+}
+
+template <typename T>
+void appendLittleEndian(QByteArray &out, T value) {
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+// Visits the view's rows in order with their partition and offset. Rows are
+// ascending, so the partition only ever moves forward.
+template <typename Visit>
+bool forEachRow(const UsageStore &store, const UsageView &view, Visit visit) {
+    const auto &partitions = store.partitions();
+    int p = 0;
+    for (int i = 0; i < view.size(); ++i) {
+        const int row = view.rowAt(i);
+        while (p + 1 < partitions.size() && store.partitionStart(p + 1) <= row) {
+            ++p;
+        }
+        if (!visit(i, partitions[p], row - store.partitionStart(p))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+UsageExporter::UsageExporter(QObject *parent)
+    : QObject(parent) {
+}
+
+UsageExporter::~UsageExporter() {
+    cancel();
+    if (m_thread) {
+        m_thread->wait();
+    }
+}
+
+bool UsageExporter::isRunning() const {
+    return m_thread && m_thread->isRunning();
+}
+
+void UsageExporter::cancel() {
+    m_cancel = true;
+}
+
+bool UsageExporter::start(Format format, const UsageStore &store, const UsageView::Filter &filter,
+                          const QString &path) {
+    if (isRunning()) {
+        return false;
+    }
+    if (m_thread) {
+        m_thread->wait();
+    }
+
+    m_cancel = false;
+    m_lastPercent = -1;
+    m_thread.reset(QThread::create([this, format, store, filter, path]() {
+        run(format, store, filter, path);
+    }));
+    m_thread->setObjectName("UsageExporter");
+    m_thread->start(QThread::LowPriority);
+    return true;
+}
+
+void UsageExporter::run(Format format, const UsageStore &store, const UsageView::Filter &filter,
+                        const QString &path) {
+    UsageView view(&store);
+    view.setFilter(filter);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit failed(file.errorString());
+        return;
+    }
+
+    bool ok = format == Format::Csv ? writeCsv(store, view, &file) : writeColumnar(store, view, &file);
+    if (m_cancel) {
+        file.cancelWriting();
+        file.commit();
+        emit canceled();
+    } else if (!ok || !file.commit()) {
+        emit failed(file.errorString());
+    } else {
+        emit finished(path);
+    }
+}
+
+bool UsageExporter::writeChunk(QSaveFile *file, QByteArray *buffer, bool force) {
+    if (!force && buffer->size() < ChunkBytes) {
+        return true;
+    }
+    if (file->write(*buffer) != buffer->size()) {
+        return false;
+    }
+    buffer->clear();
+    return !m_cancel;
+}
+
+void UsageExporter::reportProgress(qint64 done, qint64 total) {
+    int percent = total > 0 ? int(done * 100 / total) : 100;
+    if (percent != m_lastPercent) {
+        m_lastPercent = percent;
+        emit progress(percent / 100.0);
+    }
+}
+
+bool UsageExporter::writeCsv(const UsageStore &store, const UsageView &view, QSaveFile *file) {
+    QByteArray buffer;
+    buffer.reserve(ChunkBytes + 1024);
+    buffer.append("Date,Time,Child,Feature,Model,Tokens,Cost,Duration\n");
+
+    // Each distinct string is escaped and encoded once
+    QHash<quint32, QByteArray> fields;
+    auto field = [&](quint32 code) -> const QByteArray & {
+        auto it = fields.find(code);
+        if (it == fields.end()) {
+            it = fields.insert(code, csvField(store.string(code)));
+        }
+        return it.value();
+    };
+
+    HourCache hours;
+    const int total = view.size();
+    bool ok = forEachRow(store, view, [&](int i, const UsageStore::Partition &part, int offset) {
+        const qint64 msecs = part.timestamps[offset];
+        hours.cover(msecs);
+        const int seconds = int((msecs - hours.start) / 1000);
+
+        buffer.append(hours.date);
+        buffer.append(',');
+        appendTwoDigits(buffer, hours.hour);
+        buffer.append(':');
+        appendTwoDigits(buffer, seconds / 60);
+        buffer.append(':');
+        appendTwoDigits(buffer, seconds % 60);
+        buffer.append(',');
+        buffer.append(field(part.children[offset]));
+        buffer.append(',');
+        buffer.append(field(part.features[offset]));
+        buffer.append(',');
+        buffer.append(field(part.models[offset]));
+        buffer.append(',');
+        appendInt(buffer, part.tokens[offset]);
+        buffer.append(',');
+        appendDouble(buffer, part.costs[offset]);
+        buffer.append(',');
+        appendInt(buffer, part.durations[offset]);
+        buffer.append('\n');
+
+        if (buffer.size() >= ChunkBytes) {
+            reportProgress(i, total);
+            return writeChunk(file, &buffer);
+        }
+        return true;
+    });
+
+    ok = ok && writeChunk(file, &buffer, true);
+    if (ok) {
+        reportProgress(total, total);
+    }
+    return ok;
+}
+
+bool UsageExporter::writeColumnar(const UsageStore &store, const UsageView &view, QSaveFile *file) {
+    const qint64 rows = view.size();
+    QByteArray buffer;
+    buffer.reserve(ChunkBytes + 1024);
+
+    // Header: format, version, row count and the string dictionary
+    cborHead(buffer, 5, 5);
+    cborText(buffer, QStringLiteral("format"));
+    cborText(buffer, QStringLiteral("moxie-usage-columns"));
+    cborText(buffer, QStringLiteral("version"));
+    cborHead(buffer, 0, FormatVersion);
+    cborText(buffer, QStringLiteral("rows"));
+    cborHead(buffer, 0, rows);
+
+    cborText(buffer, QStringLiteral("strings"));
+    const int dictionarySize = store.stringCount();
+    cborHead(buffer, 4, dictionarySize);
+    for (int code = 0; code < dictionarySize; ++code) {
+        cborText(buffer, store.string(code));
+        if (!writeChunk(file, &buffer)) {
+            return false;
+        }
+    }
+
+    // Columns: each a tagged byte string of fixed-width little endian values
+    struct Column {
+        const char *name;
+        quint64 tag;
+        int width;
+        void (*append)(QByteArray &, const UsageStore::Partition &, int);
+    };
+    const Column columns[] = {
+        {"timestamp", TagInt64LE, 8, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<qint64>(out, part.timestamps[offset]); }},
+        {"child", TagUint32LE, 4, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<quint32>(out, part.children[offset]); }},
+        {"feature", TagUint32LE, 4, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<quint32>(out, part.features[offset]); }},
+        {"model", TagUint32LE, 4, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<quint32>(out, part.models[offset]); }},
+        {"session", TagUint32LE, 4, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<quint32>(out, part.sessions[offset]); }},
+        {"tokens", TagInt32LE, 4, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<qint32>(out, part.tokens[offset]); }},
+        {"cost", TagFloat64LE, 8, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<double>(out, part.costs[offset]); }},
+        {"duration", TagInt32LE, 4, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             appendLittleEndian<qint32>(out, part.durations[offset]); }},
+        {"successful", TagUint8, 1, [](QByteArray &out, const UsageStore::Partition &part, int offset) {
+             out.append(char(part.successful[offset] ? 1 : 0)); }},
+    };
+    const qint64 work = rows * qint64(std::size(columns));
+
+    cborText(buffer, QStringLiteral("columns"));
+    cborHead(buffer, 5, std::size(columns));
+    qint64 done = 0;
+    for (const Column &column : columns) {
+        cborText(buffer, QString::fromLatin1(column.name));
+        cborHead(buffer, 6, column.tag);
+        cborHead(buffer, 2, quint64(rows) * column.width);
+        bool ok = forEachRow(store, view, [&](int, const UsageStore::Partition &part, int offset) {
+            column.append(buffer, part, offset);
+            ++done;
+            if (buffer.size() >= ChunkBytes) {
+                reportProgress(done, work);
+                return writeChunk(file, &buffer);
+            }
+            return true;
+        });
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (!writeChunk(file, &buffer, true)) {
+        return false;
+    }
+    reportProgress(work, work);
+    return true;
+}
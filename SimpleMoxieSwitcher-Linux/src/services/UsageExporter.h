@@ -0,0 +1,51 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include "UsageStore.h"
+#include "UsageView.h"
+
+class QSaveFile;
+
+// Writes usage rows to a file on a worker thread. start() takes a snapshot
+// of the store (columns are implicitly shared, so this is cheap and later
+// inserts don't disturb it) and the filter to export. Rows are formatted
+// straight from the columns into 64 KB chunks. Progress is reported as the
+// chunks go out, and a canceled export leaves no file behind.
+//
+// Csv is the familiar spreadsheet layout. Columnar is a CBOR document with
+// one typed array (RFC 8746) per column plus the string dictionary, for
+// loading into analysis tools without parsing text.
+class UsageExporter : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Format { Csv, Columnar };
+
+    explicit UsageExporter(QObject *parent = nullptr);
+    ~UsageExporter() override;
+
+    // False if an export is already running
+    bool start(Format format, const UsageStore &store, const UsageView::Filter &filter, const QString &path);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void progress(double fraction);
+    void finished(const QString &path);
+    void failed(const QString &error);
+    void canceled();
+
+private:
+    void run(Format format, const UsageStore &store, const UsageView::Filter &filter, const QString &path);
+    bool writeCsv(const UsageStore &store, const UsageView &view, QSaveFile *file);
+    bool writeColumnar(const UsageStore &store, const UsageView &view, QSaveFile *file);
+    bool writeChunk(QSaveFile *file, QByteArray *buffer, bool force = false);
+    void reportProgress(qint64 done, qint64 total);
+
+    std::unique_ptr<QThread> m_thread;
+    std::atomic_bool m_cancel{false};
+    int m_lastPercent = -1;
+};
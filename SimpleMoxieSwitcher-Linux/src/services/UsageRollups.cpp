@@ -0,0 +1,113 @@
+#include "UsageRollups.h"
+
+QDateTime UsageRollups::bucketStart(Resolution resolution, const QDateTime &time) {
+    const QDate date = time.date();
+    switch (resolution) {
+    case Hour:
+        return QDateTime(date, QTime(time.time().hour(), 0));
+    case Day:
+        return date.startOfDay();
+    case Week:
+        return date.addDays(1 - date.dayOfWeek()).startOfDay();   // Monday
+    }
+    return QDateTime();
+}
+
+QDateTime UsageRollups::nextBucket(Resolution resolution, const QDateTime &start) {
+    switch (resolution) {
+    case Hour:
+        return start.addSecs(60 * 60);
+    case Day:
+        return start.date().addDays(1).startOfDay();
+    case Week:
+        return start.date().addDays(7).startOfDay();
+    }
+    return QDateTime();
+}
+
+void UsageRollups::accumulate(Resolution resolution, const QDateTime &start, const QString &model,
+                              const QString &childProfileId, qint64 tokens, double cost, int requests) {
+    const qint64 key = start.toMSecsSinceEpoch();
+    auto apply = [=](Series &series) {
+        Bucket &bucket = series[key];
+        bucket.tokens += tokens;
+        bucket.cost += cost;
+        bucket.requests += requests;
+        if (bucket.requests <= 0) {
+            series.remove(key);
+        }
+    };
+
+    Level &level = m_levels[resolution];
+    apply(level.total);
+    apply(level.byModel[model]);
+    apply(level.byChild[childProfileId]);
+}
+
+void UsageRollups::add(const UsageRecord &record) {
+    for (Resolution resolution : {Hour, Day, Week}) {
+        accumulate(resolution, bucketStart(resolution, record.timestamp), record.aiModel,
+                   record.childProfileId, record.tokensUsed, record.estimatedCost, 1);
+    }
+}
+
+void UsageRollups::addDaily(const QDate &day, const QString &model, const QString &childProfileId,
+                            qint64 tokens, double cost, int requests) {
+    const QDateTime start = day.startOfDay();
+    accumulate(Day, start, model, childProfileId, tokens, cost, requests);
+    accumulate(Week, bucketStart(Week, start), model, childProfileId, tokens, cost, requests);
+}
+
+void UsageRollups::removeHourly(const UsageRecord &record) {
+    accumulate(Hour, bucketStart(Hour, record.timestamp), record.aiModel, record.childProfileId,
+               -record.tokensUsed, -record.estimatedCost, -1);
+}
+
+void UsageRollups::clear() {
+    for (Level &level : m_levels) {
+        level = Level();
+    }
+}
+
+QStringList UsageRollups::keys(GroupBy groupBy) const {
+    const Level &level = m_levels[Day];
+    QStringList result = groupBy == ByModel ? level.byModel.keys()
+                       : groupBy == ByChild ? level.byChild.keys()
+                                            : QStringList();
+    result.sort();
+    return result;
+}
+
+QList<QPointF> UsageRollups::series(Resolution resolution, Metric metric, GroupBy groupBy, const QString &key,
+                                    const QDateTime &from, const QDateTime &to) const {
+    static const Series none;
+    const Level &level = m_levels[resolution];
+    const Series &series = groupBy == ByModel ? level.byModel.value(key, none)
+                         : groupBy == ByChild ? level.byChild.value(key, none)
+                                              : level.total;
+
+    QList<QPointF> points;
+    if (series.isEmpty() && (!from.isValid() || !to.isValid())) {
+        return points;
+    }
+
+    QDateTime bucket = bucketStart(resolution, from.isValid() ? from
+                                                              : QDateTime::fromMSecsSinceEpoch(series.firstKey()));
+    const qint64 last = to.isValid() ? to.toMSecsSinceEpoch() : series.lastKey();
+
+    // Walk buckets and the map together; empty buckets read as zero
+    auto it = series.lowerBound(bucket.toMSecsSinceEpoch());
+    for (; bucket.toMSecsSinceEpoch() <= last; bucket = nextBucket(resolution, bucket)) {
+        const qint64 x = bucket.toMSecsSinceEpoch();
+        double y = 0.0;
+        while (it != series.cend() && it.key() < x) {
+            ++it;
+        }
+        if (it != series.cend() && it.key() == x) {
+            y = metric == Tokens ? double(it->tokens) : metric == Cost ? it->cost : double(it->requests);
+            ++it;
+        }
+        points.append(QPointF(double(x), y));
+    }
+    return points;
+}
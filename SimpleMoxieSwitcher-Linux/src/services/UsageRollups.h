@@ -0,0 +1,55 @@
+#pragma once
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPointF>
+#include <QStringList>
+#include "../models/UsageRecord.h"
+
+// Pre-aggregated usage time series at hour, day and week resolution, overall
+// and per model and per child. Buckets are updated as records arrive, so a
+// chart reads one value per bucket instead of walking history. Hourly buckets
+// cover the raw records in memory; day and week buckets also take the daily
+// totals that older records were rolled into, so they reach back further.
+class UsageRollups {
+public:
+    enum Resolution { Hour, Day, Week };
+    enum Metric { Tokens, Cost, Requests };
+    enum GroupBy { Total, ByModel, ByChild };
+
+    void add(const UsageRecord &record);
+    void addDaily(const QDate &day, const QString &model, const QString &childProfileId,
+                  qint64 tokens, double cost, int requests);
+    // For records leaving memory whose day totals live on in the database
+    void removeHourly(const UsageRecord &record);
+    void clear();
+
+    // One point per bucket from from to to, with empty buckets as zero; x is
+    // the bucket start in ms since epoch. Invalid bounds mean the data's extent.
+    QList<QPointF> series(Resolution resolution, Metric metric, GroupBy groupBy, const QString &key,
+                          const QDateTime &from = QDateTime(), const QDateTime &to = QDateTime()) const;
+    QStringList keys(GroupBy groupBy) const;
+
+    static QDateTime bucketStart(Resolution resolution, const QDateTime &time);
+
+private:
+    struct Bucket {
+        qint64 tokens = 0;
+        double cost = 0.0;
+        int requests = 0;
+    };
+    using Series = QMap<qint64, Bucket>;    // bucket start (ms) -> totals
+
+    struct Level {
+        Series total;
+        QHash<QString, Series> byModel;
+        QHash<QString, Series> byChild;
+    };
+
+    void accumulate(Resolution resolution, const QDateTime &start, const QString &model,
+                    const QString &childProfileId, qint64 tokens, double cost, int requests);
+    static QDateTime nextBucket(Resolution resolution, const QDateTime &start);
+
+    Level m_levels[3];
+};
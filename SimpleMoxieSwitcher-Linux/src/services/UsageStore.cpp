@@ -0,0 +1,250 @@
+#include "UsageStore.h"
+#include <algorithm>
+
+namespace {
+
+// Re-keys a sparse per-offset table after rows were inserted or removed at offset
+void shiftOffsets(QHash<int, QString> &table, int offset, int delta) {
+    if (table.isEmpty()) {
+        return;
+    }
+    QHash<int, QString> shifted;
+    for (auto it = table.cbegin(); it != table.cend(); ++it) {
+        if (it.key() < offset) {
+            if (delta > 0) {
+                shifted.insert(it.key(), it.value());
+            }
+            // else the row was removed
+        } else {
+            shifted.insert(it.key() + delta, it.value());
+        }
+    }
+    table = shifted;
+}
+
+} // namespace
+
+void UsageStore::clear() {
+    m_codes.clear();
+    m_strings.clear();
+    m_partitions.clear();
+    m_starts.clear();
+    m_childPostings.clear();
+    m_modelPostings.clear();
+    m_size = 0;
+}
+
+void UsageStore::addPosting(QHash<quint32, QList<int>> &postings, quint32 code, int row, bool append) {
+    QList<int> &rows = postings[code];
+    if (append) {
+        rows.append(row);
+    } else {
+        rows.insert(std::lower_bound(rows.begin(), rows.end(), row) - rows.begin(), row);
+    }
+}
+
+quint32 UsageStore::intern(const QString &string) {
+    auto it = m_codes.constFind(string);
+    if (it != m_codes.cend()) {
+        return it.value();
+    }
+    quint32 code = m_strings.size();
+    m_strings.append(string);
+    m_codes.insert(string, code);
+    return code;
+}
+
+int UsageStore::partitionFor(const QDate &day) {
+    // The common case: today's partition, or a new day
+    if (!m_partitions.isEmpty() && m_partitions.last().day == day) {
+        return m_partitions.size() - 1;
+    }
+    if (m_partitions.isEmpty() || m_partitions.last().day < day) {
+        m_partitions.append(Partition{day});
+        m_starts.append(m_size);
+        return m_partitions.size() - 1;
+    }
+
+    auto it = std::lower_bound(m_partitions.begin(), m_partitions.end(), day,
+                               [](const Partition &partition, const QDate &d) { return partition.day < d; });
+    int index = it - m_partitions.begin();
+    if (it->day != day) {
+        m_partitions.insert(index, Partition{day});
+        m_starts.insert(index, m_starts.at(index));
+    }
+    return index;
+}
+
+void UsageStore::updateStarts(int fromPartition) {
+    for (int i = qMax(1, fromPartition); i < m_partitions.size(); ++i) {
+        m_starts[i] = m_starts[i - 1] + m_partitions[i - 1].size();
+    }
+}
+
+int UsageStore::insert(const UsageRecord &record) {
+    const qint64 msecs = record.timestamp.toMSecsSinceEpoch();
+    const int index = partitionFor(record.timestamp.date());
+    Partition &part = m_partitions[index];
+
+    int offset = part.size();
+    if (offset > 0 && part.timestamps.last() > msecs) {
+        offset = std::upper_bound(part.timestamps.begin(), part.timestamps.end(), msecs)
+            - part.timestamps.begin();
+        shiftOffsets(part.ids, offset, 1);
+        shiftOffsets(part.errors, offset, 1);
+    }
+
+    part.timestamps.insert(offset, msecs);
+    part.children.insert(offset, intern(record.childProfileId));
+    part.features.insert(offset, intern(record.feature));
+    part.models.insert(offset, intern(record.aiModel));
+    part.sessions.insert(offset, intern(record.sessionId));
+    part.tokens.insert(offset, record.tokensUsed);
+    part.durations.insert(offset, record.durationSeconds);
+    part.costs.insert(offset, record.estimatedCost);
+    part.successful.insert(offset, record.wasSuccessful);
+    if (!record.id.isEmpty()) {
+        part.ids.insert(offset, record.id);
+    }
+    if (!record.errorMessage.isEmpty()) {
+        part.errors.insert(offset, record.errorMessage);
+    }
+
+    ++m_size;
+    updateStarts(index + 1);
+    const int row = m_starts.at(index) + offset;
+
+    // Backdated: every posting after the new row moves down by one
+    const bool append = row == m_size - 1;
+    if (!append) {
+        for (auto *postings : {&m_childPostings, &m_modelPostings}) {
+            for (QList<int> &rows : *postings) {
+                for (auto it = std::lower_bound(rows.begin(), rows.end(), row); it != rows.end(); ++it) {
+                    ++*it;
+                }
+            }
+        }
+    }
+    addPosting(m_childPostings, part.children.at(offset), row, append);
+    addPosting(m_modelPostings, part.models.at(offset), row, append);
+    return row;
+}
+
+int UsageStore::removeBefore(const QDateTime &cutoff) {
+    const qint64 msecs = cutoff.toMSecsSinceEpoch();
+    int removed = 0;
+
+    // Whole days go at once
+    int whole = 0;
+    while (whole < m_partitions.size() && m_partitions[whole].timestamps.last() < msecs) {
+        removed += m_partitions[whole].size();
+        ++whole;
+    }
+    m_partitions.remove(0, whole);
+    m_starts.remove(0, whole);
+
+    // Then the head of the day the cutoff falls in
+    if (!m_partitions.isEmpty()) {
+        Partition &part = m_partitions.first();
+        int count = std::lower_bound(part.timestamps.begin(), part.timestamps.end(), msecs)
+            - part.timestamps.begin();
+        if (count > 0) {
+            part.timestamps.remove(0, count);
+            part.children.remove(0, count);
+            part.features.remove(0, count);
+            part.models.remove(0, count);
+            part.sessions.remove(0, count);
+            part.tokens.remove(0, count);
+            part.durations.remove(0, count);
+            part.costs.remove(0, count);
+            part.successful.remove(0, count);
+            shiftOffsets(part.ids, count, -count);
+            shiftOffsets(part.errors, count, -count);
+            removed += count;
+        }
+        m_starts[0] = 0;
+        updateStarts(1);
+    }
+
+    m_size -= removed;
+
+    if (removed > 0) {
+        for (auto *postings : {&m_childPostings, &m_modelPostings}) {
+            for (auto it = postings->begin(); it != postings->end();) {
+                QList<int> &rows = it.value();
+                rows.remove(0, std::lower_bound(rows.begin(), rows.end(), removed) - rows.begin());
+                for (int &row : rows) {
+                    row -= removed;
+                }
+                it = rows.isEmpty() ? postings->erase(it) : std::next(it);
+            }
+        }
+    }
+    return removed;
+}
+
+int UsageStore::partitionOf(int row) const {
+    return std::upper_bound(m_starts.begin(), m_starts.end(), row) - m_starts.begin() - 1;
+}
+
+UsageRecord UsageStore::at(int row) const {
+    UsageRecord record;
+    if (row < 0 || row >= m_size) {
+        return record;
+    }
+    const int index = partitionOf(row);
+    const Partition &part = m_partitions.at(index);
+    const int offset = row - m_starts.at(index);
+
+    record.id = part.ids.value(offset);
+    record.childProfileId = m_strings.at(part.children.at(offset));
+    record.feature = m_strings.at(part.features.at(offset));
+    record.aiModel = m_strings.at(part.models.at(offset));
+    record.tokensUsed = part.tokens.at(offset);
+    record.estimatedCost = part.costs.at(offset);
+    record.timestamp = QDateTime::fromMSecsSinceEpoch(part.timestamps.at(offset));
+    record.durationSeconds = part.durations.at(offset);
+    record.sessionId = m_strings.at(part.sessions.at(offset));
+    record.wasSuccessful = part.successful.at(offset);
+    record.errorMessage = part.errors.value(offset);
+    return record;
+}
+
+qint64 UsageStore::timestampAt(int row) const {
+    const int index = partitionOf(row);
+    return m_partitions.at(index).timestamps.at(row - m_starts.at(index));
+}
+
+quint32 UsageStore::childCodeAt(int row) const {
+    const int index = partitionOf(row);
+    return m_partitions.at(index).children.at(row - m_starts.at(index));
+}
+
+quint32 UsageStore::modelCodeAt(int row) const {
+    const int index = partitionOf(row);
+    return m_partitions.at(index).models.at(row - m_starts.at(index));
+}
+
+const QList<int> &UsageStore::childRows(quint32 code) const {
+    static const QList<int> none;
+    auto it = m_childPostings.constFind(code);
+    return it == m_childPostings.cend() ? none : it.value();
+}
+
+const QList<int> &UsageStore::modelRows(quint32 code) const {
+    static const QList<int> none;
+    auto it = m_modelPostings.constFind(code);
+    return it == m_modelPostings.cend() ? none : it.value();
+}
+
+int UsageStore::lowerBound(qint64 msecs) const {
+    // Partitions are never empty, so each one's last timestamp bounds it
+    auto it = std::partition_point(m_partitions.begin(), m_partitions.end(),
+                                   [msecs](const Partition &part) { return part.timestamps.last() < msecs; });
+    if (it == m_partitions.end()) {
+        return m_size;
+    }
+    const int index = it - m_partitions.begin();
+    return m_starts.at(index)
+        + int(std::lower_bound(it->timestamps.begin(), it->timestamps.end(), msecs) - it->timestamps.begin());
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <QDate>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include "../models/UsageRecord.h"
+
+// In-memory usage records laid out by column and partitioned by local
+// calendar day. Strings that repeat (child, feature, model, session) are
+// interned once and stored as 32-bit codes; numbers and timestamps sit in
+// packed arrays. Record ids and error messages are rarely set and live in
+// sparse side tables. A record costs 41 bytes of columns and 8 in the child
+// and model posting lists, plus list growth slack and its share of the
+// dictionary (mostly session ids), instead of a UsageRecord with six QStrings
+// and a QDateTime. "moxie_bench store" measures both.
+//
+// Rows are numbered globally in timestamp order across partitions, so a time
+// range is a contiguous run of rows found by binary search. Each child and
+// model also has a posting list of its rows, ascending, for filtered views.
+// Appending the newest record is O(1); an older one is inserted in place and
+// renumbers the rows after it, as does expiry.
+class UsageStore {
+public:
+    static constexpr quint32 NoCode = 0xFFFFFFFF;
+
+    struct Partition {
+        QDate day;
+        QList<qint64> timestamps;       // ms since epoch, ascending
+        QList<quint32> children;
+        QList<quint32> features;
+        QList<quint32> models;
+        QList<quint32> sessions;
+        QList<qint32> tokens;
+        QList<qint32> durations;
+        QList<double> costs;
+        QList<bool> successful;
+        QHash<int, QString> ids;        // by offset, only when set
+        QHash<int, QString> errors;
+
+        int size() const { return timestamps.size(); }
+    };
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    void clear();
+
+    // Returns the global row the record landed on
+    int insert(const UsageRecord &record);
+
+    // Drops every record older than cutoff; returns how many went
+    int removeBefore(const QDateTime &cutoff);
+
+    UsageRecord at(int row) const;
+    qint64 timestampAt(int row) const;
+    quint32 childCodeAt(int row) const;
+    quint32 modelCodeAt(int row) const;
+
+    // Ascending rows holding a given child or model code
+    const QList<int> &childRows(quint32 code) const;
+    const QList<int> &modelRows(quint32 code) const;
+
+    // First row at or after the given time
+    int lowerBound(qint64 msecs) const;
+    int lowerBound(const QDateTime &time) const { return lowerBound(time.toMSecsSinceEpoch()); }
+
+    // Dictionary lookups; NoCode if the string never occurred
+    quint32 code(const QString &string) const { return m_codes.value(string, NoCode); }
+    const QString &string(quint32 code) const { return m_strings.at(code); }
+    int stringCount() const { return m_strings.size(); }
+
+    // For column scans
+    const QList<Partition> &partitions() const { return m_partitions; }
+    int partitionStart(int partition) const { return m_starts.at(partition); }
+
+private:
+    quint32 intern(const QString &string);
+    int partitionOf(int row) const;
+    int partitionFor(const QDate &day);
+    void updateStarts(int fromPartition);
+    static void addPosting(QHash<quint32, QList<int>> &postings, quint32 code, int row, bool append);
+
+    QHash<QString, quint32> m_codes;
+    QStringList m_strings;
+
+    QList<Partition> m_partitions;      // ascending by day
+    QList<int> m_starts;                // global row of each partition's first record
+    QHash<quint32, QList<int>> m_childPostings;
+    QHash<quint32, QList<int>> m_modelPostings;
+    int m_size = 0;
+};
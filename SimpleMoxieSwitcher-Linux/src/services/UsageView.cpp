@@ -0,0 +1,129 @@
+#include "UsageView.h"
+#include "UsageStore.h"
+#include <algorithm>
+
+UsageView::UsageView(const UsageStore *store)
+    : m_store(store) {
+    rebuild();
+}
+
+void UsageView::setFilter(const Filter &filter) {
+    m_filter = filter;
+    rebuild();
+}
+
+const QList<int> &UsageView::postings() const {
+    return m_kind == Kind::ChildPostings ? m_store->childRows(m_code) : m_store->modelRows(m_code);
+}
+
+void UsageView::rebuild() {
+    m_rows.clear();
+
+    const int first = m_filter.start.isValid() ? m_store->lowerBound(m_filter.start) : 0;
+    const int last = m_filter.end.isValid() ? m_store->lowerBound(m_filter.end.toMSecsSinceEpoch() + 1)
+                                            : m_store->size();
+
+    const bool byChild = !m_filter.childProfileId.isEmpty();
+    const bool byModel = !m_filter.aiModel.isEmpty();
+    const quint32 child = byChild ? m_store->code(m_filter.childProfileId) : UsageStore::NoCode;
+    const quint32 model = byModel ? m_store->code(m_filter.aiModel) : UsageStore::NoCode;
+
+    if (!byChild && !byModel) {
+        m_kind = Kind::Range;
+        m_first = first;
+        m_last = qMax(first, last);
+        return;
+    }
+
+    // A name that never occurred matches nothing until it does
+    if ((byChild && child == UsageStore::NoCode) || (byModel && model == UsageStore::NoCode)) {
+        m_kind = Kind::Rows;
+        return;
+    }
+
+    auto span = [first, last](const QList<int> &rows) {
+        auto begin = std::lower_bound(rows.begin(), rows.end(), first);
+        auto end = std::lower_bound(begin, rows.end(), last);
+        return std::make_pair(begin, end);
+    };
+
+    if (byChild != byModel) {
+        m_kind = byChild ? Kind::ChildPostings : Kind::ModelPostings;
+        m_code = byChild ? child : model;
+        const QList<int> &rows = postings();
+        auto [begin, end] = span(rows);
+        m_first = begin - rows.begin();
+        m_last = end - rows.begin();
+        return;
+    }
+
+    // Both: walk the shorter span and binary search the longer one
+    m_kind = Kind::Rows;
+    auto children = span(m_store->childRows(child));
+    auto models = span(m_store->modelRows(model));
+    if (children.second - children.first > models.second - models.first) {
+        std::swap(children, models);
+    }
+    for (auto it = children.first; it != children.second; ++it) {
+        if (std::binary_search(models.first, models.second, *it)) {
+            m_rows.append(*it);
+        }
+    }
+}
+
+int UsageView::size() const {
+    return m_kind == Kind::Rows ? m_rows.size() : m_last - m_first;
+}
+
+int UsageView::rowAt(int index) const {
+    switch (m_kind) {
+    case Kind::Range:
+        return m_first + index;
+    case Kind::ChildPostings:
+    case Kind::ModelPostings:
+        return postings().at(m_first + index);
+    case Kind::Rows:
+        return m_rows.at(index);
+    }
+    return -1;
+}
+
+int UsageView::countBefore(int storeRow) const {
+    switch (m_kind) {
+    case Kind::Range:
+        return qBound(0, storeRow - m_first, m_last - m_first);
+    case Kind::ChildPostings:
+    case Kind::ModelPostings: {
+        const QList<int> &rows = postings();
+        return std::lower_bound(rows.begin() + m_first, rows.begin() + m_last, storeRow)
+            - (rows.begin() + m_first);
+    }
+    case Kind::Rows:
+        return std::lower_bound(m_rows.begin(), m_rows.end(), storeRow) - m_rows.begin();
+    }
+    return 0;
+}
+
+bool UsageView::appendIfMatches(int storeRow) {
+    const qint64 time = m_store->timestampAt(storeRow);
+    if ((m_filter.start.isValid() && time < m_filter.start.toMSecsSinceEpoch())
+        || (m_filter.end.isValid() && time > m_filter.end.toMSecsSinceEpoch())) {
+        return false;
+    }
+    if (!m_filter.childProfileId.isEmpty()
+        && m_store->string(m_store->childCodeAt(storeRow)) != m_filter.childProfileId) {
+        return false;
+    }
+    if (!m_filter.aiModel.isEmpty()
+        && m_store->string(m_store->modelCodeAt(storeRow)) != m_filter.aiModel) {
+        return false;
+    }
+
+    // The row is the newest in the store, so it extends whatever span we hold
+    if (m_kind == Kind::Rows) {
+        m_rows.append(storeRow);
+    } else {
+        ++m_last;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+class UsageStore;
+
+// The rows of a UsageStore that pass a filter, without copying records. Any
+// combination of child, model and date range can be set. A date range alone
+// is just a span of store rows. A single child or model is a span of that
+// posting list, cut to the date range by binary search. Only a child and a
+// model together produce an explicit row list: the shorter posting span,
+// probed against the other one.
+//
+// The view has to be rebuilt after the store renumbers rows (expiry or a
+// backdated insert). The newest record is added with appendIfMatches().
+class UsageView {
+public:
+    struct Filter {
+        QString childProfileId;
+        QString aiModel;
+        QDateTime start;
+        QDateTime end;          // inclusive
+    };
+
+    explicit UsageView(const UsageStore *store);
+
+    const Filter &filter() const { return m_filter; }
+    void setFilter(const Filter &filter);
+    void rebuild();
+
+    int size() const;
+    int rowAt(int index) const;     // store row
+
+    // Visible rows whose store row is below storeRow
+    int countBefore(int storeRow) const;
+
+    // For the store's last row; true if it was added to the view
+    bool appendIfMatches(int storeRow);
+
+private:
+    enum class Kind { Range, ChildPostings, ModelPostings, Rows };
+
+    const QList<int> &postings() const;
+
+    const UsageStore *m_store;
+    Filter m_filter;
+    Kind m_kind = Kind::Range;
+    quint32 m_code = 0;
+    int m_first = 0;        // span in store rows (Range) or in the posting list
+    int m_last = 0;
+    QList<int> m_rows;
+};
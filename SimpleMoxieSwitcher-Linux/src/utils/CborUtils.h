@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QDateTime>
+
+// Helpers shared by the models' toCbor/fromCbor. Timestamps are stored as
+// epoch milliseconds, which decode with no string parsing. Readers also
+// accept ISO-8601 strings, the form the JSON format used.
+namespace CborUtils {
+
+inline QCborValue fromDateTime(const QDateTime &dateTime) {
+    return dateTime.isValid() ? QCborValue(dateTime.toMSecsSinceEpoch()) : QCborValue();
+}
+
+inline QDateTime toDateTime(const QCborValue &value) {
+    if (value.isInteger()) {
+        return QDateTime::fromMSecsSinceEpoch(value.toInteger());
+    }
+    if (value.isString()) {
+        return QDateTime::fromString(value.toString(), Qt::ISODate);
+    }
+    if (value.isDateTime()) {
+        return value.toDateTime();
+    }
+    return QDateTime();
+}
+
+} // namespace CborUtils
@@ -1,5 +1,10 @@
 #include "DIContainer.h"
 #include "../services/MQTTService.h"
+#include "../services/AIProviderService.h"
+#include "../services/GameContentService.h"
+#include "../services/DatabaseService.h"
+#include "../services/MaintenanceService.h"
+#include "../services/StorageService.h"
 
 void DIContainer::initialize() {
     auto& container = DIContainer::instance();
@@ -7,5 +12,21 @@ void DIContainer::initialize() {
     // Register services
     container.registerSingleton(new MQTTService());
 
+    // One I/O thread and queue for every JSON file and background read
+    container.registerSingleton(new SimpleMoxieSwitcher::StorageService());
+
+    // Shared so chat, memory extraction and games draw from one request queue
+    container.registerSingleton(new AIProviderService());
+
+    // Keeps game content buffered so games start without waiting on the model
+    container.registerSingleton(new GameContentService(container.resolve<AIProviderService>()));
+
+    // Indexed store for conversations, memories, usage and profiles
+    container.registerSingleton(new DatabaseService());
+
+    // Retention and compaction, run in small steps in the background
+    container.registerSingleton(new MaintenanceService(container.resolve<DatabaseService>(),
+                                                       container.resolve<AIProviderService>()));
+
     // Add more services as needed
 }
@@ -3,6 +3,7 @@
 #include <QObject>
 #include <QMap>
 #include <QSharedPointer>
+#include <QStringList>
 #include <typeinfo>
 
 class DIContainer {
@@ -15,6 +16,9 @@ public:
     template<typename T>
     void registerSingleton(T* instance) {
         QString key = typeid(T).name();
+        if (!m_singletons.contains(key)) {
+            m_order.append(key);
+        }
         m_singletons[key] = QSharedPointer<QObject>(instance);
     }
 
@@ -27,9 +31,26 @@ public:
         return nullptr;
     }
 
+    // For code that also runs without initialize(), such as benchmarks:
+    // falls back to a private instance owned by parent
+    template<typename T>
+    T* resolveOrCreate(QObject *parent) {
+        T *instance = resolve<T>();
+        return instance ? instance : new T(parent);
+    }
+
     static void initialize();
 
 private:
     DIContainer() = default;
+
+    // Services may use ones registered before them until they are gone
+    ~DIContainer() {
+        while (!m_order.isEmpty()) {
+            m_singletons.remove(m_order.takeLast());
+        }
+    }
+
     QMap<QString, QSharedPointer<QObject>> m_singletons;
+    QStringList m_order;
 };
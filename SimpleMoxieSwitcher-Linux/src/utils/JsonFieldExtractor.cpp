@@ -0,0 +1,369 @@
+#include "JsonFieldExtractor.h"
+#include <QtGlobal>
+#include <QtAlgorithms>
+
+namespace {
+
+constexpr int MaxDepth = 64;
+
+inline void skipWhitespace(const char *&pos, const char *end) {
+    while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+        ++pos;
+    }
+}
+
+inline int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+inline bool isScalarEnd(char c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+} // namespace
+
+JsonFieldExtractor::JsonFieldExtractor(std::initializer_list<const char *> paths) {
+    Q_ASSERT(paths.size() <= 32);
+    for (const char *path : paths) {
+        QList<Segment> segments;
+        for (const QByteArray &part : QByteArray(path).split('.')) {
+            Segment segment;
+            segment.key = part;
+            if (part == "*") {
+                segment.index = -2;
+            } else {
+                bool ok = false;
+                int index = part.toInt(&ok);
+                segment.index = ok ? index : -1;
+            }
+            segments.append(segment);
+        }
+        m_paths.append(segments);
+    }
+}
+
+bool JsonFieldExtractor::extract(QByteArrayView json, Fields *fields) const {
+    fields->clear();
+    fields->resize(m_paths.size());
+
+    State s{json.data(), json.data() + json.size(), fields};
+    skipWhitespace(s.pos, s.end);
+    if (s.pos >= s.end || *s.pos != '{') {
+        return false;
+    }
+
+    const quint32 all = m_paths.size() >= 32 ? 0xFFFFFFFFu : (1u << m_paths.size()) - 1;
+    if (!parseObject(s, 0, all)) {
+        return false;
+    }
+    skipWhitespace(s.pos, s.end);
+    return s.pos == s.end;
+}
+
+quint32 JsonFieldExtractor::terminals(quint32 mask, int depth) const {
+    quint32 result = 0;
+    for (quint32 m = mask; m; m &= m - 1) {
+        int i = qCountTrailingZeroBits(m);
+        if (m_paths[i].size() == depth) {
+            result |= 1u << i;
+        }
+    }
+    return result;
+}
+
+quint32 JsonFieldExtractor::matchKey(quint32 mask, int depth, QByteArrayView key) const {
+    quint32 result = 0;
+    for (quint32 m = mask; m; m &= m - 1) {
+        int i = qCountTrailingZeroBits(m);
+        if (m_paths[i].size() > depth && QByteArrayView(m_paths[i][depth].key) == key) {
+            result |= 1u << i;
+        }
+    }
+    return result;
+}
+
+quint32 JsonFieldExtractor::matchIndex(quint32 mask, int depth, int index) const {
+    quint32 result = 0;
+    for (quint32 m = mask; m; m &= m - 1) {
+        int i = qCountTrailingZeroBits(m);
+        if (m_paths[i].size() > depth) {
+            int wanted = m_paths[i][depth].index;
+            if (wanted == -2 || wanted == index) {
+                result |= 1u << i;
+            }
+        }
+    }
+    return result;
+}
+
+bool JsonFieldExtractor::parseValue(State &s, int depth, quint32 mask) const {
+    skipWhitespace(s.pos, s.end);
+    if (s.pos >= s.end || depth > MaxDepth) {
+        return false;
+    }
+
+    const quint32 term = terminals(mask, depth);
+    const quint32 deeper = mask & ~term;
+    Fields &fields = *s.fields;
+
+    switch (*s.pos) {
+    case '{':
+    case '[': {
+        for (quint32 m = term; m; m &= m - 1) {
+            fields[qCountTrailingZeroBits(m)].found = true;
+        }
+        if (!deeper) {
+            return skipValue(s);
+        }
+        return *s.pos == '{' ? parseObject(s, depth, deeper) : parseArray(s, depth, deeper);
+    }
+    case '"': {
+        if (!term) {
+            return skipString(s);
+        }
+        QString value;
+        if (!parseString(s, &value)) {
+            return false;
+        }
+        for (quint32 m = term; m; m &= m - 1) {
+            Field &field = fields[qCountTrailingZeroBits(m)];
+            field.found = true;
+            field.text += value;
+        }
+        return true;
+    }
+    case 't':
+    case 'f':
+    case 'n': {
+        QByteArrayView rest(s.pos, s.end - s.pos);
+        bool isTrue = rest.startsWith("true");
+        bool isFalse = rest.startsWith("false");
+        if (!isTrue && !isFalse && !rest.startsWith("null")) {
+            return false;
+        }
+        s.pos += isFalse ? 5 : 4;
+        // null reads as absent, like a missing key
+        if (isTrue || isFalse) {
+            for (quint32 m = term; m; m &= m - 1) {
+                Field &field = fields[qCountTrailingZeroBits(m)];
+                field.found = true;
+                field.boolean = isTrue;
+            }
+        }
+        return true;
+    }
+    default: {
+        const char *start = s.pos;
+        while (s.pos < s.end && !isScalarEnd(*s.pos)) {
+            ++s.pos;
+        }
+        if (s.pos == start) {
+            return false;
+        }
+        if (term) {
+            bool ok = false;
+            double number = QByteArray::fromRawData(start, s.pos - start).toDouble(&ok);
+            if (!ok) {
+                return false;
+            }
+            for (quint32 m = term; m; m &= m - 1) {
+                Field &field = fields[qCountTrailingZeroBits(m)];
+                field.found = true;
+                field.number = number;
+            }
+        }
+        return true;
+    }
+    }
+}
+
+bool JsonFieldExtractor::parseObject(State &s, int depth, quint32 mask) const {
+    ++s.pos;  // '{'
+    skipWhitespace(s.pos, s.end);
+    if (s.pos < s.end && *s.pos == '}') {
+        ++s.pos;
+        return true;
+    }
+
+    for (;;) {
+        skipWhitespace(s.pos, s.end);
+        QByteArrayView key;
+        if (s.pos >= s.end || *s.pos != '"' || !scanString(s, &key)) {
+            return false;
+        }
+        skipWhitespace(s.pos, s.end);
+        if (s.pos >= s.end || *s.pos != ':') {
+            return false;
+        }
+        ++s.pos;
+
+        quint32 child = matchKey(mask, depth, key);
+        if (child ? !parseValue(s, depth + 1, child) : !skipValue(s)) {
+            return false;
+        }
+
+        skipWhitespace(s.pos, s.end);
+        if (s.pos >= s.end) {
+            return false;
+        }
+        if (*s.pos == ',') {
+            ++s.pos;
+        } else if (*s.pos == '}') {
+            ++s.pos;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
+
+bool JsonFieldExtractor::parseArray(State &s, int depth, quint32 mask) const {
+    ++s.pos;  // '['
+    skipWhitespace(s.pos, s.end);
+    if (s.pos < s.end && *s.pos == ']') {
+        ++s.pos;
+        return true;
+    }
+
+    for (int index = 0;; ++index) {
+        quint32 child = matchIndex(mask, depth, index);
+        if (child ? !parseValue(s, depth + 1, child) : !skipValue(s)) {
+            return false;
+        }
+
+        skipWhitespace(s.pos, s.end);
+        if (s.pos >= s.end) {
+            return false;
+        }
+        if (*s.pos == ',') {
+            ++s.pos;
+        } else if (*s.pos == ']') {
+            ++s.pos;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
+
+bool JsonFieldExtractor::scanString(State &s, QByteArrayView *raw) const {
+    const char *start = ++s.pos;  // opening quote
+    while (s.pos < s.end) {
+        char c = *s.pos;
+        if (c == '"') {
+            *raw = QByteArrayView(start, s.pos - start);
+            ++s.pos;
+            return true;
+        }
+        s.pos += (c == '\\') ? 2 : 1;
+    }
+    return false;
+}
+
+bool JsonFieldExtractor::skipString(State &s) const {
+    QByteArrayView raw;
+    return scanString(s, &raw);
+}
+
+bool JsonFieldExtractor::parseString(State &s, QString *out) const {
+    QByteArrayView raw;
+    if (!scanString(s, &raw)) {
+        return false;
+    }
+    if (!raw.contains('\\')) {
+        *out = QString::fromUtf8(raw);
+        return true;
+    }
+
+    // Escapes are ASCII, so unescaped runs can be converted independently.
+    // \u escapes are UTF-16 units, which keeps surrogate pairs intact.
+    out->reserve(raw.size());
+    const char *p = raw.data();
+    const char *end = p + raw.size();
+    const char *run = p;
+    while (p < end) {
+        if (*p != '\\') {
+            ++p;
+            continue;
+        }
+        out->append(QString::fromUtf8(run, p - run));
+        if (p + 1 >= end) {
+            return false;
+        }
+        char e = p[1];
+        p += 2;
+        switch (e) {
+        case '"':  out->append(QLatin1Char('"')); break;
+        case '\\': out->append(QLatin1Char('\\')); break;
+        case '/':  out->append(QLatin1Char('/')); break;
+        case 'b':  out->append(QLatin1Char('\b')); break;
+        case 'f':  out->append(QLatin1Char('\f')); break;
+        case 'n':  out->append(QLatin1Char('\n')); break;
+        case 'r':  out->append(QLatin1Char('\r')); break;
+        case 't':  out->append(QLatin1Char('\t')); break;
+        case 'u': {
+            if (end - p < 4) {
+                return false;
+            }
+            int unit = 0;
+            for (int i = 0; i < 4; ++i) {
+                int digit = hexValue(p[i]);
+                if (digit < 0) {
+                    return false;
+                }
+                unit = unit * 16 + digit;
+            }
+            out->append(QChar(char16_t(unit)));
+            p += 4;
+            break;
+        }
+        default:
+            return false;
+        }
+        run = p;
+    }
+    out->append(QString::fromUtf8(run, end - run));
+    return true;
+}
+
+bool JsonFieldExtractor::skipValue(State &s) const {
+    skipWhitespace(s.pos, s.end);
+    if (s.pos >= s.end) {
+        return false;
+    }
+
+    char first = *s.pos;
+    if (first == '"') {
+        return skipString(s);
+    }
+    if (first != '{' && first != '[') {
+        const char *start = s.pos;
+        while (s.pos < s.end && !isScalarEnd(*s.pos)) {
+            ++s.pos;
+        }
+        return s.pos > start;
+    }
+
+    int nesting = 0;
+    while (s.pos < s.end) {
+        char c = *s.pos;
+        if (c == '"') {
+            if (!skipString(s)) {
+                return false;
+            }
+            continue;
+        }
+        ++s.pos;
+        if (c == '{' || c == '[') {
+            ++nesting;
+        } else if (c == '}' || c == ']') {
+            if (--nesting == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include <QVarLengthArray>
+#include <initializer_list>
+
+// Pulls a fixed set of fields out of a JSON document in one forward pass,
+// without building a QJsonDocument. Paths are dot-separated; a numeric segment
+// selects an array element and "*" matches every element. Subtrees that no
+// path can reach are skipped without decoding. Strings matched by "*" paths
+// are concatenated in document order.
+//
+// Keys are compared in their raw (escaped) form, which is fine for the ASCII
+// field names provider APIs use. Skipped subtrees are only checked for
+// balanced brackets and strings, not fully validated.
+class JsonFieldExtractor {
+public:
+    struct Field {
+        bool found = false;
+        QString text;
+        double number = 0.0;
+        bool boolean = false;
+
+        int toInt() const { return static_cast<int>(number); }
+    };
+    using Fields = QVarLengthArray<Field, 8>;
+
+    // Up to 32 paths; build once and reuse, extract() is const
+    JsonFieldExtractor(std::initializer_list<const char *> paths);
+
+    // Returns false unless the input is a well-formed JSON object
+    bool extract(QByteArrayView json, Fields *fields) const;
+
+private:
+    struct State {
+        const char *pos;
+        const char *end;
+        Fields *fields;
+    };
+
+    bool parseValue(State &s, int depth, quint32 mask) const;
+    bool parseObject(State &s, int depth, quint32 mask) const;
+    bool parseArray(State &s, int depth, quint32 mask) const;
+    bool parseString(State &s, QString *out) const;
+    bool skipValue(State &s) const;
+    bool skipString(State &s) const;
+    bool scanString(State &s, QByteArrayView *raw) const;
+    quint32 matchKey(quint32 mask, int depth, QByteArrayView key) const;
+    quint32 matchIndex(quint32 mask, int depth, int index) const;
+    quint32 terminals(quint32 mask, int depth) const;
+
+    struct Segment {
+        QByteArray key;
+        int index = -1;     // array index, -1 for object keys, -2 for "*"
+    };
+
+    QList<QList<Segment>> m_paths;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <QList>
+#include <QPointF>
+#include <cmath>
+
+namespace SeriesUtils {
+
+// Largest-Triangle-Three-Buckets: reduces a series (sorted by x) to
+// threshold points while keeping its visual shape. First and last points are
+// always kept; each bucket in between contributes the point forming the
+// largest triangle with the previously chosen point and the next bucket's
+// average.
+inline QList<QPointF> downsampleLttb(const QList<QPointF> &data, int threshold) {
+    if (threshold < 3 || threshold >= data.size()) {
+        return data;
+    }
+
+    QList<QPointF> sampled;
+    sampled.reserve(threshold);
+    sampled.append(data.first());
+
+    const double every = double(data.size() - 2) / (threshold - 2);
+    int previous = 0;
+    for (int i = 0; i < threshold - 2; ++i) {
+        // Average of the following bucket
+        int avgStart = int(std::floor((i + 1) * every)) + 1;
+        int avgEnd = qMin(int(std::floor((i + 2) * every)) + 1, int(data.size()));
+        double avgX = 0.0;
+        double avgY = 0.0;
+        for (int j = avgStart; j < avgEnd; ++j) {
+            avgX += data[j].x();
+            avgY += data[j].y();
+        }
+        const int avgCount = qMax(1, avgEnd - avgStart);
+        avgX /= avgCount;
+        avgY /= avgCount;
+
+        // Point of the current bucket with the largest triangle
+        const int rangeStart = int(std::floor(i * every)) + 1;
+        const int rangeEnd = int(std::floor((i + 1) * every)) + 1;
+        const QPointF &a = data[previous];
+        double maxArea = -1.0;
+        int chosen = rangeStart;
+        for (int j = rangeStart; j < rangeEnd; ++j) {
+            double area = std::abs((a.x() - avgX) * (data[j].y() - a.y())
+                                   - (a.x() - data[j].x()) * (avgY - a.y()));
+            if (area > maxArea) {
+                maxArea = area;
+                chosen = j;
+            }
+        }
+
+        sampled.append(data[chosen]);
+        previous = chosen;
+    }
+
+    sampled.append(data.last());
+    return sampled;
+}
+
+} // namespace SeriesUtils
@@ -0,0 +1,171 @@
+#include "TokenEstimator.h"
+#include <cmath>
+
+namespace {
+
+// Per-encoding pricing. Words up to wordBase letters are a single token and
+// every further wordStep letters adds one; the remaining ratios are tokens per
+// character class.
+struct Profile {
+    int wordBase;
+    int wordStep;
+    int digitsPerToken;
+    double cjkTokensPerChar;
+    double otherCharsPerToken;   // non-ASCII letters outside CJK
+    double surrogateTokens;      // emoji and other astral-plane characters
+    int messageOverhead;
+};
+
+const Profile &profileFor(TokenEstimator::Encoding encoding) {
+    static const Profile o200k       {7, 5, 3, 0.7, 3.5, 1.5, 3};
+    static const Profile cl100k      {6, 4, 3, 1.3, 2.5, 2.0, 3};
+    static const Profile llama3      {6, 4, 3, 1.0, 3.0, 2.0, 4};
+    static const Profile claude      {5, 4, 3, 1.2, 3.0, 2.0, 4};
+    static const Profile gemini      {7, 5, 1, 0.6, 3.0, 1.5, 4};
+    static const Profile sentencePiece{4, 3, 1, 1.2, 2.0, 3.0, 4};
+
+    switch (encoding) {
+        case TokenEstimator::Encoding::O200k:         return o200k;
+        case TokenEstimator::Encoding::Cl100k:        return cl100k;
+        case TokenEstimator::Encoding::Llama3:        return llama3;
+        case TokenEstimator::Encoding::Claude:        return claude;
+        case TokenEstimator::Encoding::Gemini:        return gemini;
+        case TokenEstimator::Encoding::SentencePiece: return sentencePiece;
+    }
+    return cl100k;
+}
+
+inline bool isAsciiLetter(char16_t u) {
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z');
+}
+
+inline bool isAsciiDigit(char16_t u) {
+    return u >= '0' && u <= '9';
+}
+
+inline bool isAsciiSpace(char16_t u) {
+    return u == ' ' || u == '\n' || u == '\t' || u == '\r';
+}
+
+inline bool isCjk(char16_t u) {
+    return (u >= 0x4E00 && u <= 0x9FFF)     // CJK unified ideographs
+        || (u >= 0x3040 && u <= 0x30FF)     // hiragana, katakana
+        || (u >= 0xAC00 && u <= 0xD7AF);    // hangul syllables
+}
+
+} // namespace
+
+TokenEstimator::Encoding TokenEstimator::encodingForModel(const QString &model) {
+    if (model.startsWith("gpt-4o") || model.startsWith("o1") || model.startsWith("o3")) {
+        return Encoding::O200k;
+    }
+    if (model.startsWith("gpt-") || model.startsWith("deepseek")) {
+        return Encoding::Cl100k;
+    }
+    if (model.startsWith("claude")) {
+        return Encoding::Claude;
+    }
+    if (model.startsWith("gemini")) {
+        return Encoding::Gemini;
+    }
+    if (model.startsWith("llama3") || model.startsWith("llama-3")) {
+        return Encoding::Llama3;
+    }
+    if (model.startsWith("mistral") || model.startsWith("mixtral") || model.startsWith("phi")
+        || model.startsWith("gemma") || model.startsWith("qwen")) {
+        return Encoding::SentencePiece;
+    }
+    return Encoding::Cl100k;
+}
+
+int TokenEstimator::countText(QStringView text, Encoding encoding) {
+    const Profile &p = profileFor(encoding);
+    const char16_t *data = text.utf16();
+    const qsizetype size = text.size();
+
+    double tokens = 0.0;
+    qsizetype i = 0;
+
+    while (i < size) {
+        char16_t u = data[i];
+
+        if (isAsciiLetter(u)) {
+            // Word body, apostrophe contractions stay attached
+            qsizetype start = i;
+            qsizetype nonAscii = 0;
+            while (i < size && (isAsciiLetter(data[i]) || data[i] == '\''
+                                || (data[i] >= 0x80 && !isCjk(data[i]) && QChar(data[i]).isLetter()))) {
+                if (data[i] >= 0x80) {
+                    ++nonAscii;
+                }
+                ++i;
+            }
+            qsizetype length = i - start;
+            if (nonAscii > 0) {
+                tokens += std::ceil(length / p.otherCharsPerToken);
+            } else {
+                tokens += 1 + qMax<qsizetype>(0, length - p.wordBase + p.wordStep - 1) / p.wordStep;
+            }
+        } else if (isAsciiDigit(u)) {
+            qsizetype start = i;
+            while (i < size && isAsciiDigit(data[i])) {
+                ++i;
+            }
+            tokens += (i - start + p.digitsPerToken - 1) / p.digitsPerToken;
+        } else if (isAsciiSpace(u)) {
+            // A single space is merged into the following word
+            qsizetype start = i;
+            bool newline = false;
+            while (i < size && isAsciiSpace(data[i])) {
+                newline |= (data[i] == '\n');
+                ++i;
+            }
+            if (i - start > 1 || newline) {
+                tokens += 1;
+            }
+        } else if (u < 0x80) {
+            // Runs of punctuation usually pair up ("?!", "...", "\"," )
+            qsizetype start = i;
+            while (i < size && data[i] < 0x80 && !isAsciiLetter(data[i])
+                   && !isAsciiDigit(data[i]) && !isAsciiSpace(data[i])) {
+                ++i;
+            }
+            tokens += (i - start + 1) / 2;
+        } else if (QChar::isHighSurrogate(u)) {
+            tokens += p.surrogateTokens;
+            i += (i + 1 < size && QChar::isLowSurrogate(data[i + 1])) ? 2 : 1;
+        } else if (isCjk(u)) {
+            tokens += p.cjkTokensPerChar;
+            ++i;
+        } else {
+            // Other scripts: priced per character run
+            qsizetype start = i;
+            while (i < size && data[i] >= 0x80 && !isCjk(data[i]) && !QChar::isHighSurrogate(data[i])) {
+                ++i;
+            }
+            tokens += std::ceil((i - start) / p.otherCharsPerToken);
+        }
+    }
+
+    return static_cast<int>(std::ceil(tokens));
+}
+
+int TokenEstimator::countText(const QString &text, const QString &model) {
+    return countText(QStringView(text), encodingForModel(model));
+}
+
+int TokenEstimator::messageOverhead(const QString &model) {
+    return profileFor(encodingForModel(model)).messageOverhead;
+}
+
+int TokenEstimator::countMessages(const QList<QJsonObject> &messages, const QString &model) {
+    const Encoding encoding = encodingForModel(model);
+    const int overhead = profileFor(encoding).messageOverhead;
+
+    // Reply priming adds a few tokens once per request
+    int tokens = overhead;
+    for (const auto &msg : messages) {
+        tokens += overhead + countText(QStringView(msg["content"].toString()), encoding);
+    }
+    return tokens;
+}
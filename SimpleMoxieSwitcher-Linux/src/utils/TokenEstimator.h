@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QString>
+#include <QStringView>
+#include <QList>
+#include <QJsonObject>
+
+// Fast local token counts for budgeting and cost prediction before a request
+// is sent. Text is classified in a single pass (words, digit runs, punctuation,
+// whitespace, non-Latin script) and each class is priced with ratios calibrated
+// against the tokenizer family the model uses. Counts are estimates, typically
+// within ~10% of the real tokenizer for English chat text.
+class TokenEstimator {
+public:
+    enum class Encoding {
+        O200k,          // gpt-4o
+        Cl100k,         // gpt-4, gpt-3.5, deepseek
+        Llama3,         // llama 3.x via Ollama or Groq
+        Claude,
+        Gemini,
+        SentencePiece   // mistral, mixtral, phi3, gemma, qwen
+    };
+
+    static Encoding encodingForModel(const QString &model);
+
+    static int countText(QStringView text, Encoding encoding);
+    static int countText(const QString &text, const QString &model = QString());
+
+    // Includes the per-message framing each chat format adds around the content
+    static int countMessages(const QList<QJsonObject> &messages, const QString &model = QString());
+    static int messageOverhead(const QString &model = QString());
+};
@@ -1,38 +1,101 @@
 #include "ChatViewModel.h"
+#include "../utils/DIContainer.h"
+#include "../services/StorageService.h"
 #include <QDebug>
 #include <QJsonDocument>
 #include <QJsonArray>
+#include <QPointer>
+#include <memory>
 
 ChatViewModel::ChatViewModel(QObject *parent)
     : QAbstractListModel(parent)
-    , m_aiService(new AIProviderService(this)) {
+    , m_aiService(DIContainer::instance().resolve<AIProviderService>())
+    , m_streamRefreshTimer(new QTimer(this))
+    , m_journal(nullptr)
+    , m_database(DIContainer::instance().resolve<DatabaseService>())
+    , m_storage(DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this))
+    , m_backfillTimer(new QTimer(this)) {
 
-    connect(m_aiService, &AIProviderService::responseReceived,
-            this, &ChatViewModel::processAIResponse);
-    connect(m_aiService, &AIProviderService::errorOccurred,
-            this, &ChatViewModel::errorOccurred);
+    if (!m_aiService) {
+        m_aiService = new AIProviderService(this);
+    }
+    if (!m_database) {
+        m_database = new DatabaseService(QString(), this);
+    }
+
+    setPersonalityId("friendly");
+
+    // Coalesce token bursts into at most one repaint per frame
+    m_streamRefreshTimer->setSingleShot(true);
+    m_streamRefreshTimer->setInterval(16);
+    connect(m_streamRefreshTimer, &QTimer::timeout, this, &ChatViewModel::flushStreamingRow);
+
+    m_backfillTimer->setInterval(50);
+    connect(m_backfillTimer, &QTimer::timeout, this, &ChatViewModel::backfillDatabase);
+
+    // The service is shared, so only react to replies for our own requests
+    connect(m_aiService, &AIProviderService::requestFinished,
+            this, &ChatViewModel::onRequestFinished);
+    connect(m_aiService, &AIProviderService::requestFailed,
+            this, &ChatViewModel::onRequestFailed);
+    connect(m_aiService, &AIProviderService::requestStreamingData,
+            this, &ChatViewModel::onStreamingData);
+
+    // Pick up where the last session left off
+    m_journalDirectory = m_storage->dataPath() + "/conversations";
+    m_journal = new ConversationJournal(m_journalDirectory, this);
+    connect(m_journal, &ConversationJournal::writeError, this, [this](const QString &, const QString &error) {
+        emit errorOccurred("Failed to save conversation: " + error);
+    });
+
+    QString lastId = m_storage->loadSetting("chat/lastConversationId").toString();
+    if (lastId.isEmpty() || !m_journal->exists(lastId)) {
+        startNewConversation();
+    } else {
+        loadConversation(lastId);
+    }
+}
+
+ChatViewModel::~ChatViewModel() {
+    // The AI service is shared and outlives views created from QML
+    if (m_pendingRequestId != 0) {
+        m_aiService->cancelRequest(m_pendingRequestId);
+    }
+    if (m_summaryRequestId != 0) {
+        m_aiService->cancelRequest(m_summaryRequestId);
+    }
+}
+
+void ChatViewModel::startNewConversation() {
+    m_conversation = Conversation("New Conversation", QString());
+    m_conversation.personalityId = m_personality.id;
+    m_history.clear();
+    m_journal->begin(m_conversation);
+    m_database->saveConversation(m_conversation);
+    m_storage->saveSetting("chat/lastConversationId", m_conversation.id);
 }
 
 int ChatViewModel::rowCount(const QModelIndex &parent) const {
     Q_UNUSED(parent)
-    return m_conversation.messages.size();
+    return m_history.size();
 }
 
 QVariant ChatViewModel::data(const QModelIndex &index, int role) const {
-    if (!index.isValid() || index.row() >= m_conversation.messages.size())
+    if (!index.isValid() || index.row() >= m_history.size())
         return QVariant();
 
-    const Message &msg = m_conversation.messages[index.row()];
+    // Decodes the row on first use; QML only asks for rows in view
+    const ChatMessage msg = m_history.at(index.row());
 
     switch (role) {
         case RoleRole:
-            return static_cast<int>(msg.role);
+            return msg.role;
         case ContentRole:
             return msg.content;
         case TimestampRole:
             return msg.timestamp.toString("hh:mm:ss");
         case IsUserRole:
-            return msg.role == ConversationRole::User;
+            return msg.role == "user";
         default:
             return QVariant();
     }
@@ -58,6 +121,7 @@ void ChatViewModel::setSelectedModel(const QString &model) {
     if (m_selectedModel != model) {
         m_selectedModel = model;
         emit selectedModelChanged();
+        m_aiService->preloadModel(model);
     }
 }
 
@@ -68,51 +132,111 @@ void ChatViewModel::setTemperature(double temp) {
     }
 }
 
+void ChatViewModel::setPersonalityId(const QString &id) {
+    if (m_personality.id == id)
+        return;
+
+    for (const auto &personality : Personality::getBuiltInPersonalities()) {
+        if (personality.id == id) {
+            m_personality = personality;
+            m_context.setSystemPrompt(personality.systemPrompt);
+            m_context.setReplyTokens(personality.maxTokens);
+            if (m_journal && !m_loading && m_conversation.personalityId != id) {
+                m_conversation.personalityId = id;
+                m_journal->updateHeader(m_conversation);
+                m_database->saveConversation(m_conversation);
+            }
+            emit personalityIdChanged();
+            return;
+        }
+    }
+}
+
 void ChatViewModel::sendMessage() {
-    if (m_currentMessage.isEmpty() || m_isProcessing)
+    if (m_currentMessage.isEmpty() || m_isProcessing || m_loading)
         return;
 
     // Add user message
     beginInsertRows(QModelIndex(), rowCount(), rowCount());
-    Message userMsg{ConversationRole::User, m_currentMessage, QDateTime::currentDateTime()};
-    m_conversation.addMessage(userMsg);
+    ChatMessage userMsg("user", m_currentMessage);
+    m_history.append(userMsg);
+    m_conversation.messageCount = m_history.size();
+    m_conversation.updatedAt = userMsg.timestamp;
     endInsertRows();
+    m_journal->appendMessage(userMsg);
+    m_database->appendMessage(m_conversation.id, userMsg);
 
     // Clear input and set processing
     m_isProcessing = true;
     emit isProcessingChanged();
 
-    QString temp = m_currentMessage;
     setCurrentMessage("");
 
     // Send to AI
-    m_aiService->sendRequest(temp, m_selectedModel, m_temperature);
+    requestAssistantReply();
 }
 
 void ChatViewModel::clearConversation() {
+    if (m_loading)
+        return;
+
+    if (m_pendingRequestId != 0) {
+        m_aiService->cancelRequest(m_pendingRequestId);
+        m_pendingRequestId = 0;
+        m_isProcessing = false;
+        emit isProcessingChanged();
+    }
+    m_streamRefreshTimer->stop();
+    m_streamingRow = -1;
+    m_backfillTimer->stop();
+
+    if (m_summaryRequestId != 0) {
+        m_aiService->cancelRequest(m_summaryRequestId);
+        m_summaryRequestId = 0;
+    }
+    m_context.reset();
+
     beginResetModel();
-    m_conversation.messages.clear();
+    m_history.clear();
+    m_conversation.messageCount = 0;
+    m_conversation.summary.clear();
+    m_conversation.summarizedCount = 0;
     endResetModel();
+    m_journal->clearMessages();
+    m_journal->updateHeader(m_conversation);
+    m_database->clearMessages(m_conversation.id);
 }
 
 void ChatViewModel::regenerateLastResponse() {
-    if (m_conversation.messages.isEmpty())
+    if (m_history.isEmpty() || m_loading)
         return;
 
+    if (m_pendingRequestId != 0) {
+        m_aiService->cancelRequest(m_pendingRequestId);
+        m_pendingRequestId = 0;
+        removeStreamingRow();
+    }
+
     // Find last user message
-    for (int i = m_conversation.messages.size() - 1; i >= 0; --i) {
-        if (m_conversation.messages[i].role == ConversationRole::User) {
+    for (int i = m_history.size() - 1; i >= 0; --i) {
+        if (m_history.at(i).role == "user") {
             // Remove all messages after this user message
-            beginRemoveRows(QModelIndex(), i + 1, m_conversation.messages.size() - 1);
-            while (m_conversation.messages.size() > i + 1) {
-                m_conversation.messages.removeLast();
+            if (i + 1 < m_history.size()) {
+                beginRemoveRows(QModelIndex(), i + 1, m_history.size() - 1);
+                while (m_history.size() > i + 1) {
+                    m_journal->removeMessage(m_history.last().id);
+                    m_database->removeMessage(m_history.last().id);
+                    m_history.removeLast();
+                }
+                m_conversation.messageCount = m_history.size();
+                m_backfillEnd = qMin(m_backfillEnd, m_history.size());
+                endRemoveRows();
             }
-            endRemoveRows();
 
             // Resend the user message
             m_isProcessing = true;
             emit isProcessingChanged();
-            m_aiService->sendRequest(m_conversation.messages[i].content, m_selectedModel, m_temperature);
+            requestAssistantReply();
             break;
         }
     }
@@ -120,7 +244,7 @@ void ChatViewModel::regenerateLastResponse() {
 
 void ChatViewModel::exportConversation() {
     QJsonArray messages;
-    for (const auto &msg : m_conversation.messages) {
+    for (const auto &msg : m_history.toList()) {
         messages.append(msg.toJson());
     }
 
@@ -132,16 +256,277 @@ void ChatViewModel::exportConversation() {
 }
 
 void ChatViewModel::loadConversation(const QString &id) {
-    // TODO: Load from database
     qDebug() << "Loading conversation:" << id;
+
+    if (m_pendingRequestId != 0) {
+        m_aiService->cancelRequest(m_pendingRequestId);
+        m_pendingRequestId = 0;
+        m_isProcessing = false;
+        emit isProcessingChanged();
+    }
+    if (m_summaryRequestId != 0) {
+        m_aiService->cancelRequest(m_summaryRequestId);
+        m_summaryRequestId = 0;
+    }
+    m_streamRefreshTimer->stop();
+    m_streamingRow = -1;
+    m_backfillTimer->stop();
+    m_context.reset();
+
+    // Nothing may append to the journal while it is read on the I/O thread
+    m_journal->close();
+    const quint64 generation = ++m_loadGeneration;
+    m_loading = true;
+
+    beginResetModel();
+    m_history.clear();
+    m_conversation = Conversation();
+    m_conversation.id = id;
+    endResetModel();
+
+    // Recorded up front so maintenance leaves this conversation alone
+    m_storage->saveSetting("chat/lastConversationId", id);
+
+    struct Loaded {
+        Conversation header;
+        ChatHistory history;
+        ChatHistory::ReplayState state;
+        int indexedCount = 0;
+    };
+    auto loaded = std::make_shared<Loaded>();
+    const QString directory = m_journalDirectory;
+    const QString databasePath = m_database->path();
+    m_storage->runAsync([directory, databasePath, id, loaded]() {
+        ConversationJournal reader(directory);
+        if (!reader.read(id, &loaded->header, &loaded->history, &loaded->state))
+            return false;
+        // Own connection, so the count never waits on the GUI thread's writes
+        DatabaseService database(databasePath);
+        loaded->indexedCount = database.messageCount(id);
+        return true;
+    }).then(this, [this, id, generation, loaded](bool found) {
+        if (generation == m_loadGeneration) {
+            finishLoading(id, loaded->header, found ? &loaded->history : nullptr, loaded->state,
+                          loaded->indexedCount);
+        }
+    });
 }
 
-void ChatViewModel::processAIResponse(const QString &response) {
-    beginInsertRows(QModelIndex(), rowCount(), rowCount());
-    Message aiMsg{ConversationRole::Assistant, response, QDateTime::currentDateTime()};
-    m_conversation.addMessage(aiMsg);
+void ChatViewModel::finishLoading(const QString &id, const Conversation &header, ChatHistory *history,
+                                  const ChatHistory::ReplayState &state, int indexedCount) {
+    m_loading = false;
+
+    beginResetModel();
+    if (history) {
+        m_history.swap(*history);
+        m_conversation = header;
+        m_journal->attach(id, state);
+    } else {
+        startNewConversation();
+    }
+    endResetModel();
+
+    if (!history) {
+        emit errorOccurred("Conversation not found: " + id);
+        return;
+    }
+
+    // Pick the rolling summary back up. Conversations saved before it was
+    // persisted start from nothing and catch up in batches.
+    m_context.setSummary(m_conversation.summary, qBound(0, m_conversation.summarizedCount, m_history.size()));
+    updateRollingSummary();
+
+    if (!m_conversation.personalityId.isEmpty()) {
+        setPersonalityId(m_conversation.personalityId);
+    }
+
+    // Conversations journaled before the database existed are copied in the
+    // first time they are reopened, so they become searchable; the journal
+    // stays the source of truth for the open chat
+    m_database->saveConversation(m_conversation);
+    if (indexedCount < m_history.size()) {
+        m_backfillRow = 0;
+        m_backfillEnd = m_history.size();
+        m_backfillTimer->start();
+    }
+}
+
+void ChatViewModel::backfillDatabase() {
+    // Messages are upserted, so rows already in the database are harmless;
+    // rows appended since the load are stored as they arrive
+    constexpr int BatchSize = 200;
+    if (m_backfillRow >= m_backfillEnd) {
+        m_backfillTimer->stop();
+        return;
+    }
+    Conversation batch = m_conversation;
+    batch.messages = m_history.mid(m_backfillRow, qMin(BatchSize, m_backfillEnd - m_backfillRow));
+    m_backfillRow += batch.messages.size();
+    m_database->saveConversation(batch);
+}
+
+QVariantList ChatViewModel::recentConversations(int days) const {
+    QVariantList result;
+    const QDateTime since = QDateTime::currentDateTime().addDays(-days);
+    for (const auto &conversation : m_database->conversationsUpdatedSince(since)) {
+        QVariantMap item;
+        item["id"] = conversation.id;
+        item["title"] = conversation.title;
+        item["updatedAt"] = conversation.updatedAt;
+        item["messageCount"] = conversation.messageCount;
+        result.append(item);
+    }
+    return result;
+}
+
+QVariantList ChatViewModel::searchConversations(const QString &text, int limit) const {
+    QVariantList result;
+    for (const auto &hit : m_database->searchMessages(text, limit)) {
+        QVariantMap item;
+        item["messageId"] = hit.messageId;
+        item["conversationId"] = hit.conversationId;
+        item["title"] = hit.conversationTitle;
+        item["role"] = hit.role;
+        item["snippet"] = hit.snippet;
+        item["timestamp"] = hit.timestamp;
+        result.append(item);
+    }
+    return result;
+}
+
+void ChatViewModel::requestAssistantReply() {
+    m_context.setModel(m_selectedModel);
+    QList<QJsonObject> messages = m_context.buildMessages(m_history);
+    m_pendingRequestId = m_aiService->sendChatRequest(messages, m_selectedModel, m_temperature);
+
+    // Empty assistant row that streamed chunks are appended to
+    m_streamingRow = rowCount();
+    beginInsertRows(QModelIndex(), m_streamingRow, m_streamingRow);
+    m_history.append(ChatMessage("assistant", QString()));
+    m_conversation.messageCount = m_history.size();
     endInsertRows();
+}
+
+void ChatViewModel::removeStreamingRow() {
+    m_streamRefreshTimer->stop();
+    if (m_streamingRow < 0 || m_streamingRow >= m_history.size())
+        return;
+
+    beginRemoveRows(QModelIndex(), m_streamingRow, m_streamingRow);
+    m_history.removeAt(m_streamingRow);
+    m_conversation.messageCount = m_history.size();
+    endRemoveRows();
+    m_streamingRow = -1;
+}
+
+void ChatViewModel::flushStreamingRow() {
+    if (m_streamingRow < 0 || m_streamingRow >= m_history.size())
+        return;
+
+    QModelIndex idx = index(m_streamingRow);
+    emit dataChanged(idx, idx, {ContentRole});
+}
+
+void ChatViewModel::onStreamingData(int requestId, const QString &chunk) {
+    if (requestId != m_pendingRequestId || m_streamingRow < 0)
+        return;
+
+    m_history.appendContent(m_streamingRow, chunk);
+    if (!m_streamRefreshTimer->isActive()) {
+        m_streamRefreshTimer->start();
+    }
+}
+
+void ChatViewModel::onRequestFinished(int requestId, const QString &response) {
+    if (requestId != m_pendingRequestId)
+        return;
+
+    m_pendingRequestId = 0;
+    processAIResponse(response);
+}
+
+void ChatViewModel::onRequestFailed(int requestId, const QString &error) {
+    if (requestId != m_pendingRequestId)
+        return;
+
+    m_pendingRequestId = 0;
+    removeStreamingRow();
+    m_isProcessing = false;
+    emit isProcessingChanged();
+    emit errorOccurred(error);
+}
+
+void ChatViewModel::processAIResponse(const QString &response) {
+    m_streamRefreshTimer->stop();
+
+    if (m_streamingRow >= 0 && m_streamingRow < m_history.size()) {
+        // The full response is authoritative over whatever was streamed
+        ChatMessage aiMsg = m_history.at(m_streamingRow);
+        aiMsg.content = response;
+        aiMsg.timestamp = QDateTime::currentDateTime();
+        m_history.replace(m_streamingRow, aiMsg);
+        m_conversation.updatedAt = aiMsg.timestamp;
+        m_journal->appendMessage(aiMsg);
+        m_database->appendMessage(m_conversation.id, aiMsg);
+
+        QModelIndex idx = index(m_streamingRow);
+        emit dataChanged(idx, idx, {ContentRole, TimestampRole});
+    } else {
+        ChatMessage reply("assistant", response);
+        beginInsertRows(QModelIndex(), rowCount(), rowCount());
+        m_history.append(reply);
+        m_conversation.messageCount = m_history.size();
+        m_conversation.updatedAt = reply.timestamp;
+        endInsertRows();
+        m_journal->appendMessage(reply);
+        m_database->appendMessage(m_conversation.id, reply);
+    }
+    m_streamingRow = -1;
 
     m_isProcessing = false;
     emit isProcessingChanged();
+
+    updateRollingSummary();
+}
+
+void ChatViewModel::updateRollingSummary() {
+    // Fold turns that no longer fit into the summary, a few at a time; a
+    // long backlog is worked off one bounded prompt after another
+    const int minTurnsToSummarize = 4;
+    const int maxTurnsToSummarize = 40;
+
+    if (m_summaryRequestId != 0)
+        return;
+
+    m_context.setModel(m_selectedModel);
+    QList<ChatMessage> overflow = m_context.unsummarizedOverflow(m_history, maxTurnsToSummarize);
+    if (overflow.size() < minTurnsToSummarize)
+        return;
+
+    int summarizedCount = m_context.summarizedCount() + overflow.size();
+    QString conversationId = m_conversation.id;
+
+    // Temperature 0: a summary should be a faithful fold of its input, and
+    // the same input is then answered from the response cache
+    QPointer<ChatViewModel> self(this);
+    m_summaryRequestId = m_aiService->sendRequest(
+        m_context.summaryPrompt(overflow), m_selectedModel, 0.0, AIProviderService::Background,
+        [self, summarizedCount, conversationId](const QString &response, const QString &error) {
+            if (self) {
+                self->finishRollingSummary(conversationId, summarizedCount, response, error);
+            }
+        });
+}
+
+void ChatViewModel::finishRollingSummary(const QString &conversationId, int summarizedCount,
+                                         const QString &response, const QString &error) {
+    m_summaryRequestId = 0;
+    if (!error.isEmpty() || response.trimmed().isEmpty() || conversationId != m_conversation.id)
+        return;
+    m_context.setSummary(response.trimmed(), summarizedCount);
+
+    m_conversation.summary = m_context.summary();
+    m_conversation.summarizedCount = summarizedCount;
+    m_journal->updateHeader(m_conversation);
+    updateRollingSummary();
 }
\ No newline at end of file
@@ -1,8 +1,19 @@
 #pragma once
 #include <QObject>
 #include <QAbstractListModel>
+#include <QTimer>
 #include "../models/Conversation.h"
+#include "../models/Personality.h"
 #include "../services/AIProviderService.h"
+#include "../services/ContextWindowManager.h"
+#include "../services/ConversationJournal.h"
+#include "../services/ChatHistory.h"
+#include "../services/DatabaseService.h"
+#include <QVariantList>
+
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
 
 class ChatViewModel : public QAbstractListModel {
     Q_OBJECT
@@ -10,6 +21,7 @@ class ChatViewModel : public QAbstractListModel {
     Q_PROPERTY(bool isProcessing READ isProcessing NOTIFY isProcessingChanged)
     Q_PROPERTY(QString selectedModel READ selectedModel WRITE setSelectedModel NOTIFY selectedModelChanged)
     Q_PROPERTY(double temperature READ temperature WRITE setTemperature NOTIFY temperatureChanged)
+    Q_PROPERTY(QString personalityId READ personalityId WRITE setPersonalityId NOTIFY personalityIdChanged)
 
 public:
     enum ChatRoles {
@@ -20,6 +32,7 @@ public:
     };
 
     explicit ChatViewModel(QObject *parent = nullptr);
+    ~ChatViewModel() override;
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
@@ -36,11 +49,22 @@ public:
     double temperature() const { return m_temperature; }
     void setTemperature(double temp);
 
+    QString personalityId() const { return m_personality.id; }
+    void setPersonalityId(const QString &id);
+
+    // Conversations touched in the last few days, newest first
+    Q_INVOKABLE QVariantList recentConversations(int days = 7) const;
+
+    // Full-text search across every stored conversation
+    Q_INVOKABLE QVariantList searchConversations(const QString &text, int limit = 50) const;
+
 public slots:
     void sendMessage();
     void clearConversation();
     void regenerateLastResponse();
     void exportConversation();
+    // Indexes the conversation on the I/O thread; the model is empty and
+    // input is ignored until it is ready
     void loadConversation(const QString &id);
 
 signals:
@@ -48,15 +72,59 @@ signals:
     void isProcessingChanged();
     void selectedModelChanged();
     void temperatureChanged();
+    void personalityIdChanged();
     void errorOccurred(const QString &error);
 
 private:
+    // Header only; the messages live in m_history
     Conversation m_conversation;
+    ChatHistory m_history;
     QString m_currentMessage;
     bool m_isProcessing = false;
     QString m_selectedModel = "gpt-3.5-turbo";
     double m_temperature = 0.7;
     AIProviderService *m_aiService;
+    int m_pendingRequestId = 0;
+
+    // Token-budgeted history sent with each request
+    Personality m_personality;
+    ContextWindowManager m_context;
+    int m_summaryRequestId = 0;
+
+    // Placeholder assistant row grown in place while a reply streams in
+    int m_streamingRow = -1;
+    QTimer *m_streamRefreshTimer;
+
+    // Persists each message as it is finalized; the streaming placeholder
+    // is only journaled once its reply completes
+    ConversationJournal *m_journal;
+
+    // Indexed copy used for browsing and queries across conversations
+    DatabaseService *m_database;
+
+    SimpleMoxieSwitcher::StorageService *m_storage;
+    QString m_journalDirectory;
+    quint64 m_loadGeneration = 0;
+    bool m_loading = false;
+
+    // Copies a reopened conversation into the database a batch per tick
+    // when it was journaled before the database existed
+    QTimer *m_backfillTimer;
+    int m_backfillRow = 0;
+    int m_backfillEnd = 0;
 
+    void startNewConversation();
+    void finishLoading(const QString &id, const Conversation &header, ChatHistory *history,
+                       const ChatHistory::ReplayState &state, int indexedCount);
+    void backfillDatabase();
+    void requestAssistantReply();
+    void updateRollingSummary();
+    void finishRollingSummary(const QString &conversationId, int summarizedCount,
+                              const QString &response, const QString &error);
+    void removeStreamingRow();
+    void flushStreamingRow();
+    void onStreamingData(int requestId, const QString &chunk);
+    void onRequestFinished(int requestId, const QString &response);
+    void onRequestFailed(int requestId, const QString &error);
     void processAIResponse(const QString &response);
 };
\ No newline at end of file
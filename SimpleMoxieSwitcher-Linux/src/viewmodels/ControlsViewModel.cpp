@@ -1,4 +1,6 @@
 #include "ControlsViewModel.h"
+#include "../services/AIProviderService.h"
+#include "../utils/DIContainer.h"
 #include <QDebug>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -35,6 +37,11 @@ void ControlsViewModel::setIsSleepMode(bool sleep) {
         m_isSleepMode = sleep;
         emit isSleepModeChanged();
         sendMqttCommand("moxie/control/sleep", sleep ? "true" : "false");
+
+        // Release the local model's memory while the robot sleeps
+        if (auto *aiService = DIContainer::instance().resolve<AIProviderService>()) {
+            aiService->setSleepMode(sleep);
+        }
     }
 }
 
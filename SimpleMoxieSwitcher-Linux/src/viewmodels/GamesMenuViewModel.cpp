@@ -1,8 +1,18 @@
 #include "GamesMenuViewModel.h"
-#include <QDebug>
+#include "../services/GameContentService.h"
+#include "../services/AIProviderService.h"
+#include "../utils/DIContainer.h"
 
 GamesMenuViewModel::GamesMenuViewModel(QObject *parent)
-    : QObject(parent) {
+    : QObject(parent)
+    , m_contentService(DIContainer::instance().resolve<GameContentService>()) {
+
+    if (!m_contentService) {
+        m_contentService = new GameContentService(DIContainer::instance().resolve<AIProviderService>(), this);
+    }
+
+    connect(m_contentService, &GameContentService::bufferChanged,
+            this, &GamesMenuViewModel::onBufferChanged);
 }
 
 void GamesMenuViewModel::loadStats() {
@@ -16,7 +26,60 @@ void GamesMenuViewModel::loadStats() {
     emit statsChanged();
 }
 
-void GamesMenuViewModel::startGame(const QString& gameType) {
-    qDebug() << "Starting game:" << gameType;
-    emit gameStarted(gameType);
+void GamesMenuViewModel::startGame(const QString& gameType, const QString& difficulty) {
+    GameType type = gameTypeFromString(gameType);
+    Difficulty level = difficultyFromString(difficulty);
+
+    m_hasPendingGame = false;
+    if (beginGame(type, level)) {
+        return;
+    }
+
+    // Nothing buffered yet (first launch or provider offline); the refill
+    // take() kicked off will start the game when its first batch lands
+    m_pendingType = type;
+    m_pendingDifficulty = level;
+    m_hasPendingGame = true;
+    setIsPreparingGame(true);
+}
+
+int GamesMenuViewModel::availableChallenges(const QString& gameType, const QString& difficulty) const {
+    return m_contentService->available(gameTypeFromString(gameType), difficultyFromString(difficulty));
+}
+
+bool GamesMenuViewModel::beginGame(GameType type, Difficulty difficulty) {
+    const QList<QJsonObject> challenges = m_contentService->take(type, difficulty, ChallengesPerGame);
+    if (challenges.isEmpty()) {
+        return false;
+    }
+
+    m_currentChallenges.clear();
+    for (const auto &challenge : challenges) {
+        m_currentChallenges.append(challenge.toVariantMap());
+    }
+    emit currentChallengesChanged();
+
+    setIsPreparingGame(false);
+    emit gameStarted(gameTypeToString(type));
+    return true;
+}
+
+void GamesMenuViewModel::onBufferChanged(int gameType, int difficulty, int available) {
+    if (!m_hasPendingGame || available == 0) {
+        return;
+    }
+    if (gameType == static_cast<int>(m_pendingType) && difficulty == static_cast<int>(m_pendingDifficulty)) {
+        // Cleared first because take() re-emits bufferChanged
+        m_hasPendingGame = false;
+        if (!beginGame(m_pendingType, m_pendingDifficulty)) {
+            m_hasPendingGame = true;
+        }
+    }
+}
+
+void GamesMenuViewModel::setIsPreparingGame(bool preparing) {
+    if (m_isPreparingGame != preparing) {
+        m_isPreparingGame = preparing;
+        emit isPreparingGameChanged();
+    }
 }
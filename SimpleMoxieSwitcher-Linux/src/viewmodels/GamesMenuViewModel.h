@@ -1,14 +1,19 @@
 #pragma once
 
 #include <QObject>
+#include <QVariantList>
 #include "../models/Games.h"
 
+class GameContentService;
+
 class GamesMenuViewModel : public QObject {
     Q_OBJECT
     Q_PROPERTY(int totalGamesPlayed READ totalGamesPlayed NOTIFY statsChanged)
     Q_PROPERTY(int totalPoints READ totalPoints NOTIFY statsChanged)
     Q_PROPERTY(int bestScore READ bestScore NOTIFY statsChanged)
     Q_PROPERTY(double averageAccuracy READ averageAccuracy NOTIFY statsChanged)
+    Q_PROPERTY(QVariantList currentChallenges READ currentChallenges NOTIFY currentChallengesChanged)
+    Q_PROPERTY(bool isPreparingGame READ isPreparingGame NOTIFY isPreparingGameChanged)
 
 public:
     explicit GamesMenuViewModel(QObject *parent = nullptr);
@@ -17,14 +22,33 @@ public:
     int totalPoints() const { return m_stats.totalPoints; }
     int bestScore() const { return m_stats.bestScore; }
     double averageAccuracy() const { return m_stats.averageAccuracy; }
+    QVariantList currentChallenges() const { return m_currentChallenges; }
+    bool isPreparingGame() const { return m_isPreparingGame; }
 
     Q_INVOKABLE void loadStats();
-    Q_INVOKABLE void startGame(const QString& gameType);
+    Q_INVOKABLE void startGame(const QString& gameType, const QString& difficulty = "Easy");
+    Q_INVOKABLE int availableChallenges(const QString& gameType, const QString& difficulty = "Easy") const;
 
 signals:
     void statsChanged();
     void gameStarted(const QString& gameType);
+    void currentChallengesChanged();
+    void isPreparingGameChanged();
+
+private slots:
+    void onBufferChanged(int gameType, int difficulty, int available);
 
 private:
+    bool beginGame(GameType type, Difficulty difficulty);
+    void setIsPreparingGame(bool preparing);
+
     GameStats m_stats;
+    GameContentService *m_contentService;
+    QVariantList m_currentChallenges;
+    bool m_isPreparingGame = false;
+    bool m_hasPendingGame = false;
+    GameType m_pendingType = GameType::Trivia;
+    Difficulty m_pendingDifficulty = Difficulty::Easy;
+
+    static constexpr int ChallengesPerGame = 10;
 };
@@ -1,24 +1,74 @@
 #include "UsageViewModel.h"
+#include "../services/DatabaseService.h"
+#include "../services/MaintenanceService.h"
+#include "../services/StorageService.h"
+#include "../services/UsageExporter.h"
+#include "../utils/DIContainer.h"
+#include "../utils/SeriesUtils.h"
 #include <QDebug>
-#include <QFile>
-#include <QTextStream>
+#include <QDir>
+#include <QStandardPaths>
 #include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace {
+
+struct UsageSnapshot {
+    UsageStore store;
+    UsageAggregates aggregates;
+    UsageRollups rollups;
+};
+
+} // namespace
 
 UsageViewModel::UsageViewModel(QObject *parent)
-    : QAbstractListModel(parent) {
+    : QAbstractListModel(parent)
+    , m_database(DIContainer::instance().resolve<DatabaseService>())
+    , m_maintenance(DIContainer::instance().resolve<MaintenanceService>())
+    , m_view(&m_store)
+    , m_exporter(new UsageExporter(this))
+    , m_storage(DIContainer::instance().resolveOrCreate<SimpleMoxieSwitcher::StorageService>(this)) {
+    if (!m_database) {
+        m_database = new DatabaseService(QString(), this);
+    }
+    if (!m_maintenance) {
+        m_maintenance = new MaintenanceService(m_database, nullptr, this);
+    }
+
+    // Rows rolled into daily totals in the background leave the list too
+    connect(m_maintenance, &MaintenanceService::usageRolledUp,
+            this, &UsageViewModel::dropRecordsBefore);
+
+    // Exporter signals arrive from its worker thread, queued
+    connect(m_exporter, &UsageExporter::progress, this, [this](double fraction) {
+        m_exportProgress = fraction;
+        emit exportProgressChanged();
+    });
+    connect(m_exporter, &UsageExporter::finished, this, [this](const QString &path) {
+        setExporting(false);
+        emit exportCompleted(path);
+    });
+    connect(m_exporter, &UsageExporter::failed, this, [this](const QString &error) {
+        setExporting(false);
+        emit exportFailed(error);
+    });
+    connect(m_exporter, &UsageExporter::canceled, this, [this]() {
+        setExporting(false);
+    });
     loadUsageData();
 }
 
 int UsageViewModel::rowCount(const QModelIndex &parent) const {
     Q_UNUSED(parent)
-    return m_filteredRecords.size();
+    return m_view.size();
 }
 
 QVariant UsageViewModel::data(const QModelIndex &index, int role) const {
-    if (!index.isValid() || index.row() >= m_filteredRecords.size())
+    if (!index.isValid() || index.row() >= m_view.size())
         return QVariant();
 
-    const UsageRecord &record = m_filteredRecords[index.row()];
+    const UsageRecord record = m_store.at(m_view.rowAt(index.row()));
 
     switch (role) {
         case FeatureRole:
@@ -53,198 +103,268 @@ QHash<int, QByteArray> UsageViewModel::roleNames() const {
 }
 
 double UsageViewModel::todayCost() const {
-    double cost = 0.0;
-    QDateTime today = QDateTime::currentDateTime();
-
-    for (const auto &record : m_records) {
-        if (record.timestamp.date() == today.date()) {
-            cost += record.estimatedCost;
-        }
-    }
-    return cost;
+    return m_aggregates.costOn(QDate::currentDate());
 }
 
 double UsageViewModel::weekCost() const {
-    double cost = 0.0;
-    QDateTime weekAgo = QDateTime::currentDateTime().addDays(-7);
-
-    for (const auto &record : m_records) {
-        if (record.timestamp >= weekAgo) {
-            cost += record.estimatedCost;
-        }
-    }
-    return cost;
+    // Today and the six calendar days before it
+    QDate today = QDate::currentDate();
+    return m_aggregates.costBetween(today.addDays(-6), today);
 }
 
 double UsageViewModel::monthCost() const {
-    double cost = 0.0;
-    QDateTime monthAgo = QDateTime::currentDateTime().addMonths(-1);
-
-    for (const auto &record : m_records) {
-        if (record.timestamp >= monthAgo) {
-            cost += record.estimatedCost;
-        }
-    }
-    return cost;
+    QDate today = QDate::currentDate();
+    return m_aggregates.costBetween(today.addMonths(-1), today);
 }
 
 int UsageViewModel::totalTokens() const {
-    int tokens = 0;
-    for (const auto &record : m_records) {
-        tokens += record.tokensUsed;
-    }
-    return tokens;
+    return int(qMin<qint64>(m_aggregates.totalTokens(), std::numeric_limits<int>::max()));
 }
 
 int UsageViewModel::totalSessions() const {
-    QSet<QString> sessions;
-    for (const auto &record : m_records) {
-        sessions.insert(record.sessionId);
-    }
-    return sessions.size();
+    return m_aggregates.sessionCount();
 }
 
 QString UsageViewModel::mostUsedModel() const {
-    QMap<QString, int> modelCounts;
-    for (const auto &record : m_records) {
-        modelCounts[record.aiModel]++;
-    }
-
-    QString mostUsed;
-    int maxCount = 0;
-    for (auto it = modelCounts.begin(); it != modelCounts.end(); ++it) {
-        if (it.value() > maxCount) {
-            maxCount = it.value();
-            mostUsed = it.key();
-        }
-    }
-    return mostUsed;
+    return m_aggregates.mostUsedModel();
 }
 
 QString UsageViewModel::mostActiveChild() const {
-    QMap<QString, int> childCounts;
-    for (const auto &record : m_records) {
-        childCounts[record.childProfileId]++;
+    return m_aggregates.mostActiveChild();
+}
+
+QVariantList UsageViewModel::usageSeries(const QString &metric, const QString &resolution,
+                                         const QString &groupBy, const QString &key,
+                                         const QDateTime &from, const QDateTime &to, int maxPoints) const {
+    const auto m = metric == "cost" ? UsageRollups::Cost
+                 : metric == "requests" ? UsageRollups::Requests
+                                        : UsageRollups::Tokens;
+    const auto r = resolution == "hour" ? UsageRollups::Hour
+                 : resolution == "week" ? UsageRollups::Week
+                                        : UsageRollups::Day;
+    const auto g = groupBy == "model" ? UsageRollups::ByModel
+                 : groupBy == "child" ? UsageRollups::ByChild
+                                      : UsageRollups::Total;
+
+    QList<QPointF> points = m_rollups.series(r, m, g, key, from, to);
+    if (maxPoints > 0) {
+        points = SeriesUtils::downsampleLttb(points, maxPoints);
     }
 
-    QString mostActive;
-    int maxCount = 0;
-    for (auto it = childCounts.begin(); it != childCounts.end(); ++it) {
-        if (it.value() > maxCount) {
-            maxCount = it.value();
-            mostActive = it.key();
-        }
+    QVariantList result;
+    result.reserve(points.size());
+    for (const QPointF &point : std::as_const(points)) {
+        result.append(point);
     }
-    return mostActive;
+    return result;
+}
+
+QStringList UsageViewModel::seriesKeys(const QString &groupBy) const {
+    return m_rollups.keys(groupBy == "child" ? UsageRollups::ByChild : UsageRollups::ByModel);
 }
 
 void UsageViewModel::loadUsageData() {
-    beginResetModel();
+    const quint64 generation = ++m_loadGeneration;
+    m_loading = true;
+
+    // Our own queued writes must be visible to the loader's connection
+    m_database->flush();
+    const QString path = m_database->path();
+
+    m_storage->runAsync([path]() {
+        UsageSnapshot snapshot;
+        DatabaseService database(path);
+        database.readSnapshot([&]() {
+            for (const auto &record : database.usageRecords(QDateTime(), QDateTime())) {
+                snapshot.store.insert(record);
+                snapshot.aggregates.add(record);
+                snapshot.rollups.add(record);
+            }
 
-    // TODO: Load from database
-    // For now, create sample data
-    for (int i = 0; i < 50; ++i) {
-        UsageRecord record;
-        record.childProfileId = QString("child_%1").arg(i % 3);
-        record.feature = i % 4 == 0 ? "chat" : i % 4 == 1 ? "game" : i % 4 == 2 ? "story" : "learning";
-        record.aiModel = i % 3 == 0 ? "gpt-4" : i % 3 == 1 ? "gpt-3.5-turbo" : "claude-3-sonnet";
-        record.tokensUsed = 100 + (rand() % 900);
-        record.estimatedCost = record.calculateCost(record.tokensUsed, record.aiModel);
-        record.timestamp = QDateTime::currentDateTime().addDays(-(rand() % 30));
-        record.durationSeconds = 30 + (rand() % 300);
-        record.sessionId = QString("session_%1").arg(i / 5);
-
-        m_records.append(record);
-    }
+            // Days already rolled up by maintenance still feed the day and week charts
+            for (const auto &day : database.dailyUsage(QDate(1970, 1, 1), QDate::currentDate())) {
+                snapshot.rollups.addDaily(day.day, day.aiModel, day.childProfileId, day.tokensUsed,
+                                          day.estimatedCost, day.requests);
+            }
+        });
+        return snapshot;
+    }).then(this, [this, generation](const UsageSnapshot &snapshot) {
+        if (generation != m_loadGeneration) {
+            return;     // a newer load is on its way
+        }
+        m_loading = false;
+
+        beginResetModel();
+        m_store = snapshot.store;
+        m_aggregates = snapshot.aggregates;
+        m_rollups = snapshot.rollups;
+
+        // The loader may or may not have seen these, depending on timing
+        for (const auto &record : std::exchange(m_recordedWhileLoading, {})) {
+            if (!containsRecord(record)) {
+                m_store.insert(record);
+                m_aggregates.add(record);
+                m_rollups.add(record);
+            }
+        }
+        applyFilters();
+        endResetModel();
 
-    m_filteredRecords = m_records;
-    endResetModel();
+        const QDateTime cutoff = std::exchange(m_rolledUpWhileLoading, QDateTime());
+        if (cutoff.isValid()) {
+            dropRecordsBefore(cutoff);
+        }
+        emit statsChanged();
+    });
+}
 
-    emit statsChanged();
+bool UsageViewModel::containsRecord(const UsageRecord &record) const {
+    if (record.id.isEmpty()) {
+        return false;
+    }
+    for (int row = m_store.lowerBound(record.timestamp); row < m_store.size(); ++row) {
+        if (m_store.timestampAt(row) != record.timestamp.toMSecsSinceEpoch()) {
+            break;
+        }
+        if (m_store.at(row).id == record.id) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void UsageViewModel::exportToCSV() {
-    QString filePath = "usage_export_" + QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss") + ".csv";
-    QFile file(filePath);
-
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream stream(&file);
-
-        // Header
-        stream << "Date,Time,Child,Feature,Model,Tokens,Cost,Duration\n";
-
-        // Data
-        for (const auto &record : m_filteredRecords) {
-            stream << record.timestamp.toString("yyyy-MM-dd") << ","
-                   << record.timestamp.toString("hh:mm:ss") << ","
-                   << record.childProfileId << ","
-                   << record.feature << ","
-                   << record.aiModel << ","
-                   << record.tokensUsed << ","
-                   << record.estimatedCost << ","
-                   << record.durationSeconds << "\n";
-        }
+    startExport(int(UsageExporter::Format::Csv), "csv");
+}
+
+void UsageViewModel::exportColumnar() {
+    startExport(int(UsageExporter::Format::Columnar), "cbor");
+}
+
+void UsageViewModel::cancelExport() {
+    m_exporter->cancel();
+}
+
+void UsageViewModel::startExport(int format, const QString &extension) {
+    if (m_isExporting)
+        return;
+
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+    if (directory.isEmpty()) {
+        directory = m_storage->dataPath() + "/exports";
+    }
+    QDir().mkpath(directory);
+    QString filePath = directory + "/usage_export_"
+        + QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss") + "." + extension;
+
+    // The exporter works on a snapshot, so recording usage meanwhile is fine
+    if (m_exporter->start(UsageExporter::Format(format), m_store, m_view.filter(), filePath)) {
+        m_exportProgress = 0.0;
+        emit exportProgressChanged();
+        setExporting(true);
+    }
+}
 
-        file.close();
-        emit exportCompleted(filePath);
+void UsageViewModel::setExporting(bool exporting) {
+    if (m_isExporting != exporting) {
+        m_isExporting = exporting;
+        emit isExportingChanged();
     }
 }
 
 void UsageViewModel::clearOldData() {
-    QDateTime cutoff = QDateTime::currentDateTime().addMonths(-3);
+    // Old rows are rolled into daily totals off the hot path; the model
+    // follows along through usageRolledUp
+    m_maintenance->runNow();
+}
 
-    beginResetModel();
-    m_records.erase(std::remove_if(m_records.begin(), m_records.end(),
-        [cutoff](const UsageRecord &record) {
-            return record.timestamp < cutoff;
-        }), m_records.end());
+void UsageViewModel::dropRecordsBefore(const QDateTime &cutoff) {
+    if (m_loading) {
+        if (!m_rolledUpWhileLoading.isValid() || cutoff > m_rolledUpWhileLoading) {
+            m_rolledUpWhileLoading = cutoff;
+        }
+        return;
+    }
 
-    applyFilters();
-    endResetModel();
+    // Store rows are in timestamp order, so old rows are a prefix of the
+    // store and of the (ascending) visible rows
+    const int dropped = m_store.lowerBound(cutoff);
+    if (dropped == 0) {
+        return;
+    }
+    for (int row = 0; row < dropped; ++row) {
+        const UsageRecord record = m_store.at(row);
+        m_aggregates.remove(record);
+        m_rollups.removeHourly(record);
+    }
+
+    const int count = m_view.countBefore(dropped);
+    if (count > 0) {
+        beginRemoveRows(QModelIndex(), 0, count - 1);
+    }
+    m_store.removeBefore(cutoff);
+    m_view.rebuild();
+    if (count > 0) {
+        endRemoveRows();
+    }
 
     emit statsChanged();
 }
 
 void UsageViewModel::recordUsage(const UsageRecord &record) {
-    beginInsertRows(QModelIndex(), m_records.size(), m_records.size());
-    m_records.append(record);
+    m_database->recordUsage(record);
+    if (m_loading) {
+        m_recordedWhileLoading.append(record);
+        return;
+    }
 
-    // Add to filtered if it passes current filters
-    m_filteredRecords.append(record);
+    const int row = m_store.insert(record);
+    m_aggregates.add(record);
+    m_rollups.add(record);
 
-    endInsertRows();
+    if (row == m_store.size() - 1) {
+        // The usual case: only the new row needs checking against the filters
+        const int position = m_view.size();
+        if (m_view.appendIfMatches(row)) {
+            beginInsertRows(QModelIndex(), position, position);
+            endInsertRows();
+        }
+    } else {
+        // A backdated record renumbers the rows after it
+        beginResetModel();
+        m_view.rebuild();
+        endResetModel();
+    }
 
     emit statsChanged();
 }
 
 void UsageViewModel::filterByChild(const QString &childId) {
-    beginResetModel();
-
-    if (childId.isEmpty()) {
-        m_filteredRecords = m_records;
-    } else {
-        m_filteredRecords.clear();
-        for (const auto &record : m_records) {
-            if (record.childProfileId == childId) {
-                m_filteredRecords.append(record);
-            }
-        }
-    }
+    UsageView::Filter filter = m_view.filter();
+    filter.childProfileId = childId;
+    setFilter(filter);
+}
 
-    endResetModel();
-    emit statsChanged();
+void UsageViewModel::filterByModel(const QString &model) {
+    UsageView::Filter filter = m_view.filter();
+    filter.aiModel = model;
+    setFilter(filter);
 }
 
 void UsageViewModel::filterByDateRange(const QDateTime &start, const QDateTime &end) {
-    beginResetModel();
+    UsageView::Filter filter = m_view.filter();
+    filter.start = start;
+    filter.end = end;
+    setFilter(filter);
+}
 
-    m_filteredRecords.clear();
-    for (const auto &record : m_records) {
-        if (record.timestamp >= start && record.timestamp <= end) {
-            m_filteredRecords.append(record);
-        }
-    }
+void UsageViewModel::clearFilters() {
+    setFilter(UsageView::Filter());
+}
 
+void UsageViewModel::setFilter(const UsageView::Filter &filter) {
+    beginResetModel();
+    m_view.setFilter(filter);
     endResetModel();
     emit statsChanged();
 }
@@ -255,5 +375,5 @@ void UsageViewModel::calculateStats() {
 
 void UsageViewModel::applyFilters() {
     // Apply any active filters
-    m_filteredRecords = m_records;
+    m_view.rebuild();
 }
\ No newline at end of file
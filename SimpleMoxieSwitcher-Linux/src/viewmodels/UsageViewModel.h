@@ -1,7 +1,19 @@
 #pragma once
 #include <QObject>
 #include <QAbstractListModel>
+#include <QVariantList>
 #include "../models/UsageRecord.h"
+#include "../services/UsageAggregates.h"
+#include "../services/UsageRollups.h"
+#include "../services/UsageStore.h"
+#include "../services/UsageView.h"
+
+class DatabaseService;
+class MaintenanceService;
+class UsageExporter;
+namespace SimpleMoxieSwitcher {
+class StorageService;
+}
 
 class UsageViewModel : public QAbstractListModel {
     Q_OBJECT
@@ -12,6 +24,8 @@ class UsageViewModel : public QAbstractListModel {
     Q_PROPERTY(int totalSessions READ totalSessions NOTIFY statsChanged)
     Q_PROPERTY(QString mostUsedModel READ mostUsedModel NOTIFY statsChanged)
     Q_PROPERTY(QString mostActiveChild READ mostActiveChild NOTIFY statsChanged)
+    Q_PROPERTY(bool isExporting READ isExporting NOTIFY isExportingChanged)
+    Q_PROPERTY(double exportProgress READ exportProgress NOTIFY exportProgressChanged)
 
 public:
     enum UsageRoles {
@@ -38,22 +52,69 @@ public:
     QString mostUsedModel() const;
     QString mostActiveChild() const;
 
+    bool isExporting() const { return m_isExporting; }
+    double exportProgress() const { return m_exportProgress; }
+
+    // Chart series from the rollups: metric is "tokens", "cost" or
+    // "requests"; resolution "hour", "day" or "week"; groupBy "", "model" or
+    // "child" with key naming which one. Points are {x: ms since epoch, y},
+    // reduced to maxPoints with LTTB when maxPoints > 0.
+    Q_INVOKABLE QVariantList usageSeries(const QString &metric, const QString &resolution,
+                                         const QString &groupBy = QString(), const QString &key = QString(),
+                                         const QDateTime &from = QDateTime(), const QDateTime &to = QDateTime(),
+                                         int maxPoints = 0) const;
+    Q_INVOKABLE QStringList seriesKeys(const QString &groupBy) const;
+
 public slots:
+    // Reads the history on the I/O thread; the model fills in when it's done
     void loadUsageData();
+    // Exports the rows currently shown, in the background, to the
+    // documents folder; exportCompleted carries the file path
     void exportToCSV();
+    void exportColumnar();
+    void cancelExport();
     void clearOldData();
     void recordUsage(const UsageRecord &record);
+    // Filters combine; an empty value or invalid date turns that part off
     void filterByChild(const QString &childId);
+    void filterByModel(const QString &model);
     void filterByDateRange(const QDateTime &start, const QDateTime &end);
+    void clearFilters();
 
 signals:
     void statsChanged();
     void exportCompleted(const QString &filePath);
+    void exportFailed(const QString &error);
+    void isExportingChanged();
+    void exportProgressChanged();
 
 private:
-    QList<UsageRecord> m_records;
-    QList<UsageRecord> m_filteredRecords;
+    DatabaseService *m_database;
+    MaintenanceService *m_maintenance;
+    UsageStore m_store;
+    UsageView m_view;       // rows shown, as indexes into m_store
+
+    // Stats over m_store, updated on every insert and expiry
+    UsageAggregates m_aggregates;
+    UsageRollups m_rollups;
+
+    UsageExporter *m_exporter;
+    bool m_isExporting = false;
+    double m_exportProgress = 0.0;
+
+    // Loads run on the storage I/O thread with a database connection of
+    // their own; usage recorded or rolled up meanwhile is applied on top
+    SimpleMoxieSwitcher::StorageService *m_storage;
+    quint64 m_loadGeneration = 0;
+    bool m_loading = false;
+    QList<UsageRecord> m_recordedWhileLoading;
+    QDateTime m_rolledUpWhileLoading;
 
     void calculateStats();
     void applyFilters();
+    void startExport(int format, const QString &extension);
+    void setExporting(bool exporting);
+    void setFilter(const UsageView::Filter &filter);
+    void dropRecordsBefore(const QDateTime &cutoff);
+    bool containsRecord(const UsageRecord &record) const;
 };
\ No newline at end of file